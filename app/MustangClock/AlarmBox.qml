@@ -2,39 +2,123 @@ import QtQuick 2.15
 import QtQuick.Controls 2.15
 
 GroupBox {
-    title: "Alarm"
+    title: "Alarms"
 
-    property var config: ({
-        "hh": hour.value,
-        "mm": minute.value,
-        "enabled": enable.checked
-    })
+    // Matches MCFG_ALARMS_MAX in protocol/mustang_cfg.h
+    readonly property int maxAlarms: 16
+    readonly property var dayNames: ["S", "M", "T", "W", "T", "F", "S"]
+
+    // The whole table, sent in one message as { "alarms": alarmBox.alarms() }
+    function alarms() {
+        var list = []
+        for (var i = 0; i < alarmModel.count; i++) {
+            var a = alarmModel.get(i)
+            list.push({
+                "hh": a.hh,
+                "mm": a.mm,
+                "days": a.days,
+                "enabled": a.enabled,
+                "oneshot": a.oneshot,
+                "snooze": a.snooze
+            })
+        }
+        return list
+    }
+
+    ListModel {
+        id: alarmModel
+        ListElement { hh: 6; mm: 30; days: 62; enabled: true; oneshot: false; snooze: 9 }
+    }
 
     Column {
         spacing: 8
 
-        Row {
-            spacing: 8
+        Repeater {
+            model: alarmModel
 
-            SpinBox {
-                id: hour
-                from: 0
-                to: 23
-            }
+            delegate: Column {
+                id: entry
+                spacing: 4
+
+                property int row: index
+                property int dayMask: model.days
+
+                Row {
+                    spacing: 8
+
+                    SpinBox {
+                        from: 0
+                        to: 23
+                        value: model.hh
+                        onValueModified: model.hh = value
+                    }
+
+                    Text { text: ":" }
+
+                    SpinBox {
+                        from: 0
+                        to: 59
+                        value: model.mm
+                        onValueModified: model.mm = value
+                    }
+
+                    Button {
+                        text: "✕"
+                        onClicked: alarmModel.remove(index)
+                    }
+                }
+
+                // Bit n is tm_wday n, Sunday first
+                Row {
+                    spacing: 2
+
+                    Repeater {
+                        model: 7
+                        delegate: Button {
+                            required property int index
+                            width: 28
+                            text: dayNames[index]
+                            checkable: true
+                            checked: (entry.dayMask >> index) & 1
+                            onToggled: alarmModel.setProperty(entry.row, "days",
+                                                              checked ? entry.dayMask | (1 << index)
+                                                                      : entry.dayMask & ~(1 << index))
+                        }
+                    }
+                }
+
+                Row {
+                    spacing: 8
+
+                    CheckBox {
+                        text: "On"
+                        checked: model.enabled
+                        onToggled: model.enabled = checked
+                    }
+
+                    CheckBox {
+                        text: "Once"
+                        checked: model.oneshot
+                        onToggled: model.oneshot = checked
+                    }
 
-            Text { text: ":" }
+                    SpinBox {
+                        from: 1
+                        to: 30
+                        value: model.snooze
+                        onValueModified: model.snooze = value
+                    }
 
-            SpinBox {
-                id: minute
-                from: 0
-                to: 59
+                    Text { text: "min snooze" }
+                }
             }
         }
 
-        CheckBox {
-            id: enable
-            text: "Enable alarm"
-            checked: true
+        Button {
+            text: "Add alarm"
+            enabled: alarmModel.count < maxAlarms
+            onClicked: alarmModel.append({ "hh": 7, "mm": 0, "days": 127, "enabled": true,
+                                           "oneshot": false, "snooze": 9 })
         }
     }
 }
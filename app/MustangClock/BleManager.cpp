@@ -1,45 +1,123 @@
 // blemanager.cpp
 #include "BleManager.h"
+#include "QtBleTransport.h"
 #include <QJsonDocument>
 #include <QBluetoothDeviceInfo>
 #include <QDebug>
-#include <QBluetoothLocalDevice>
+#include <QElapsedTimer>
 
-BleManager::BleManager(QObject *parent) : QObject(parent)
+#include "mustang_cfg.h"
+#include "mustang_fx.h"
+
+BleManager::BleManager(QObject *parent) : BleManager(new QtBleBackend, parent)
+{
+}
+
+BleManager::BleManager(BleBackend *bleBackend, QObject *parent)
+    : QObject(parent), backend(bleBackend)
+{
+    backend->setParent(this);
+
+    creditTimer = new QTimer(this);
+    creditTimer->setInterval(kDefaultIntervalMs);
+    connect(creditTimer, &QTimer::timeout, this, [=]() {
+        writeCredits = kMaxWriteCredits;
+        pumpWrites();
+    });
+
+    profileIdleTimer = new QTimer(this);
+    profileIdleTimer->setSingleShot(true);
+    profileIdleTimer->setInterval(kProfileIdleMs);
+    connect(profileIdleTimer, &QTimer::timeout, this, [=]() {
+        requestConnectionUpdate(ConnectionProfile::LowPower);
+    });
+
+    deviceModel = new DeviceListModel(this);
+    fleetProvisioner = new FleetProvisioner(backend, this);
+
+    connect(backend, &BleBackend::deviceDiscovered, this, &BleManager::onAdvertisement);
+
+    connect(backend, &BleBackend::scanFinished, this, [=]() {
+        setScanning(false);
+        qDebug() << "Scan window closed," << deviceModel->rowCount() << "clock(s) after"
+                 << scanTimer.elapsed() << "ms";
+        if (!fleetScan && deviceModel->rowCount() > 0)
+            connectToIndex(0);
+    });
+
+    connect(backend, &BleBackend::scanError, this, [=](const QString &error) {
+        qDebug() << "Scan error:" << error;
+        setScanning(false);
+    });
+}
+
+void BleManager::onAdvertisement(const QBluetoothDeviceInfo &info)
 {
-    discoveryAgent = new QBluetoothDeviceDiscoveryAgent(this);
-    localDevice = new QBluetoothLocalDevice(this);
+    if (!(info.coreConfigurations() & QBluetoothDeviceInfo::LowEnergyCoreConfiguration))
+        return;
 
-    connect(discoveryAgent, &QBluetoothDeviceDiscoveryAgent::deviceDiscovered,
-            this, [=](const QBluetoothDeviceInfo &info) {
-                qDebug() << "Found device:" << info.name();
+    // Older firmware only has the name in its advertisement
+    if (!info.serviceUuids().contains(SERVICE_UUID) && !info.name().contains("MUSTANG"))
+        return;
+
+    const bool known = backend->isKnownDevice(info);
+    const int row = deviceModel->upsert(info, known);
+    qDebug() << "Clock" << info.name() << DeviceListModel::idOf(info) << "RSSI" << info.rssi()
+             << (known ? "(known)" : "") << "rank" << row << "after" << scanTimer.elapsed() << "ms";
+    emit deviceFound();
 
-                if (info.name().contains("MUSTANG")) {
-                    discoveryAgent->stop();
-                    qDebug() << "Device found, storing info...";
-                    lastFoundInfo = info;  // store for later connection
-                    connectToDevice();
-                }
-            });
+    // A known clock close by and leading the list: no point scanning on
+    if (!fleetScan && known && row == 0 && info.rssi() >= kStrongRssi) {
+        qDebug() << "Strongest known clock found, stopping scan";
+        backend->stopScan();
+        setScanning(false);
+        connectToIndex(0);
+    }
 }
 
-void BleManager::cleanupController() {
-    if (!controller) return;
-
-    // Disconnect if still connected
-    if (controller->state() != QLowEnergyController::UnconnectedState) {
-        connect(controller, &QLowEnergyController::disconnected, controller, [=]() {
-            qDebug() << "Old controller fully disconnected, deleting...";
-            controller->deleteLater();
-        });
-        controller->disconnectFromDevice();
-    } else {
-        controller->deleteLater();
+void BleManager::setScanning(bool active)
+{
+    if (scanActive == active)
+        return;
+    scanActive = active;
+    emit scanningChanged();
+}
+
+void BleManager::connectToIndex(int row)
+{
+    const QBluetoothDeviceInfo info = deviceModel->deviceAt(row);
+    if (!info.isValid())
+        return;
+
+    if (backend->isScanning()) {
+        backend->stopScan();
+        setScanning(false);
     }
 
-    controller = nullptr;
-    configService = nullptr;
-    configChar = QLowEnergyCharacteristic();  // reset
+    lastFoundInfo = info;  // store for later connection
+    connectToDevice();
+}
+
+void BleManager::cleanupController() {
+    if (!transport) return;
+
+    // Drop the link without hearing back from it
+    transport->disconnect(this);
+    transport->disconnectFromDevice();
+    transport->deleteLater();
+
+    transport = nullptr;
+    outbound.clear();
+    pendingFragments.clear();
+    currentSection.clear();
+    unconfirmedSections.clear();
+    writeInFlight = false;
+    inFlightFragment.clear();
+    creditTimer->stop();
+    profileIdleTimer->stop();
+    profile = ConnectionProfile::None;
+    intervalMs = -1;
+    emit connectionProfileChanged();
 }
 
 void BleManager::connectToDevice() {
@@ -48,71 +126,105 @@ void BleManager::connectToDevice() {
         return;
     }
 
-    // Clean up any old controller
+    // Clean up any old link
     cleanupController();
 
-    // Create fresh controller
-    controller = QLowEnergyController::createCentral(lastFoundInfo, this);
-    if (!controller) {
-        qWarning() << "Failed to create QLowEnergyController";
-        return;
-    }
+    connectTimer.start();
+    readyLatencyMs = -1;
+    firstWriteLatencyMs = -1;
+    emit latencyChanged();
 
-    // Pair only if not already paired
-    if (localDevice->pairingStatus(lastFoundInfo.address()) != QBluetoothLocalDevice::Paired) {
-        qDebug() << "Requesting pairing...";
-        localDevice->requestPairing(lastFoundInfo.address(), QBluetoothLocalDevice::Paired);
-    }
+    transport = backend->createTransport(this);
+    backend->requestPairing(lastFoundInfo);
 
-    // Signals
-    connect(controller, &QLowEnergyController::connected, this, [=]() {
-        qDebug() << "Connected, discovering services...";
-        emit connected();
-        controller->discoverServices();
-    });
+    connect(transport, &BleTransport::connected, this, &BleManager::connected);
+    connect(transport, &BleTransport::disconnected, this, &BleManager::disconnected);
+    connect(transport, &BleTransport::ready, this, &BleManager::onTransportReady);
 
-    connect(controller, &QLowEnergyController::disconnected, this, [=]() {
-        qDebug() << "Disconnected";
-        emit disconnected();
+    connect(transport, &BleTransport::errorOccurred, this, [=](const QString &error) {
+        qDebug() << "BLE link error:" << error;
     });
 
-    connect(controller, &QLowEnergyController::serviceDiscovered, this, [=](const QBluetoothUuid &uuid){
-        if (uuid == SERVICE_UUID) qDebug() << "Config service found";
+    // Credits are refilled once per connection event
+    connect(transport, &BleTransport::connectionIntervalChanged, this, [=](int ms) {
+        qDebug() << "Connection interval" << ms << "ms," << connectionProfile() << "profile requested";
+        creditTimer->setInterval(ms);
+        intervalMs = ms;
+        emit connectionProfileChanged();
     });
 
-    connect(controller, &QLowEnergyController::discoveryFinished, this, [=]() {
-        configService = controller->createServiceObject(SERVICE_UUID, this);
-        if (!configService) {
-            qDebug() << "Service creation failed";
-            return;
-        }
-
-        connect(configService, &QLowEnergyService::stateChanged, this, [=](QLowEnergyService::ServiceState s){
-            if (s == QLowEnergyService::RemoteServiceDiscovered) {
-                configChar = configService->characteristic(CONFIG_CHAR_UUID);
-                qDebug() << "Characteristic ready";
-                for (auto c : configService->characteristics()) {
-                    qDebug() << "  UUID:" << c.uuid();
-                }
-            }
-        });
-
-        configService->discoverDetails();
+    // Only with-response writes are confirmed; some backends also report
+    // without-response writes, and one of those still queued may arrive once
+    // the sync write is in flight, so it has to match the sync bytes
+    connect(transport, &BleTransport::written, this, [=](const QByteArray &value) {
+        if (writeInFlight && value == inFlightFragment)
+            onWriteDone(true);
     });
 
-    connect(controller, &QLowEnergyController::errorOccurred, this, [=](QLowEnergyController::Error error){
-        qDebug() << "BLE controller error:" << error;
+    connect(transport, &BleTransport::writeFailed, this, [=]() {
+        qDebug() << "Config write failed, dropping" << currentSection;
+        onWriteDone(false);
     });
 
-    connect(controller, &QLowEnergyController::connectionUpdated, this, [=](const QLowEnergyConnectionParameters &params){
-        qDebug() << "BLE connection updated:"
-                 << "Latency:" << params.latency()
-                 << "Supervision Timeout:" << params.supervisionTimeout();
-    });
+    transport->connectToDevice(lastFoundInfo);
+}
+
+void BleManager::onTransportReady()
+{
+    readyLatencyMs = connectTimer.elapsed();
+    qDebug() << "Characteristic ready after" << readyLatencyMs << "ms"
+             << (transport->layoutCached() ? "(cached layout)" : "(first discovery)");
+    emit latencyChanged();
+
+    // Writes queued while connecting go out now
+    pumpWrites();
+}
 
-    // Initiate connection
-    qDebug() << "Starting connection to device...";
-    controller->connectToDevice();
+void BleManager::onWriteDone(bool ok)
+{
+    writeInFlight = false;
+    inFlightFragment.clear();
+    if (!ok) {
+        pendingFragments.clear();
+        finishItem(false);
+    } else if (pendingFragments.isEmpty()) {
+        finishItem(true);
+    }
+    pumpWrites();
+}
+
+QString BleManager::connectionProfile() const
+{
+    switch (profile) {
+    case ConnectionProfile::Fast:
+        return QStringLiteral("fast");
+    case ConnectionProfile::LowPower:
+        return QStringLiteral("lowPower");
+    default:
+        return QString();
+    }
+}
+
+void BleManager::requestConnectionUpdate(ConnectionProfile next)
+{
+    if (!transport || next == profile || next == ConnectionProfile::None)
+        return;
+
+    QLowEnergyConnectionParameters params;
+    if (next == ConnectionProfile::Fast) {
+        params.setIntervalRange(7.5, 15);
+        params.setLatency(0);
+        params.setSupervisionTimeout(4000);
+    } else {
+        params.setIntervalRange(100, 200);
+        params.setLatency(4);
+        params.setSupervisionTimeout(6000);
+    }
+
+    profile = next;
+    qDebug() << "Requesting" << connectionProfile() << "connection profile";
+    transport->requestConnectionUpdate(params);
+    emit connectionProfileChanged();
 }
 
 BleManager::~BleManager() {
@@ -121,38 +233,447 @@ BleManager::~BleManager() {
 
 void BleManager::startScan()
 {
-    qDebug() << "Scanning...";
-    discoveryAgent->start();
+    beginScan(false);
+}
+
+void BleManager::scanFleet()
+{
+    beginScan(true);
+}
+
+void BleManager::beginScan(bool fleet)
+{
+    if (backend->isScanning())
+        return;
+
+    fleetScan = fleet;
+    qDebug() << "Scanning for" << kScanWindowMs << "ms" << (fleet ? "(fleet)" : "") << "...";
+    deviceModel->clear();
+    scanTimer.start();
+    setScanning(true);
+    backend->startScan(kScanWindowMs);
+}
+
+void BleManager::setBinaryConfig(bool enabled)
+{
+    if (useBinaryConfig == enabled)
+        return;
+    useBinaryConfig = enabled;
+    emit binaryConfigChanged();
+}
+
+void BleManager::setWriteWithoutResponse(bool enabled)
+{
+    if (useWriteWithoutResponse == enabled)
+        return;
+    useWriteWithoutResponse = enabled;
+    emit writeWithoutResponseChanged();
+}
+
+QByteArray BleManager::encodeBinaryConfig(const QVariantMap &cfg)
+{
+    uint8_t buf[512];
+    mcfg_writer_t w;
+    mcfg_writer_init(&w, buf, sizeof(buf));
+
+    if (cfg.contains("wifi")) {
+        const QVariantMap wifi = cfg.value("wifi").toMap();
+        const QByteArray ssid = wifi.value("ssid").toString().toUtf8();
+        const QByteArray psk = wifi.value("psk").toString().toUtf8();
+        if (ssid.size() > MCFG_SSID_MAX || psk.size() > MCFG_PSK_MAX)
+            return QByteArray();
+        mcfg_put(&w, MCFG_TAG_WIFI_SSID, ssid.constData(), uint8_t(ssid.size()));
+        mcfg_put(&w, MCFG_TAG_WIFI_PSK, psk.constData(), uint8_t(psk.size()));
+    }
+
+    if (cfg.contains("time")) {
+        const QVariantMap time = cfg.value("time").toMap();
+        mcfg_put_time(&w, uint8_t(time.value("hh").toInt()), uint8_t(time.value("mm").toInt()));
+    }
+
+    if (cfg.contains("alarm")) {
+        const QVariantMap alarm = cfg.value("alarm").toMap();
+        mcfg_put_alarm(&w,
+                       uint8_t(alarm.value("hh").toInt()),
+                       uint8_t(alarm.value("mm").toInt()),
+                       alarm.value("enabled").toBool() ? MCFG_ALARM_F_ENABLED : 0);
+    }
+
+    // The whole alarm table in one TLV, replacing the clock's table
+    if (cfg.contains("alarms")) {
+        const QVariantList alarms = cfg.value("alarms").toList();
+        uint8_t entries[MCFG_ALARMS_MAX * MCFG_ALARM_ENTRY_LEN];
+        if (alarms.size() > MCFG_ALARMS_MAX)
+            return QByteArray();
+
+        for (qsizetype i = 0; i < alarms.size(); ++i) {
+            const QVariantMap a = alarms.at(i).toMap();
+            const uint8_t flags = (a.value("enabled", true).toBool() ? MCFG_ALARM_F_ENABLED : 0)
+                                  | (a.value("oneshot").toBool() ? MCFG_ALARM_F_ONESHOT : 0);
+            mcfg_alarm_entry(entries + i * MCFG_ALARM_ENTRY_LEN,
+                             uint8_t(a.value("hh").toInt()),
+                             uint8_t(a.value("mm").toInt()),
+                             uint8_t(a.value("days", MCFG_ALARM_DAYS_ALL).toInt()),
+                             flags,
+                             uint8_t(a.value("snooze").toInt()));
+        }
+        mcfg_put_alarms(&w, entries, uint8_t(alarms.size()));
+    }
+
+    // Alarm effect program, an empty list puts the firmware default back
+    if (cfg.contains("fx")) {
+        QByteArray program;
+        if (!encodeEffect(cfg.value("fx").toList(), &program))
+            return QByteArray();
+        mcfg_put_fx(&w, reinterpret_cast<const uint8_t *>(program.constData()),
+                    uint8_t(program.size()));
+    }
+
+    // End of a session: the clock persists now instead of after its debounce
+    if (cfg.value("commit").toBool())
+        mcfg_put_commit(&w);
+
+    if (w.overflow)
+        return QByteArray();
+
+    return QByteArray(reinterpret_cast<const char *>(buf), qsizetype(w.len));
+}
+
+bool BleManager::encodeEffect(const QVariantList &steps, QByteArray *program)
+{
+    // Durations are given in ms, the clock counts MFX_TICK_MS ticks
+    const auto ticks = [](const QVariantMap &step) {
+        return uint8_t(qBound(1, (step.value("ms").toInt() + MFX_TICK_MS / 2) / MFX_TICK_MS, 255));
+    };
+    QByteArray prog;
+
+    if (steps.isEmpty()) {
+        program->clear();
+        return true;
+    }
+
+    for (const QVariant &v : steps) {
+        const QVariantMap step = v.toMap();
+        const QString op = step.value("op").toString();
+
+        if (op == "segments") {
+            const QVariantList digits = step.value("digits").toList();
+            prog.append(char(MFX_OP_SEGS));
+            for (int i = 0; i < MFX_DIGITS; ++i)
+                prog.append(char(digits.value(i).toInt()));
+        } else if (op == "clock") {
+            prog.append(char(MFX_OP_CLOCK));
+        } else if (op == "blank") {
+            prog.append(char(MFX_OP_BLANK));
+        } else if (op == "level") {
+            prog.append(char(MFX_OP_LEVEL));
+            prog.append(char((step.value("level").toInt() & 0x07)
+                             | (step.value("on", true).toBool() ? 0x08 : 0x00)));
+        } else if (op == "fade") {
+            prog.append(char(MFX_OP_FADE));
+            prog.append(char(step.value("level").toInt()));
+            prog.append(char(ticks(step)));
+        } else if (op == "text") {
+            const QByteArray text = step.value("text").toString().toLatin1();
+            if (text.isEmpty() || text.size() > MCFG_FX_MAX)
+                return false;
+            prog.append(char(MFX_OP_TEXT));
+            prog.append(char(ticks(step)));
+            prog.append(char(text.size()));
+            prog.append(text);
+        } else if (op == "out") {
+            prog.append(char(MFX_OP_OUT));
+            prog.append(char((step.value("led").toBool() ? MFX_OUT_LED : 0)
+                             | (step.value("buzzer").toBool() ? MFX_OUT_BUZZER : 0)));
+        } else if (op == "wait") {
+            prog.append(char(MFX_OP_WAIT));
+            prog.append(char(ticks(step)));
+        } else if (op == "repeat") {
+            prog.append(char(MFX_OP_REPEAT));
+            prog.append(char(step.value("count").toInt()));
+        } else if (op == "next") {
+            prog.append(char(MFX_OP_NEXT));
+        } else {
+            qDebug() << "Unknown effect step" << op;
+            return false;
+        }
+    }
+    prog.append(char(MFX_OP_END));
+
+    const int rc = mfx_check(reinterpret_cast<const uint8_t *>(prog.constData()),
+                             size_t(prog.size()));
+    if (rc != MFX_OK) {
+        qDebug() << "Effect rejected, mfx_check" << rc << "on" << prog.size() << "bytes";
+        return false;
+    }
+    *program = prog;
+    return true;
+}
+
+QList<QByteArray> BleManager::fragmentConfig(const QByteArray &msg, int maxWrite)
+{
+    QList<QByteArray> fragments;
+
+    if (maxWrite <= MCFG_FRAG_FIRST_LEN || msg.size() > 0xFFFF)
+        return fragments;
+
+    const uint16_t crc = mcfg_crc16(0xFFFF, reinterpret_cast<const uint8_t *>(msg.constData()),
+                                    size_t(msg.size()));
+    qsizetype offset = 0;
+
+    while (offset < msg.size() || fragments.isEmpty()) {
+        if (fragments.size() >= MCFG_FRAG_MAX_COUNT)
+            return QList<QByteArray>();
+
+        uint8_t header[MCFG_FRAG_FIRST_LEN];
+        const size_t headerLen = mcfg_frag_header(header, uint8_t(fragments.size()),
+                                                  uint16_t(msg.size()), crc);
+        const qsizetype chunk = qMin(qsizetype(maxWrite) - qsizetype(headerLen),
+                                     msg.size() - offset);
+
+        QByteArray fragment(reinterpret_cast<const char *>(header), qsizetype(headerLen));
+        fragment.append(msg.mid(offset, chunk));
+        fragments.append(fragment);
+        offset += chunk;
+    }
+
+    return fragments;
 }
 
 void BleManager::sendConfig(const QVariantMap &cfg)
 {
+    QElapsedTimer timer;
+
+    timer.start();
     QJsonDocument doc = QJsonDocument::fromVariant(cfg);
     QByteArray json = doc.toJson(QJsonDocument::Compact);
+    const qint64 jsonNs = timer.nsecsElapsed();
+
+    timer.restart();
+    QByteArray binary = encodeBinaryConfig(cfg);
+    const qint64 binaryNs = timer.nsecsElapsed();
+
+    qDebug() << "Config size JSON:" << json.size() << "bytes /" << jsonNs / 1000 << "us,"
+             << "binary:" << binary.size() << "bytes /" << binaryNs / 1000 << "us";
 
-    writeToBle(json);
+    const QString section = cfg.keys().join('+');
+
+    // An alarm table or effect has no JSON form, it always goes binary;
+    // neither firmware could apply the JSON, so it is not sent at all
+    const bool binaryOnly = cfg.contains("alarms") || cfg.contains("fx");
+    if (binaryOnly && binary.isEmpty()) {
+        qDebug() << "Config does not encode, not sending" << section;
+        emit configRejected(section);
+        return;
+    }
+    if (useBinaryConfig || binaryOnly)
+        writeToBle(section, binary);
+    else
+        writeToBle(section, json);
+}
+
+void BleManager::provisionFleet(const QVariantMap &cfg)
+{
+    const QList<QBluetoothDeviceInfo> clocks = deviceModel->allDevices();
+    if (clocks.isEmpty()) {
+        qDebug() << "No clocks to provision, scan first";
+        return;
+    }
+
+    // One message per clock, so it is the whole session
+    QVariantMap session = cfg;
+    session.insert("commit", true);
+
+    const bool binaryOnly = session.contains("alarms") || session.contains("fx");
+    const QByteArray binary = useBinaryConfig || binaryOnly
+        ? encodeBinaryConfig(session)
+        : QByteArray();
+    if (binaryOnly && binary.isEmpty()) {
+        qDebug() << "Fleet config does not encode, not provisioning";
+        emit configRejected(session.keys().join('+'));
+        return;
+    }
+    const QByteArray payload = binary.isEmpty()
+        ? QJsonDocument::fromVariant(session).toJson(QJsonDocument::Compact)
+        : binary;
+
+    // The fleet links need their own connections
+    cleanupController();
+
+    fleetProvisioner->start(clocks, payload);
+}
+
+void BleManager::beginConfig()
+{
+    batch.clear();
+    batchOpen = true;
 }
 
-void BleManager::writeToBle(const QByteArray &json)
+void BleManager::stageConfig(const QVariantMap &cfg)
 {
-    if (!configService) {
-        qDebug() << "BLE not ready service not available";
+    if (!batchOpen) {
+        qDebug() << "stageConfig outside a batch, sending directly";
+        sendConfig(cfg);
         return;
     }
-    if (!configChar.isValid()) {
-        qDebug() << "BLE not ready characteristic invalid";
-        qDebug() << "  UUID:" << configChar.uuid();
+
+    // Later stages of the same section win
+    for (auto it = cfg.cbegin(); it != cfg.cend(); ++it)
+        batch.insert(it.key(), it.value());
+}
+
+void BleManager::commitConfig()
+{
+    if (!batchOpen)
+        return;
+
+    batchOpen = false;
+    if (batch.isEmpty())
         return;
+
+    qDebug() << "Committing batch:" << batch.keys();
+    batch.insert("commit", true);
+    sendConfig(batch);
+    batch.clear();
+}
+
+void BleManager::abortConfig()
+{
+    batchOpen = false;
+    batch.clear();
+}
+
+void BleManager::writeToBle(const QString &section, const QByteArray &data)
+{
+    // Queued while the link is coming up, sent as soon as the characteristic
+    // is ready; without a link there is nothing to queue for, it is dropped
+    if (!transport) {
+        qDebug() << "BLE not connected, dropping" << section;
+        return;
+    }
+
+    if (mcfg_is_binary(reinterpret_cast<const uint8_t *>(data.constData()), size_t(data.size())))
+        qDebug() << "Queueing binary" << section << ":" << data.toHex(' ');
+    else
+        qDebug() << "Queueing JSON" << section << ": " + QString::fromUtf8(data);
+
+    // A newer config for a section still waiting in the queue replaces it
+    for (OutboundItem &item : outbound) {
+        if (item.section == section) {
+            item.data = data;
+            qDebug() << "Coalesced with queued" << section;
+            return;
+        }
+    }
+
+    outbound.append({ section, data });
+    pumpWrites();
+}
+
+bool BleManager::startNextItem()
+{
+    while (!outbound.isEmpty()) {
+        const OutboundItem item = outbound.takeFirst();
+        const int maxWrite = transport->maxWriteSize();
+
+        if (item.data.size() <= maxWrite)
+            pendingFragments = { item.data };
+        else
+            pendingFragments = fragmentConfig(item.data, maxWrite);
+
+        if (pendingFragments.isEmpty()) {
+            qDebug() << "Config too large:" << item.data.size() << "bytes at" << maxWrite << "per write";
+            continue;
+        }
+
+        currentSection = item.section;
+        transferBytes = item.data.size();
+        transferFragments = int(pendingFragments.size());
+        transferTimer.start();
+        return true;
     }
+    return false;
+}
 
-    qDebug() << "Writing JSON: " + QString::fromUtf8(json);
+void BleManager::finishItem(bool ok)
+{
+    if (currentSection.isEmpty())
+        return;
 
-    configService->writeCharacteristic(
-        configChar,
-        json,
-        QLowEnergyService::WriteWithResponse
-        );
+    if (ok) {
+        const qint64 ms = qMax<qint64>(transferTimer.elapsed(), 1);
+        lastThroughput = transferBytes * 1000 / ms;
+        qDebug() << "Sent" << currentSection << transferBytes << "bytes in" << transferFragments
+                 << (useWriteWithoutResponse ? "writes (no response)" : "writes")
+                 << "at MTU" << transport->mtu() << "," << intervalMs << "ms interval:"
+                 << ms << "ms," << lastThroughput << "B/s";
+        emit throughputChanged();
 
-    // emit dataSent("WiFi");   // or "Time"/"Alarm"
+        // The response to this write confirms the sections handed off before it
+        for (const QString &section : std::as_const(unconfirmedSections))
+            emit dataSent(section);
+        emit dataSent(currentSection);
+    } else if (!unconfirmedSections.isEmpty()) {
+        qDebug() << "Write failed, no confirmation for" << unconfirmedSections;
+    }
+    unconfirmedSections.clear();
+    currentSection.clear();
 }
 
+void BleManager::pumpWrites()
+{
+    if (!transport || !transport->isReady() || writeInFlight)
+        return;
+
+    if (pendingFragments.isEmpty() && !startNextItem()) {
+        // Only when the item meant to carry the sync write was dropped
+        if (!unconfirmedSections.isEmpty()) {
+            qDebug() << "No sync write followed, unconfirmed:" << unconfirmedSections;
+            unconfirmedSections.clear();
+        }
+        creditTimer->stop();
+        if (!profileIdleTimer->isActive())
+            profileIdleTimer->start();
+        return;
+    }
+
+    profileIdleTimer->stop();
+    requestConnectionUpdate(ConnectionProfile::Fast);
+
+    const bool noResponse = useWriteWithoutResponse && transport->canWriteWithoutResponse();
+
+    if (firstWriteLatencyMs < 0) {
+        firstWriteLatencyMs = connectTimer.elapsed();
+        qDebug() << "Connect to first write:" << firstWriteLatencyMs << "ms";
+        emit latencyChanged();
+    }
+
+    while (!pendingFragments.isEmpty()) {
+        // The final write of a burst goes with response as the sync point
+        const bool sync = pendingFragments.size() == 1 && outbound.isEmpty();
+
+        if (!noResponse || sync) {
+            writeInFlight = true;
+            inFlightFragment = pendingFragments.takeFirst();
+            transport->writeConfig(inFlightFragment, true);
+            return;
+        }
+
+        if (writeCredits == 0) {
+            if (!creditTimer->isActive())
+                creditTimer->start();
+            return;
+        }
+
+        writeCredits--;
+        transport->writeConfig(pendingFragments.takeFirst(), false);
+
+        // Only handed to the stack, dataSent waits for the sync write
+        if (pendingFragments.isEmpty()) {
+            qDebug() << "Handed off" << currentSection << transferBytes << "bytes without response";
+            unconfirmedSections.append(currentSection);
+            currentSection.clear();
+            startNextItem();
+        }
+    }
+}
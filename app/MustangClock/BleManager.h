@@ -5,46 +5,177 @@
 #pragma once
 
 #include <QObject>
+#include <QElapsedTimer>
+#include <QList>
+#include <QStringList>
+#include <QTimer>
 #include <QStringLiteral>
-#include <QtBluetooth/QBluetoothDeviceDiscoveryAgent>
 #include <QtBluetooth/QBluetoothDeviceInfo>
-#include <QtBluetooth/QLowEnergyController>
-#include <QtBluetooth/QLowEnergyService>
 #include <QtBluetooth/QBluetoothUuid>
-#include <QtBluetooth/QBluetoothLocalDevice>
+
+#include "BleTransport.h"
+#include "DeviceListModel.h"
+#include "FleetProvisioner.h"
 
 class BleManager : public QObject
 {
     Q_OBJECT
+    Q_PROPERTY(DeviceListModel *devices READ devices CONSTANT)
+    Q_PROPERTY(bool scanning READ scanning NOTIFY scanningChanged)
+    Q_PROPERTY(FleetProvisioner *fleet READ fleet CONSTANT)
+    Q_PROPERTY(bool binaryConfig READ binaryConfig WRITE setBinaryConfig NOTIFY binaryConfigChanged)
+    Q_PROPERTY(bool writeWithoutResponse READ writeWithoutResponse WRITE setWriteWithoutResponse NOTIFY writeWithoutResponseChanged)
+    // Milliseconds since connectToDevice, -1 until reached
+    Q_PROPERTY(qint64 readyLatencyMs READ readyLatency NOTIFY latencyChanged)
+    Q_PROPERTY(qint64 firstWriteLatencyMs READ firstWriteLatency NOTIFY latencyChanged)
+    // Requested connection profile ("fast", "lowPower", empty when not
+    // connected) and the interval the link actually runs at, -1 if unknown
+    Q_PROPERTY(QString connectionProfile READ connectionProfile NOTIFY connectionProfileChanged)
+    Q_PROPERTY(int connectionIntervalMs READ connectionInterval NOTIFY connectionProfileChanged)
+    // Last config message, bytes per second from first write to acknowledgement
+    Q_PROPERTY(qint64 throughput READ throughput NOTIFY throughputChanged)
 public:
+    enum class ConnectionProfile {
+        None,
+        Fast,       // config transfer in flight
+        LowPower,   // connected and idle
+    };
+
+    // Qt Bluetooth backend
     explicit BleManager(QObject *parent = nullptr);
+    // Takes ownership of backend, e.g. a SimBackend for offline runs
+    explicit BleManager(BleBackend *backend, QObject *parent = nullptr);
     ~BleManager();
     void connectToDevice();
     Q_INVOKABLE void startScan();
+    Q_INVOKABLE void connectToIndex(int row);
+    // Fleet mode: scan the whole window without connecting, then provision
+    // every clock found with the same config
+    Q_INVOKABLE void scanFleet();
+    Q_INVOKABLE void provisionFleet(const QVariantMap &cfg);
+    FleetProvisioner *fleet() const { return fleetProvisioner; }
+    DeviceListModel *devices() const { return deviceModel; }
+    bool scanning() const { return scanActive; }
     Q_INVOKABLE void sendConfig(const QVariantMap &cfg);
 
+    // Batch: sections staged between begin and commit go out as one message
+    Q_INVOKABLE void beginConfig();
+    Q_INVOKABLE void stageConfig(const QVariantMap &cfg);
+    Q_INVOKABLE void commitConfig();
+    Q_INVOKABLE void abortConfig();
+
+    bool binaryConfig() const { return useBinaryConfig; }
+    void setBinaryConfig(bool enabled);
+
+    bool writeWithoutResponse() const { return useWriteWithoutResponse; }
+    void setWriteWithoutResponse(bool enabled);
+
+    qint64 readyLatency() const { return readyLatencyMs; }
+    qint64 firstWriteLatency() const { return firstWriteLatencyMs; }
+
+    QString connectionProfile() const;
+    int connectionInterval() const { return intervalMs; }
+    qint64 throughput() const { return lastThroughput; }
+
+    // Matches the firmware's profiles in gap.c
+    void requestConnectionUpdate(ConnectionProfile profile);
+
+    // Shared with ClockLink and the transports
+    static inline const QBluetoothUuid SERVICE_UUID =
+        QBluetoothUuid(QStringLiteral("12345678-9abc-def0-f0de-bc9a78563412"));
+
+    static inline const QBluetoothUuid CONFIG_CHAR_UUID =
+        QBluetoothUuid(QStringLiteral("9abcdef0-1234-5678-7856-3412f0debc9a"));
+
+    // TLV encoding from protocol/mustang_cfg.h, empty on overflow
+    static QByteArray encodeBinaryConfig(const QVariantMap &cfg);
+    // Alarm effect steps ({"op": "blank"}, {"op": "wait", "ms": 150}, ...)
+    // to protocol/mustang_fx.h bytecode; false if they do not pass mfx_check()
+    static bool encodeEffect(const QVariantList &steps, QByteArray *program);
+    // Split a message into protocol/mustang_cfg.h fragments of at most
+    // maxWrite bytes each, empty if it needs more than MCFG_FRAG_MAX_COUNT
+    static QList<QByteArray> fragmentConfig(const QByteArray &msg, int maxWrite);
+
 signals:
     void log(const QString &msg);
     void deviceFound();
     void connected();
     void disconnected();
-    void dataSent();   // optional, for JSON write feedback
+    void dataSent(const QString &section);   // config message acknowledged by the peer
+    // Alarms or effect that do not fit the binary encoding (e.g. an SSID
+    // over MCFG_SSID_MAX bytes); nothing was sent
+    void configRejected(const QString &section);
+    void binaryConfigChanged();
+    void scanningChanged();
+    void writeWithoutResponseChanged();
+    void latencyChanged();
+    void connectionProfileChanged();
+    void throughputChanged();
 
 private:
     void cleanupController();
-    void writeToBle(const QByteArray &json);
+    void onAdvertisement(const QBluetoothDeviceInfo &info);
+    void setScanning(bool active);
+    void beginScan(bool fleet);
+    void onTransportReady();
+    void onWriteDone(bool ok);
+    void writeToBle(const QString &section, const QByteArray &data);
+    void pumpWrites();
+    void finishItem(bool ok);
+    bool startNextItem();
     QBluetoothDeviceInfo lastFoundInfo;
-    QBluetoothDeviceDiscoveryAgent *discoveryAgent = nullptr;
-    QLowEnergyController *controller = nullptr;
-    QLowEnergyService *configService = nullptr;
-    QLowEnergyCharacteristic configChar;
-    QBluetoothLocalDevice *localDevice = nullptr;
+    BleBackend *backend = nullptr;
+    BleTransport *transport = nullptr;
+    bool useBinaryConfig = false;
 
-    const QBluetoothUuid SERVICE_UUID =
-        QBluetoothUuid(QStringLiteral("12345678-9abc-def0-f0de-bc9a78563412"));
+    // LE-only scan, bounded window; a known clock at least this strong ends it early
+    static constexpr int kScanWindowMs = 2000;
+    static constexpr qint16 kStrongRssi = -70;
+    DeviceListModel *deviceModel = nullptr;
+    QElapsedTimer scanTimer;
+    bool scanActive = false;
+    bool fleetScan = false;
+    FleetProvisioner *fleetProvisioner = nullptr;
+    bool useWriteWithoutResponse = false;
 
-    const QBluetoothUuid CONFIG_CHAR_UUID =
-        QBluetoothUuid(QStringLiteral("9abcdef0-1234-5678-7856-3412f0debc9a"));
+    bool batchOpen = false;
+    QVariantMap batch;
+
+    // Reconnect latency, see readyLatencyMs / firstWriteLatencyMs
+    QElapsedTimer connectTimer;
+    qint64 readyLatencyMs = -1;
+    qint64 firstWriteLatencyMs = -1;
+
+    // Outbound pipeline: queued messages, coalesced per config section
+    struct OutboundItem {
+        QString section;
+        QByteArray data;
+    };
+    QList<OutboundItem> outbound;
+
+    // Item on the wire. Without-response writes spend a credit each, credits
+    // come back once per connection interval; the last write of a burst goes
+    // with response so the peer confirms the whole burst.
+    static constexpr int kMaxWriteCredits = 4;
+    static constexpr int kDefaultIntervalMs = 30;
+    QString currentSection;
+    QStringList unconfirmedSections;   // handed off, waiting for the sync write
+    QList<QByteArray> pendingFragments;
+    bool writeInFlight = false;
+    QByteArray inFlightFragment;   // bytes of the with-response write
+    int writeCredits = kMaxWriteCredits;
+    QTimer *creditTimer = nullptr;
+    QElapsedTimer transferTimer;
+    qsizetype transferBytes = 0;
+    int transferFragments = 0;
+    qint64 lastThroughput = 0;
+
+    // Fast profile while the pipeline has work, low power once it has been
+    // empty for kProfileIdleMs
+    static constexpr int kProfileIdleMs = 1000;
+    ConnectionProfile profile = ConnectionProfile::None;
+    int intervalMs = -1;
+    QTimer *profileIdleTimer = nullptr;
 
 };
 
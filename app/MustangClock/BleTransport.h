@@ -0,0 +1,82 @@
+#ifndef BLETRANSPORT_H
+#define BLETRANSPORT_H
+
+// bletransport.h
+#pragma once
+
+#include <QObject>
+#include <QByteArray>
+#include <QString>
+#include <QtBluetooth/QBluetoothDeviceInfo>
+#include <QtBluetooth/QLowEnergyConnectionParameters>
+
+/*
+ * One link to one clock's config characteristic. BleManager and ClockLink
+ * own the config protocol (queueing, fragmentation, credits); a transport
+ * only connects, discovers the config service and moves bytes.
+ */
+class BleTransport : public QObject
+{
+    Q_OBJECT
+public:
+    using QObject::QObject;
+
+    virtual void connectToDevice(const QBluetoothDeviceInfo &info) = 0;
+    virtual void disconnectFromDevice() = 0;
+
+    // Config characteristic discovered, writes may start
+    virtual bool isReady() const = 0;
+    virtual int mtu() const = 0;
+    // Largest single write: the ATT write header takes 3 bytes of the MTU,
+    // which is at least the default 23 before any exchange
+    int maxWriteSize() const { return qMax(mtu(), 23) - 3; }
+    virtual bool canWriteWithoutResponse() const = 0;
+    // The config service layout was known before this connection
+    virtual bool layoutCached() const { return false; }
+
+    virtual void writeConfig(const QByteArray &data, bool withResponse) = 0;
+    // Granted parameters come back through connectionIntervalChanged
+    virtual void requestConnectionUpdate(const QLowEnergyConnectionParameters &params) = 0;
+
+signals:
+    void connected();
+    void disconnected();
+    void ready();
+    // With-response writes are acknowledged; some backends also report
+    // without-response writes here
+    void written(const QByteArray &value);
+    void writeFailed();
+    void errorOccurred(const QString &error);
+    void connectionIntervalChanged(int ms);
+};
+
+/*
+ * The adapter side: scanning, pairing and a factory for links. BleManager
+ * and FleetProvisioner only see this interface, so the whole BLE layer can
+ * run against SimBackend on a machine without a radio.
+ */
+class BleBackend : public QObject
+{
+    Q_OBJECT
+public:
+    using QObject::QObject;
+
+    virtual void startScan(int windowMs) = 0;
+    // Ends the scan without scanFinished
+    virtual void stopScan() = 0;
+    virtual bool isScanning() const = 0;
+
+    // Connected before, with a cached GATT layout
+    virtual bool isKnownDevice(const QBluetoothDeviceInfo &info) const { Q_UNUSED(info); return false; }
+    virtual void requestPairing(const QBluetoothDeviceInfo &info) { Q_UNUSED(info); }
+
+    virtual BleTransport *createTransport(QObject *parent) = 0;
+
+signals:
+    // Also emitted again for RSSI updates
+    void deviceDiscovered(const QBluetoothDeviceInfo &info);
+    void scanFinished();
+    void scanError(const QString &error);
+};
+
+#endif
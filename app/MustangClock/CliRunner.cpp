@@ -0,0 +1,171 @@
+// clirunner.cpp
+#include "CliRunner.h"
+#include "BleManager.h"
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QTextStream>
+
+CliRunner::CliRunner(const Options &options, QObject *parent)
+    : QObject(parent), opts(options)
+{
+    if (opts.simulate) {
+        simBackend = new SimBackend(opts.sim);
+        ble = new BleManager(simBackend, this);
+    } else {
+        ble = new BleManager(this);
+    }
+    ble->setBinaryConfig(opts.binary);
+    ble->setWriteWithoutResponse(opts.noResponse);
+    ble->fleet()->setMaxConcurrent(opts.concurrency);
+
+    deadline.setSingleShot(true);
+    deadline.setInterval(opts.timeoutMs);
+    connect(&deadline, &QTimer::timeout, this, [=]() {
+        emitEvent(QStringLiteral("timeout"));
+        finish(2);
+    });
+
+    connect(ble, &BleManager::scanningChanged, this, [=]() {
+        if (!ble->scanning())
+            onScanFinished();
+    });
+
+    connect(ble, &BleManager::connected, this, [=]() {
+        emitEvent(QStringLiteral("connected"));
+    });
+
+    connect(ble, &BleManager::disconnected, this, [=]() {
+        emitEvent(QStringLiteral("disconnected"));
+        finish(1);
+    });
+
+    connect(ble, &BleManager::latencyChanged, this, [=]() {
+        if (ble->readyLatency() >= 0 && !sending)
+            onReady();
+    });
+
+    connect(ble, &BleManager::dataSent, this, [=](const QString &section) {
+        emitEvent(QStringLiteral("sent"), {
+            { "section", section },
+            { "firstWriteLatencyMs", ble->firstWriteLatency() },
+            { "throughput", ble->throughput() },
+            { "profile", ble->connectionProfile() },
+            { "intervalMs", ble->connectionInterval() },
+        });
+        finish(0);
+    });
+
+    connect(ble, &BleManager::configRejected, this, [=](const QString &section) {
+        emitEvent(QStringLiteral("rejected"), { { "section", section } });
+        finish(1);
+    });
+
+    connect(ble->fleet(), &FleetProvisioner::finished, this, [=](int succeeded, int failed) {
+        emitEvent(QStringLiteral("fleet"), {
+            { "succeeded", succeeded },
+            { "failed", failed },
+            { "clocks", QJsonArray::fromVariantList(ble->fleet()->status()) },
+            { "summary", ble->fleet()->summary() },
+        });
+        finish(failed == 0 ? 0 : 1);
+    });
+}
+
+void CliRunner::start()
+{
+    clock.start();
+    deadline.start();
+
+    // Scan and provision need the whole window; the others stop at the
+    // first good match unless a specific address is wanted
+    if (opts.command == Command::Scan || opts.command == Command::Provision || !opts.address.isEmpty())
+        ble->scanFleet();
+    else
+        ble->startScan();
+
+    emitEvent(QStringLiteral("scanStarted"));
+}
+
+void CliRunner::onScanFinished()
+{
+    DeviceListModel *devices = ble->devices();
+    QJsonArray list;
+
+    for (int row = 0; row < devices->rowCount(); ++row) {
+        const QModelIndex index = devices->index(row);
+        list.append(QJsonObject{
+            { "name", devices->data(index, DeviceListModel::NameRole).toString() },
+            { "address", devices->data(index, DeviceListModel::AddressRole).toString() },
+            { "rssi", devices->data(index, DeviceListModel::RssiRole).toInt() },
+            { "known", devices->data(index, DeviceListModel::KnownRole).toBool() },
+        });
+    }
+    emitEvent(QStringLiteral("scanFinished"), { { "devices", list } });
+
+    if (devices->rowCount() == 0) {
+        finish(1);
+        return;
+    }
+
+    switch (opts.command) {
+    case Command::Scan:
+        finish(0);
+        break;
+
+    case Command::Provision:
+        ble->provisionFleet(opts.config);
+        break;
+
+    case Command::Connect:
+    case Command::Send:
+        // Without an address BleManager has already picked a clock
+        if (opts.address.isEmpty())
+            break;
+        for (int row = 0; row < devices->rowCount(); ++row) {
+            if (devices->data(devices->index(row), DeviceListModel::AddressRole).toString()
+                    .compare(opts.address, Qt::CaseInsensitive) == 0) {
+                ble->connectToIndex(row);
+                return;
+            }
+        }
+        emitEvent(QStringLiteral("notFound"), { { "address", opts.address } });
+        finish(1);
+        break;
+    }
+}
+
+void CliRunner::onReady()
+{
+    emitEvent(QStringLiteral("ready"), { { "readyLatencyMs", ble->readyLatency() } });
+
+    if (opts.command == Command::Connect) {
+        finish(0);
+        return;
+    }
+
+    if (opts.command == Command::Send) {
+        sending = true;
+        ble->sendConfig(opts.config);
+    }
+}
+
+void CliRunner::emitEvent(const QString &event, QJsonObject fields)
+{
+    static QTextStream out(stdout);
+
+    fields.insert("event", event);
+    fields.insert("ms", clock.elapsed());
+    out << QJsonDocument(fields).toJson(QJsonDocument::Compact) << Qt::endl;
+}
+
+void CliRunner::finish(int exitCode)
+{
+    if (finished)
+        return;
+    finished = true;
+    deadline.stop();
+
+    if (simBackend)
+        emitEvent(QStringLiteral("peripherals"), { { "clocks", QJsonArray::fromVariantList(simBackend->statsList()) } });
+    emit done(exitCode);
+}
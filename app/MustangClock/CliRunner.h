@@ -0,0 +1,69 @@
+#ifndef CLIRUNNER_H
+#define CLIRUNNER_H
+
+// clirunner.h
+#pragma once
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QTimer>
+#include <QVariantMap>
+
+#include "SimTransport.h"
+
+class BleManager;
+
+/*
+ * Drives BleManager without a GUI. Every phase is reported on stdout as
+ * one JSON object per line ({"event": ..., "ms": ...}), with ms counted
+ * from the start of the command; diagnostics go to stderr. With simulate
+ * set the clocks are SimBackend ones and a final "peripherals" event
+ * reports what each of them received.
+ */
+class CliRunner : public QObject
+{
+    Q_OBJECT
+public:
+    enum class Command {
+        Scan,
+        Connect,
+        Send,
+        Provision,
+    };
+
+    struct Options {
+        Command command = Command::Scan;
+        QString address;          // empty: strongest / known clock
+        QVariantMap config;
+        bool binary = false;
+        bool noResponse = false;
+        int concurrency = 3;
+        int timeoutMs = 30000;
+        bool simulate = false;
+        SimParams sim;
+    };
+
+    explicit CliRunner(const Options &options, QObject *parent = nullptr);
+
+    void start();
+
+signals:
+    void done(int exitCode);
+
+private:
+    void onScanFinished();
+    void onReady();
+    void emitEvent(const QString &event, QJsonObject fields = QJsonObject());
+    void finish(int exitCode);
+
+    Options opts;
+    BleManager *ble = nullptr;
+    SimBackend *simBackend = nullptr;
+    QElapsedTimer clock;
+    QTimer deadline;
+    bool sending = false;
+    bool finished = false;
+};
+
+#endif
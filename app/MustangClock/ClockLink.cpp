@@ -0,0 +1,112 @@
+// clocklink.cpp
+#include "ClockLink.h"
+#include "BleManager.h"
+#include <QDebug>
+
+ClockLink::ClockLink(const QBluetoothDeviceInfo &info, BleTransport *transport, QObject *parent)
+    : QObject(parent), info(info), transport(transport)
+{
+    transport->setParent(this);
+
+    watchdog.setSingleShot(true);
+    watchdog.setInterval(kTimeoutMs);
+    connect(&watchdog, &QTimer::timeout, this, [=]() {
+        finish(false, QStringLiteral("timeout"));
+    });
+
+    connect(transport, &BleTransport::connected, this, [=]() {
+        setState(State::Discovering);
+    });
+
+    connect(transport, &BleTransport::disconnected, this, [=]() {
+        if (linkState != State::Done && linkState != State::Failed)
+            finish(false, QStringLiteral("disconnected"));
+    });
+
+    connect(transport, &BleTransport::errorOccurred, this, [=](const QString &e) {
+        finish(false, e);
+    });
+
+    connect(transport, &BleTransport::ready, this, &ClockLink::onReady);
+
+    connect(transport, &BleTransport::written, this, [=](const QByteArray &value) {
+        sent += value.size();
+        writeNext();
+    });
+
+    connect(transport, &BleTransport::writeFailed, this, [=]() {
+        finish(false, QStringLiteral("write failed"));
+    });
+}
+
+ClockLink::~ClockLink()
+{
+    transport->disconnectFromDevice();
+}
+
+void ClockLink::setState(State state)
+{
+    if (linkState == state)
+        return;
+    linkState = state;
+    emit stateChanged(state);
+}
+
+void ClockLink::provision(const QByteArray &message)
+{
+    payload = message;
+    sent = 0;
+    error.clear();
+    timer.start();
+    watchdog.start();
+
+    setState(State::Connecting);
+    transport->connectToDevice(info);
+}
+
+void ClockLink::onReady()
+{
+    const int maxWrite = transport->maxWriteSize();
+    fragments = payload.size() <= maxWrite
+        ? QList<QByteArray>{ payload }
+        : BleManager::fragmentConfig(payload, maxWrite);
+    if (fragments.isEmpty()) {
+        finish(false, QStringLiteral("config too large"));
+        return;
+    }
+
+    setState(State::Writing);
+    writeNext();
+}
+
+void ClockLink::writeNext()
+{
+    if (linkState != State::Writing)
+        return;
+
+    if (fragments.isEmpty()) {
+        finish(true);
+        return;
+    }
+
+    transport->writeConfig(fragments.takeFirst(), true);
+}
+
+void ClockLink::finish(bool ok, const QString &why)
+{
+    if (linkState == State::Done || linkState == State::Failed)
+        return;
+
+    watchdog.stop();
+    error = why;
+    setState(ok ? State::Done : State::Failed);
+
+    qDebug() << info.name() << (ok ? "provisioned:" : "failed:")
+             << (ok ? QStringLiteral("%1 bytes").arg(sent) : why)
+             << "in" << timer.elapsed() << "ms";
+
+    // Free the connection slot right away
+    transport->disconnectFromDevice();
+
+    emit finished(ok);
+}
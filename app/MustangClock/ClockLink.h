@@ -0,0 +1,71 @@
+#ifndef CLOCKLINK_H
+#define CLOCKLINK_H
+
+// clocklink.h
+#pragma once
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QList>
+#include <QTimer>
+#include <QtBluetooth/QBluetoothDeviceInfo>
+
+#include "BleTransport.h"
+
+/*
+ * One connection to one clock: connect, discover the config service, write
+ * a config message (fragmented for the link's MTU), disconnect. Each link
+ * owns its transport, so several can run side by side.
+ */
+class ClockLink : public QObject
+{
+    Q_OBJECT
+public:
+    enum class State {
+        Idle,
+        Connecting,
+        Discovering,
+        Writing,
+        Done,
+        Failed,
+    };
+    Q_ENUM(State)
+
+    // Whole provisioning attempt, connect to last write acknowledged
+    static constexpr int kTimeoutMs = 15000;
+
+    // Takes ownership of transport
+    ClockLink(const QBluetoothDeviceInfo &info, BleTransport *transport, QObject *parent = nullptr);
+    ~ClockLink();
+
+    void provision(const QByteArray &payload);
+
+    const QBluetoothDeviceInfo &device() const { return info; }
+    State state() const { return linkState; }
+    QString errorString() const { return error; }
+    qsizetype bytesSent() const { return sent; }
+    qint64 elapsedMs() const { return timer.elapsed(); }
+
+signals:
+    void stateChanged(ClockLink::State state);
+    void finished(bool ok);
+
+private:
+    void setState(State state);
+    void onReady();
+    void writeNext();
+    void finish(bool ok, const QString &why = QString());
+
+    QBluetoothDeviceInfo info;
+    BleTransport *transport = nullptr;
+
+    State linkState = State::Idle;
+    QString error;
+    QByteArray payload;
+    QList<QByteArray> fragments;
+    qsizetype sent = 0;
+    QElapsedTimer timer;
+    QTimer watchdog;
+};
+
+#endif
@@ -0,0 +1,120 @@
+// devicelistmodel.cpp
+#include "DeviceListModel.h"
+
+DeviceListModel::DeviceListModel(QObject *parent) : QAbstractListModel(parent)
+{
+}
+
+int DeviceListModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : int(entries.size());
+}
+
+QVariant DeviceListModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= entries.size())
+        return QVariant();
+
+    const Entry &e = entries.at(index.row());
+    switch (role) {
+    case NameRole:
+        return e.info.name();
+    case AddressRole:
+        return idOf(e.info);
+    case RssiRole:
+        return e.info.rssi();
+    case KnownRole:
+        return e.known;
+    default:
+        return QVariant();
+    }
+}
+
+QHash<int, QByteArray> DeviceListModel::roleNames() const
+{
+    return {
+        { NameRole, "name" },
+        { AddressRole, "address" },
+        { RssiRole, "rssi" },
+        { KnownRole, "known" },
+    };
+}
+
+QString DeviceListModel::idOf(const QBluetoothDeviceInfo &info)
+{
+    // macOS/iOS hide the address
+    return info.address().isNull() ? info.deviceUuid().toString() : info.address().toString();
+}
+
+// First row with a weaker signal, ignoring row 'skip'
+int DeviceListModel::rankOf(qint16 rssi, int skip) const
+{
+    int row = 0;
+    for (int i = 0; i < entries.size(); ++i) {
+        if (i == skip)
+            continue;
+        if (entries.at(i).info.rssi() < rssi)
+            break;
+        ++row;
+    }
+    return row;
+}
+
+int DeviceListModel::upsert(const QBluetoothDeviceInfo &info, bool known)
+{
+    const QString id = idOf(info);
+
+    for (int i = 0; i < entries.size(); ++i) {
+        if (idOf(entries.at(i).info) != id)
+            continue;
+
+        entries[i].info = info;
+        entries[i].known = known;
+        emit dataChanged(index(i), index(i));
+
+        const int to = rankOf(info.rssi(), i);
+        if (to != i) {
+            // beginMoveRows wants the destination as seen before the move
+            beginMoveRows(QModelIndex(), i, i, QModelIndex(), to > i ? to + 1 : to);
+            entries.move(i, to);
+            endMoveRows();
+        }
+        return to;
+    }
+
+    const int row = rankOf(info.rssi(), -1);
+    beginInsertRows(QModelIndex(), row, row);
+    entries.insert(row, { info, known });
+    endInsertRows();
+    emit countChanged();
+    return row;
+}
+
+void DeviceListModel::clear()
+{
+    if (entries.isEmpty())
+        return;
+
+    beginResetModel();
+    entries.clear();
+    endResetModel();
+    emit countChanged();
+}
+
+QBluetoothDeviceInfo DeviceListModel::deviceAt(int row) const
+{
+    return row >= 0 && row < entries.size() ? entries.at(row).info : QBluetoothDeviceInfo();
+}
+
+QList<QBluetoothDeviceInfo> DeviceListModel::allDevices() const
+{
+    QList<QBluetoothDeviceInfo> devices;
+    for (const Entry &e : entries)
+        devices.append(e.info);
+    return devices;
+}
+
+bool DeviceListModel::isKnown(int row) const
+{
+    return row >= 0 && row < entries.size() && entries.at(row).known;
+}
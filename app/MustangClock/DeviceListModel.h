@@ -0,0 +1,55 @@
+#ifndef DEVICELISTMODEL_H
+#define DEVICELISTMODEL_H
+
+// devicelistmodel.h
+#pragma once
+
+#include <QAbstractListModel>
+#include <QList>
+#include <QtBluetooth/QBluetoothDeviceInfo>
+
+// Clocks seen by the current scan, strongest RSSI first
+class DeviceListModel : public QAbstractListModel
+{
+    Q_OBJECT
+    Q_PROPERTY(int count READ rowCount NOTIFY countChanged)
+public:
+    enum Roles {
+        NameRole = Qt::UserRole + 1,
+        AddressRole,
+        RssiRole,
+        KnownRole,
+    };
+
+    explicit DeviceListModel(QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role) const override;
+    QHash<int, QByteArray> roleNames() const override;
+
+    // Insert or refresh a device, returns its row after re-ranking
+    int upsert(const QBluetoothDeviceInfo &info, bool known);
+    void clear();
+
+    QBluetoothDeviceInfo deviceAt(int row) const;
+    QList<QBluetoothDeviceInfo> allDevices() const;
+    bool isKnown(int row) const;
+
+    // Stable per-device key: the address, or the device UUID where hidden
+    static QString idOf(const QBluetoothDeviceInfo &info);
+
+signals:
+    void countChanged();
+
+private:
+    struct Entry {
+        QBluetoothDeviceInfo info;
+        bool known = false;
+    };
+
+    int rankOf(qint16 rssi, int skip) const;
+
+    QList<Entry> entries;
+};
+
+#endif
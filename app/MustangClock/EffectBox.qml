@@ -0,0 +1,71 @@
+import QtQuick 2.15
+import QtQuick.Controls 2.15
+
+GroupBox {
+    title: "Alarm Effect"
+
+    // Steps for BleManager::encodeEffect, sent as { "fx": effectBox.effect() };
+    // an empty list puts the clock's built-in blink back
+    function effect() {
+        switch (preset.currentIndex) {
+        case 1:
+            return [
+                { "op": "level", "level": 0 },
+                { "op": "out", "led": true },
+                { "op": "fade", "level": 7, "ms": 400 },
+                { "op": "repeat", "count": 10 },
+                { "op": "blank" },
+                { "op": "out", "led": true, "buzzer": true },
+                { "op": "wait", "ms": 200 },
+                { "op": "clock" },
+                { "op": "out", "led": true },
+                { "op": "wait", "ms": 800 },
+                { "op": "next" }
+            ]
+        case 2:
+            return [
+                { "op": "repeat", "count": 6 },
+                { "op": "out", "led": true, "buzzer": true },
+                { "op": "text", "text": message.text, "ms": 250 },
+                { "op": "out" },
+                { "op": "clock" },
+                { "op": "wait", "ms": 1000 },
+                { "op": "next" }
+            ]
+        case 3:
+            return [
+                { "op": "repeat", "count": 30 },
+                { "op": "out", "led": true, "buzzer": true },
+                { "op": "wait", "ms": 100 },
+                { "op": "out" },
+                { "op": "wait", "ms": 100 },
+                { "op": "out", "led": true, "buzzer": true },
+                { "op": "wait", "ms": 100 },
+                { "op": "out" },
+                { "op": "wait", "ms": 700 },
+                { "op": "next" }
+            ]
+        default:
+            return []
+        }
+    }
+
+    Column {
+        spacing: 8
+
+        ComboBox {
+            id: preset
+            width: 200
+            model: ["Blink (built in)", "Fade in", "Scroll text", "Beep beep"]
+        }
+
+        TextField {
+            id: message
+            width: 200
+            visible: preset.currentIndex === 2
+            text: "WAKE UP"
+            // MCFG_FX_MAX less the loop around the text
+            maximumLength: 48
+        }
+    }
+}
@@ -0,0 +1,186 @@
+// fleetprovisioner.cpp
+#include "FleetProvisioner.h"
+#include "BleTransport.h"
+#include "ClockLink.h"
+#include "DeviceListModel.h"
+#include <QDebug>
+#include <QTimer>
+
+FleetProvisioner::FleetProvisioner(BleBackend *backend, QObject *parent)
+    : QObject(parent), backend(backend)
+{
+}
+
+void FleetProvisioner::setMaxConcurrent(int n)
+{
+    n = qBound(1, n, kMaxLinks);
+    if (concurrency == n)
+        return;
+    concurrency = n;
+    emit maxConcurrentChanged();
+}
+
+void FleetProvisioner::start(const QList<QBluetoothDeviceInfo> &devices, const QByteArray &message)
+{
+    if (isRunning) {
+        qDebug() << "Fleet provisioning already running";
+        return;
+    }
+
+    jobs.clear();
+    for (const QBluetoothDeviceInfo &info : devices)
+        jobs.append({ info });
+
+    payload = message;
+    active = 0;
+    isRunning = true;
+    ++runGeneration;
+    timer.start();
+    emit runningChanged();
+    emit statusChanged();
+
+    qDebug() << "Provisioning" << jobs.size() << "clocks," << concurrency << "at a time,"
+             << payload.size() << "bytes each";
+    launchMore();
+}
+
+void FleetProvisioner::cancel()
+{
+    if (!isRunning)
+        return;
+
+    for (Job &job : jobs) {
+        job.waiting = false;
+        if (job.link) {
+            job.link->disconnect(this);
+            job.link->deleteLater();
+            job.link = nullptr;
+        }
+        if (job.state != QLatin1String("done") && job.state != QLatin1String("failed"))
+            job.state = QStringLiteral("cancelled");
+    }
+    active = 0;
+    ++runGeneration;
+    checkDone();
+}
+
+void FleetProvisioner::launchMore()
+{
+    for (int i = 0; i < jobs.size() && active < concurrency; ++i) {
+        Job &job = jobs[i];
+        if (!job.waiting)
+            continue;
+
+        job.waiting = false;
+        job.attempts++;
+        job.state = QStringLiteral("connecting");
+        job.link = new ClockLink(job.info, backend->createTransport(nullptr), this);
+        active++;
+
+        connect(job.link, &ClockLink::stateChanged, this, [=](ClockLink::State s) {
+            switch (s) {
+            case ClockLink::State::Discovering:
+                jobs[i].state = QStringLiteral("discovering");
+                break;
+            case ClockLink::State::Writing:
+                jobs[i].state = QStringLiteral("writing");
+                break;
+            default:
+                return;
+            }
+            emit statusChanged();
+        });
+        connect(job.link, &ClockLink::finished, this, [=](bool ok) { onLinkFinished(i, ok); });
+
+        job.link->provision(payload);
+    }
+    emit statusChanged();
+}
+
+void FleetProvisioner::onLinkFinished(int index, bool ok)
+{
+    Job &job = jobs[index];
+    ClockLink *link = job.link;
+
+    job.bytes = link->bytesSent();
+    job.ms = link->elapsedMs();
+    job.error = link->errorString();
+    job.link = nullptr;
+    link->deleteLater();
+    active--;
+
+    if (ok) {
+        job.state = QStringLiteral("done");
+    } else if (job.attempts < kMaxAttempts) {
+        job.state = QStringLiteral("retrying");
+        const int generation = runGeneration;
+        QTimer::singleShot(kRetryDelayMs * job.attempts, this, [=]() {
+            if (!isRunning || generation != runGeneration)
+                return;
+            jobs[index].waiting = true;
+            launchMore();
+        });
+    } else {
+        job.state = QStringLiteral("failed");
+    }
+
+    emit statusChanged();
+    launchMore();
+    checkDone();
+}
+
+void FleetProvisioner::checkDone()
+{
+    if (!isRunning || active > 0)
+        return;
+
+    int succeeded = 0;
+    int failed = 0;
+    for (const Job &job : jobs) {
+        if (job.state == QLatin1String("retrying"))
+            return;
+        if (job.state == QLatin1String("done"))
+            succeeded++;
+        else
+            failed++;
+    }
+
+    isRunning = false;
+    qDebug() << "Fleet provisioning finished:" << summary();
+    emit runningChanged();
+    emit statusChanged();
+    emit finished(succeeded, failed);
+}
+
+QVariantList FleetProvisioner::status() const
+{
+    QVariantList list;
+    for (const Job &job : jobs) {
+        list.append(QVariantMap{
+            { "name", job.info.name() },
+            { "address", DeviceListModel::idOf(job.info) },
+            { "state", job.state },
+            { "attempts", job.attempts },
+            { "bytes", job.bytes },
+            { "ms", job.ms },
+            { "error", job.error },
+        });
+    }
+    return list;
+}
+
+QString FleetProvisioner::summary() const
+{
+    int done = 0;
+    qsizetype bytes = 0;
+    for (const Job &job : jobs) {
+        if (job.state == QLatin1String("done")) {
+            done++;
+            bytes += job.bytes;
+        }
+    }
+
+    const qint64 ms = qMax<qint64>(timer.isValid() ? timer.elapsed() : 0, 1);
+    return QStringLiteral("%1/%2 clocks, %3 bytes in %4 ms, %5 B/s")
+        .arg(done).arg(jobs.size()).arg(bytes).arg(ms).arg(bytes * 1000 / ms);
+}
@@ -0,0 +1,77 @@
+#ifndef FLEETPROVISIONER_H
+#define FLEETPROVISIONER_H
+
+// fleetprovisioner.h
+#pragma once
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QList>
+#include <QVariantList>
+#include <QtBluetooth/QBluetoothDeviceInfo>
+
+class BleBackend;
+class ClockLink;
+
+/*
+ * Pushes one config message to many clocks, at most maxConcurrent links at
+ * a time (the host adapter limits simultaneous LE connections). Failed
+ * clocks are retried up to kMaxAttempts times with a growing back-off.
+ */
+class FleetProvisioner : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(bool running READ running NOTIFY runningChanged)
+    Q_PROPERTY(int maxConcurrent READ maxConcurrent WRITE setMaxConcurrent NOTIFY maxConcurrentChanged)
+    // One map per clock: name, address, state, attempts, bytes, ms, error
+    Q_PROPERTY(QVariantList status READ status NOTIFY statusChanged)
+    Q_PROPERTY(QString summary READ summary NOTIFY statusChanged)
+public:
+    static constexpr int kMaxAttempts = 3;
+    static constexpr int kRetryDelayMs = 500;
+    static constexpr int kMaxLinks = 7;
+
+    explicit FleetProvisioner(BleBackend *backend, QObject *parent = nullptr);
+
+    void start(const QList<QBluetoothDeviceInfo> &devices, const QByteArray &payload);
+    Q_INVOKABLE void cancel();
+
+    bool running() const { return isRunning; }
+    int maxConcurrent() const { return concurrency; }
+    void setMaxConcurrent(int n);
+    QVariantList status() const;
+    QString summary() const;
+
+signals:
+    void runningChanged();
+    void maxConcurrentChanged();
+    void statusChanged();
+    void finished(int succeeded, int failed);
+
+private:
+    struct Job {
+        QBluetoothDeviceInfo info;
+        QString state = QStringLiteral("queued");
+        QString error;
+        int attempts = 0;
+        bool waiting = true;     // eligible for a free slot
+        qsizetype bytes = 0;
+        qint64 ms = 0;
+        ClockLink *link = nullptr;
+    };
+
+    void launchMore();
+    void onLinkFinished(int job, bool ok);
+    void checkDone();
+
+    BleBackend *backend = nullptr;
+    QList<Job> jobs;
+    QByteArray payload;
+    int concurrency = 3;
+    int active = 0;
+    bool isRunning = false;
+    int runGeneration = 0;      // bumped by start() and cancel(), drops stale retries
+    QElapsedTimer timer;
+};
+
+#endif
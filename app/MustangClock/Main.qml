@@ -16,6 +16,19 @@ ApplicationWindow {
         WifiBox { id: wifiBox }
         TimeBox { id: timeBox }
         AlarmBox { id: alarmBox }
+        EffectBox { id: effectBox }
+
+        CheckBox {
+            text: "Binary protocol"
+            checked: bleManager.binaryConfig
+            onToggled: bleManager.binaryConfig = checked
+        }
+
+        CheckBox {
+            text: "Write without response"
+            checked: bleManager.writeWithoutResponse
+            onToggled: bleManager.writeWithoutResponse = checked
+        }
 
         // Status labels
         Label {
@@ -36,6 +49,43 @@ ApplicationWindow {
             width: parent.width
         }
 
+        // Connection profile and the throughput of the last config sent
+        Label {
+            visible: bleManager.connectionProfile !== ""
+            text: bleManager.connectionProfile
+                  + (bleManager.connectionIntervalMs > 0 ? "  " + bleManager.connectionIntervalMs + " ms" : "")
+                  + (bleManager.throughput > 0 ? "  " + bleManager.throughput + " B/s" : "")
+            horizontalAlignment: Text.AlignHCenter
+            width: parent.width
+        }
+
+        // Clocks from the last scan, strongest first; tap to connect
+        ListView {
+            width: parent.width
+            height: Math.min(contentHeight, 120)
+            clip: true
+            model: bleManager.devices
+            delegate: ItemDelegate {
+                width: ListView.view.width
+                text: name + "  " + rssi + " dBm" + (known ? "  ★" : "")
+                onClicked: bleManager.connectToIndex(index)
+            }
+        }
+
+        // Fleet mode: per-clock progress while provisioning several clocks
+        Repeater {
+            model: bleManager.fleet.status
+            delegate: Label {
+                text: modelData.name + "  " + modelData.state
+                      + (modelData.attempts > 1 ? "  (try " + modelData.attempts + ")" : "")
+            }
+        }
+
+        Label {
+            visible: bleManager.fleet.status.length > 0
+            text: bleManager.fleet.summary
+        }
+
         GridLayout {
             columns: 2
             rowSpacing: 12
@@ -44,7 +94,8 @@ ApplicationWindow {
             width: parent.width * 0.9
 
             Button {
-                text: "Connect"
+                text: bleManager.scanning ? "Scanning..." : "Connect"
+                enabled: !bleManager.scanning
                 onClicked: {
                     if (!bleManager.deviceFoundYet) {
                         bleManager.startScan()
@@ -54,12 +105,43 @@ ApplicationWindow {
                 }
             }
 
+            Button {
+                text: "Scan fleet"
+                enabled: !bleManager.scanning && !bleManager.fleet.running
+                onClicked: bleManager.scanFleet()
+            }
+
+            Button {
+                text: "Provision all"
+                enabled: !bleManager.scanning && !bleManager.fleet.running && bleManager.devices.count > 0
+                onClicked: bleManager.provisionFleet({
+                    "wifi": wifiBox.config,
+                    "time": timeBox.config,
+                    "alarms": alarmBox.alarms(),
+                    "fx": effectBox.effect()
+                })
+            }
+
+            Button {
+                text: "Apply all"
+                Layout.fillWidth: true
+                onClicked: {
+                    bleManager.beginConfig()
+                    bleManager.stageConfig({ "wifi": wifiBox.config })
+                    bleManager.stageConfig({ "time": timeBox.config })
+                    bleManager.stageConfig({ "alarms": alarmBox.alarms() })
+                    bleManager.stageConfig({ "fx": effectBox.effect() })
+                    bleManager.commitConfig()
+                    sendStatusLabel.text = "All config queued"
+                }
+            }
+
             Button {
                 text: "Send WiFi"
                 Layout.fillWidth: true
                 onClicked: {
                     bleManager.sendConfig({ "wifi": wifiBox.config })
-                    sendStatusLabel.text = "WiFi config sent!"
+                    sendStatusLabel.text = "WiFi config queued"
                 }
             }
 
@@ -68,16 +150,25 @@ ApplicationWindow {
                 Layout.fillWidth: true
                 onClicked: {
                     bleManager.sendConfig({ "time": timeBox.config })
-                    sendStatusLabel.text = "Time config sent!"
+                    sendStatusLabel.text = "Time config queued"
                 }
             }
 
             Button {
-                text: "Send Alarm"
+                text: "Send Alarms"
                 Layout.fillWidth: true
                 onClicked: {
-                    bleManager.sendConfig({ "alarm": alarmBox.config })
-                    sendStatusLabel.text = "Alarm config sent!"
+                    bleManager.sendConfig({ "alarms": alarmBox.alarms() })
+                    sendStatusLabel.text = "Alarm table queued"
+                }
+            }
+
+            Button {
+                text: "Send Effect"
+                Layout.fillWidth: true
+                onClicked: {
+                    bleManager.sendConfig({ "fx": effectBox.effect() })
+                    sendStatusLabel.text = "Alarm effect queued"
                 }
             }
         }
@@ -93,7 +184,12 @@ ApplicationWindow {
             connectionStatusLabel.text = "Disconnected"
         }
         function onDataSent(type) {
+            sendStatusLabel.color = "green"
             sendStatusLabel.text = type + " config sent!"
         }
+        function onConfigRejected(type) {
+            sendStatusLabel.color = "red"
+            sendStatusLabel.text = type + " config too long, not sent"
+        }
     }
 }
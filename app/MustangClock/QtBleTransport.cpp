@@ -0,0 +1,302 @@
+// qtbletransport.cpp
+#include "QtBleTransport.h"
+#include "BleManager.h"
+#include "DeviceListModel.h"
+#include <QDebug>
+#include <QSettings>
+
+QtBleTransport::QtBleTransport(QObject *parent) : BleTransport(parent)
+{
+}
+
+QtBleTransport::~QtBleTransport()
+{
+    disconnectFromDevice();
+}
+
+void QtBleTransport::connectToDevice(const QBluetoothDeviceInfo &device)
+{
+    disconnectFromDevice();
+
+    info = device;
+    hasCachedLayout = !cachedLayout().isEmpty();
+
+    controller = QLowEnergyController::createCentral(info, this);
+    if (!controller) {
+        qWarning() << "Failed to create QLowEnergyController";
+        emit errorOccurred(QStringLiteral("no controller"));
+        return;
+    }
+
+    connect(controller, &QLowEnergyController::connected, this, [=]() {
+        qDebug() << "Connected, discovering services...";
+        emit connected();
+        controller->discoverServices();
+    });
+
+    connect(controller, &QLowEnergyController::disconnected, this, [=]() {
+        qDebug() << "Disconnected";
+        emit disconnected();
+    });
+
+    connect(controller, &QLowEnergyController::serviceDiscovered, this, [=](const QBluetoothUuid &uuid){
+        if (uuid != BleManager::SERVICE_UUID)
+            return;
+        qDebug() << "Config service found";
+
+        // Known layout: no need to wait for the remaining services
+        if (hasCachedLayout && !configService)
+            setupConfigService();
+    });
+
+    connect(controller, &QLowEnergyController::discoveryFinished, this, [=]() {
+        if (!configService)
+            setupConfigService();
+        checkDatabaseHash();
+    });
+
+    connect(controller, &QLowEnergyController::mtuChanged, this, [=](int mtu) {
+        qDebug() << "ATT MTU:" << mtu;
+    });
+
+    connect(controller, &QLowEnergyController::errorOccurred, this, [=](QLowEnergyController::Error error){
+        qDebug() << "BLE controller error:" << error;
+        emit errorOccurred(QStringLiteral("controller error %1").arg(int(error)));
+    });
+
+    connect(controller, &QLowEnergyController::connectionUpdated, this, [=](const QLowEnergyConnectionParameters &params){
+        qDebug() << "BLE connection updated:"
+                 << "Latency:" << params.latency()
+                 << "Supervision Timeout:" << params.supervisionTimeout();
+        emit connectionIntervalChanged(qMax(1, int(params.maximumInterval())));
+    });
+
+    qDebug() << "Starting connection to device...";
+    controller->connectToDevice();
+}
+
+void QtBleTransport::disconnectFromDevice()
+{
+    if (!controller)
+        return;
+
+    // The old controller outlives this link until it has fully disconnected
+    QLowEnergyController *old = controller;
+    old->disconnect(this);
+    old->setParent(nullptr);
+    if (old->state() != QLowEnergyController::UnconnectedState) {
+        connect(old, &QLowEnergyController::disconnected, old, [=]() {
+            qDebug() << "Old controller fully disconnected, deleting...";
+            old->deleteLater();
+        });
+        old->disconnectFromDevice();
+    } else {
+        old->deleteLater();
+    }
+
+    if (configService)
+        configService->deleteLater();
+    controller = nullptr;
+    configService = nullptr;
+    configChar = QLowEnergyCharacteristic();
+}
+
+bool QtBleTransport::canWriteWithoutResponse() const
+{
+    return configChar.isValid() && (configChar.properties() & QLowEnergyCharacteristic::WriteNoResponse);
+}
+
+void QtBleTransport::writeConfig(const QByteArray &data, bool withResponse)
+{
+    if (!isReady())
+        return;
+    configService->writeCharacteristic(configChar, data,
+                                       withResponse ? QLowEnergyService::WriteWithResponse
+                                                    : QLowEnergyService::WriteWithoutResponse);
+}
+
+void QtBleTransport::requestConnectionUpdate(const QLowEnergyConnectionParameters &params)
+{
+    // Not supported on every platform; connectionUpdated tells what was granted
+    if (controller && controller->state() != QLowEnergyController::UnconnectedState)
+        controller->requestConnectionUpdate(params);
+}
+
+void QtBleTransport::setupConfigService()
+{
+    configService = controller->createServiceObject(BleManager::SERVICE_UUID, this);
+    if (!configService) {
+        qDebug() << "Service creation failed";
+        emit errorOccurred(QStringLiteral("config service missing"));
+        return;
+    }
+
+    connect(configService, &QLowEnergyService::stateChanged, this, [=](QLowEnergyService::ServiceState s){
+        if (s != QLowEnergyService::RemoteServiceDiscovered)
+            return;
+
+        configChar = configService->characteristic(BleManager::CONFIG_CHAR_UUID);
+        if (!configChar.isValid()) {
+            emit errorOccurred(QStringLiteral("config characteristic missing"));
+            return;
+        }
+
+        const QString layout = serviceLayout();
+        if (layout != cachedLayout()) {
+            qDebug() << "Caching config service layout:" << layout;
+            storeGattCache(QStringLiteral("layout"), layout);
+        }
+
+        emit ready();
+    });
+
+    connect(configService, &QLowEnergyService::characteristicWritten, this,
+            [=](const QLowEnergyCharacteristic &, const QByteArray &value) {
+                emit written(value);
+            });
+
+    connect(configService, &QLowEnergyService::errorOccurred, this,
+            [=](QLowEnergyService::ServiceError error) {
+                if (error == QLowEnergyService::CharacteristicWriteError)
+                    emit writeFailed();
+                else
+                    emit errorOccurred(QStringLiteral("service error %1").arg(int(error)));
+            });
+
+    // The config characteristic is write-only, there are no values worth reading
+    configService->discoverDetails(QLowEnergyService::SkipValueDiscovery);
+}
+
+bool QtBleTransport::hasGattCache(const QBluetoothDeviceInfo &info)
+{
+    QSettings settings(QStringLiteral("MustangClock"), QStringLiteral("MustangClock"));
+    settings.beginGroup(QStringLiteral("gattCache"));
+    return settings.childGroups().contains(DeviceListModel::idOf(info));
+}
+
+QString QtBleTransport::cacheGroup() const
+{
+    return QStringLiteral("gattCache/") + DeviceListModel::idOf(info);
+}
+
+QString QtBleTransport::cachedLayout() const
+{
+    QSettings settings(QStringLiteral("MustangClock"), QStringLiteral("MustangClock"));
+    return settings.value(cacheGroup() + QStringLiteral("/layout")).toString();
+}
+
+void QtBleTransport::storeGattCache(const QString &key, const QVariant &value)
+{
+    QSettings settings(QStringLiteral("MustangClock"), QStringLiteral("MustangClock"));
+    settings.setValue(cacheGroup() + '/' + key, value);
+}
+
+QString QtBleTransport::serviceLayout() const
+{
+    QStringList entries;
+    for (const QLowEnergyCharacteristic &c : configService->characteristics())
+        entries << c.uuid().toString(QUuid::WithoutBraces) + ':' + QString::number(int(c.properties()), 16);
+    entries.sort();
+    return entries.join(',');
+}
+
+void QtBleTransport::checkDatabaseHash()
+{
+    const QBluetoothUuid gattUuid(QBluetoothUuid::ServiceClassUuid::GenericAttribute);
+    if (!controller || !controller->services().contains(gattUuid))
+        return;
+
+    QLowEnergyService *gatt = controller->createServiceObject(gattUuid, this);
+    if (!gatt)
+        return;
+
+    const QBluetoothUuid hashUuid(quint16(0x2B2A));
+
+    connect(gatt, &QLowEnergyService::stateChanged, this, [=](QLowEnergyService::ServiceState s){
+        if (s != QLowEnergyService::RemoteServiceDiscovered)
+            return;
+        const QLowEnergyCharacteristic hash = gatt->characteristic(hashUuid);
+        if (hash.isValid())
+            gatt->readCharacteristic(hash);
+        else
+            gatt->deleteLater();
+    });
+
+    connect(gatt, &QLowEnergyService::characteristicRead, this,
+            [=](const QLowEnergyCharacteristic &c, const QByteArray &value) {
+                if (c.uuid() != hashUuid)
+                    return;
+
+                QSettings settings(QStringLiteral("MustangClock"), QStringLiteral("MustangClock"));
+                const QByteArray cached = settings.value(cacheGroup() + QStringLiteral("/dbHash")).toByteArray();
+                if (!cached.isEmpty() && cached != value) {
+                    qDebug() << "GATT database changed, dropping cached layout";
+                    settings.remove(cacheGroup());
+
+                    // Only the old entries are stale: a layout already discovered
+                    // on this link is current, and one still being discovered is
+                    // stored when it is done
+                    if (configChar.isValid())
+                        settings.setValue(cacheGroup() + QStringLiteral("/layout"), serviceLayout());
+                }
+                settings.setValue(cacheGroup() + QStringLiteral("/dbHash"), value);
+                gatt->deleteLater();
+            });
+
+    gatt->discoverDetails(QLowEnergyService::SkipValueDiscovery);
+}
+
+QtBleBackend::QtBleBackend(QObject *parent) : BleBackend(parent)
+{
+    discoveryAgent = new QBluetoothDeviceDiscoveryAgent(this);
+    localDevice = new QBluetoothLocalDevice(this);
+
+    connect(discoveryAgent, &QBluetoothDeviceDiscoveryAgent::deviceDiscovered,
+            this, &BleBackend::deviceDiscovered);
+
+    // RSSI refreshes for devices already seen
+    connect(discoveryAgent, &QBluetoothDeviceDiscoveryAgent::deviceUpdated,
+            this, [=](const QBluetoothDeviceInfo &info, QBluetoothDeviceInfo::Fields fields) {
+                if (fields & QBluetoothDeviceInfo::Field::RSSI)
+                    emit deviceDiscovered(info);
+            });
+
+    connect(discoveryAgent, &QBluetoothDeviceDiscoveryAgent::finished,
+            this, &BleBackend::scanFinished);
+
+    connect(discoveryAgent, &QBluetoothDeviceDiscoveryAgent::errorOccurred,
+            this, [=](QBluetoothDeviceDiscoveryAgent::Error error) {
+                qDebug() << "Scan error:" << error;
+                emit scanError(discoveryAgent->errorString());
+            });
+}
+
+void QtBleBackend::startScan(int windowMs)
+{
+    discoveryAgent->setLowEnergyDiscoveryTimeout(windowMs);
+    discoveryAgent->start(QBluetoothDeviceDiscoveryAgent::LowEnergyMethod);
+}
+
+void QtBleBackend::stopScan()
+{
+    discoveryAgent->stop();
+}
+
+bool QtBleBackend::isKnownDevice(const QBluetoothDeviceInfo &info) const
+{
+    return QtBleTransport::hasGattCache(info);
+}
+
+void QtBleBackend::requestPairing(const QBluetoothDeviceInfo &info)
+{
+    // Pair only if not already paired
+    if (localDevice->pairingStatus(info.address()) != QBluetoothLocalDevice::Paired) {
+        qDebug() << "Requesting pairing...";
+        localDevice->requestPairing(info.address(), QBluetoothLocalDevice::Paired);
+    }
+}
+
+BleTransport *QtBleBackend::createTransport(QObject *parent)
+{
+    return new QtBleTransport(parent);
+}
@@ -0,0 +1,72 @@
+#ifndef QTBLETRANSPORT_H
+#define QTBLETRANSPORT_H
+
+// qtbletransport.h
+#pragma once
+
+#include <QtBluetooth/QBluetoothDeviceDiscoveryAgent>
+#include <QtBluetooth/QBluetoothLocalDevice>
+#include <QtBluetooth/QLowEnergyController>
+#include <QtBluetooth/QLowEnergyService>
+
+#include "BleTransport.h"
+
+/*
+ * Qt Bluetooth link. Keeps a per-device GATT cache in QSettings: the config
+ * service layout and the peer's Database Hash (0x2B2A). A known layout lets
+ * the config service be set up as soon as it is discovered; a changed hash
+ * drops the entry.
+ */
+class QtBleTransport : public BleTransport
+{
+    Q_OBJECT
+public:
+    explicit QtBleTransport(QObject *parent = nullptr);
+    ~QtBleTransport();
+
+    void connectToDevice(const QBluetoothDeviceInfo &info) override;
+    void disconnectFromDevice() override;
+    bool isReady() const override { return configService && configChar.isValid(); }
+    int mtu() const override { return controller ? controller->mtu() : 0; }
+    bool canWriteWithoutResponse() const override;
+    bool layoutCached() const override { return hasCachedLayout; }
+    void writeConfig(const QByteArray &data, bool withResponse) override;
+    void requestConnectionUpdate(const QLowEnergyConnectionParameters &params) override;
+
+    static bool hasGattCache(const QBluetoothDeviceInfo &info);
+
+private:
+    void setupConfigService();
+    void checkDatabaseHash();
+    QString cacheGroup() const;
+    QString cachedLayout() const;
+    QString serviceLayout() const;
+    void storeGattCache(const QString &key, const QVariant &value);
+
+    QBluetoothDeviceInfo info;
+    QLowEnergyController *controller = nullptr;
+    QLowEnergyService *configService = nullptr;
+    QLowEnergyCharacteristic configChar;
+    bool hasCachedLayout = false;
+};
+
+// LE discovery through QBluetoothDeviceDiscoveryAgent, QtBleTransport links
+class QtBleBackend : public BleBackend
+{
+    Q_OBJECT
+public:
+    explicit QtBleBackend(QObject *parent = nullptr);
+
+    void startScan(int windowMs) override;
+    void stopScan() override;
+    bool isScanning() const override { return discoveryAgent->isActive(); }
+    bool isKnownDevice(const QBluetoothDeviceInfo &info) const override;
+    void requestPairing(const QBluetoothDeviceInfo &info) override;
+    BleTransport *createTransport(QObject *parent) override;
+
+private:
+    QBluetoothDeviceDiscoveryAgent *discoveryAgent = nullptr;
+    QBluetoothLocalDevice *localDevice = nullptr;
+};
+
+#endif
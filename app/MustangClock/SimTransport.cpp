@@ -0,0 +1,334 @@
+// simtransport.cpp
+#include "SimTransport.h"
+#include "BleManager.h"
+#include "DeviceListModel.h"
+#include <QDebug>
+#include <QJsonDocument>
+
+SimParams SimParams::fromString(const QString &spec, bool *ok)
+{
+    SimParams p;
+    bool valid = true;
+
+    for (const QString &entry : spec.split(',', Qt::SkipEmptyParts)) {
+        const QString key = entry.section('=', 0, 0).trimmed();
+        const QString value = entry.section('=', 1).trimmed();
+        bool num = true;
+
+        if (key == QLatin1String("default") && value.isEmpty())
+            continue;
+        else if (key == QLatin1String("clocks"))
+            p.clocks = value.toInt(&num);
+        else if (key == QLatin1String("mtu"))
+            p.mtu = value.toInt(&num);
+        else if (key == QLatin1String("interval"))
+            p.intervalMs = value.toInt(&num);
+        else if (key == QLatin1String("latency"))
+            p.latencyMs = value.toInt(&num);
+        else if (key == QLatin1String("loss"))
+            p.loss = value.toDouble(&num);
+        else if (key == QLatin1String("packets"))
+            p.packetsPerEvent = value.toInt(&num);
+        else if (key == QLatin1String("seed"))
+            p.seed = value.toUInt(&num);
+        else
+            num = false;
+
+        valid = valid && num;
+    }
+
+    // 7.5 ms is the shortest connection interval, 517 the largest ATT MTU
+    valid = valid && p.clocks >= 1 && p.clocks <= 32 && p.mtu >= 23 && p.mtu <= 517
+        && p.intervalMs >= 7 && p.latencyMs >= 0 && p.loss >= 0.0 && p.loss <= 1.0
+        && p.packetsPerEvent >= 1;
+
+    if (ok)
+        *ok = valid;
+    return valid ? p : SimParams();
+}
+
+SimTransport::SimTransport(SimBackend *backend, QObject *parent)
+    : BleTransport(parent), backend(backend)
+{
+    setupTimer.setSingleShot(true);
+    connect(&setupTimer, &QTimer::timeout, this, [=]() {
+        linkUp = true;
+        silentEvents = 0;
+        discoveryLeft = cached ? 1 : kDiscoveryRequests;
+        intervalMs = backend->params().intervalMs;
+        emit connected();
+        emit connectionIntervalChanged(intervalMs);
+        eventTimer.start(intervalMs);
+    });
+
+    connect(&eventTimer, &QTimer::timeout, this, &SimTransport::onConnectionEvent);
+}
+
+SimTransport::~SimTransport()
+{
+    disconnectFromDevice();
+}
+
+void SimTransport::connectToDevice(const QBluetoothDeviceInfo &info)
+{
+    disconnectFromDevice();
+
+    id = DeviceListModel::idOf(info);
+    cached = backend->isKnownDevice(info);
+    setupTimer.start(backend->params().latencyMs);
+}
+
+void SimTransport::disconnectFromDevice()
+{
+    setupTimer.stop();
+    eventTimer.stop();
+    linkUp = false;
+    linkReady = false;
+    discoveryLeft = 0;
+    txQueue.clear();
+    awaitingResponse = false;
+    eventsToUpdate = 0;
+}
+
+int SimTransport::mtu() const
+{
+    // Exchanged during discovery
+    return linkReady ? backend->params().mtu : 23;
+}
+
+void SimTransport::writeConfig(const QByteArray &data, bool withResponse)
+{
+    if (!linkReady)
+        return;
+    txQueue.append({ data, withResponse });
+}
+
+void SimTransport::requestConnectionUpdate(const QLowEnergyConnectionParameters &params)
+{
+    if (!linkUp)
+        return;
+
+    // The central grants the shortest interval it was asked for
+    pendingIntervalMs = qMax(7, int(params.minimumInterval()));
+    eventsToUpdate = kUpdateInstantEvents;
+}
+
+void SimTransport::onConnectionEvent()
+{
+    int budget = backend->params().packetsPerEvent;
+
+    if (eventsToUpdate > 0 && --eventsToUpdate == 0 && pendingIntervalMs != intervalMs) {
+        intervalMs = pendingIntervalMs;
+        eventTimer.setInterval(intervalMs);
+        emit connectionIntervalChanged(intervalMs);
+    }
+
+    // Lost packets are retried by the link layer; the link drops after a
+    // supervision timeout's worth of events without getting through
+    auto transmit = [&]() {
+        if (backend->rollLoss()) {
+            backend->onRetransmit(id);
+            silentEvents++;
+            return false;
+        }
+        silentEvents = 0;
+        budget--;
+        return true;
+    };
+
+    auto checkSupervision = [&]() {
+        if (silentEvents * intervalMs >= kSupervisionTimeoutMs)
+            dropLink();
+    };
+
+    if (awaitingResponse) {
+        if (!transmit()) {
+            checkSupervision();
+            return;
+        }
+        awaitingResponse = false;
+        if (responseOk)
+            emit written(responseValue);
+        else
+            emit writeFailed();
+
+        // The handler may have closed the link
+        if (!linkUp)
+            return;
+    }
+
+    if (discoveryLeft > 0) {
+        if (transmit() && --discoveryLeft == 0) {
+            linkReady = true;
+            backend->onReady(id);
+            emit ready();
+        }
+        checkSupervision();
+        return;
+    }
+
+    while (budget > 0 && !awaitingResponse && !txQueue.isEmpty()) {
+        if (!transmit())
+            break;
+
+        const Packet packet = txQueue.takeFirst();
+        const bool ok = backend->deliver(id, packet.data);
+        if (packet.withResponse) {
+            awaitingResponse = true;
+            responseOk = ok;
+            responseValue = packet.data;
+        }
+    }
+    checkSupervision();
+}
+
+void SimTransport::dropLink()
+{
+    qDebug() << "Simulated supervision timeout on" << id;
+    disconnectFromDevice();
+    emit disconnected();
+}
+
+SimBackend::SimBackend(const SimParams &params, QObject *parent)
+    : BleBackend(parent), simParams(params), rng(params.seed)
+{
+    uptime.start();
+
+    for (int i = 0; i < simParams.clocks; ++i) {
+        QBluetoothDeviceInfo info(QBluetoothAddress(Q_UINT64_C(0xC0DE00000000) | quint64(i + 1)),
+                                  QStringLiteral("MUSTANG-SIM-%1").arg(i + 1), 0);
+        info.setCoreConfigurations(QBluetoothDeviceInfo::LowEnergyCoreConfiguration);
+        info.setServiceUuids({ BleManager::SERVICE_UUID });
+        // First clock strongest
+        info.setRssi(qint16(-45 - 2 * i));
+        clocks.append(info);
+    }
+
+    scanTimer.setSingleShot(true);
+    connect(&scanTimer, &QTimer::timeout, this, [=]() {
+        scanning = false;
+        emit scanFinished();
+    });
+}
+
+void SimBackend::startScan(int windowMs)
+{
+    if (scanning)
+        return;
+
+    scanning = true;
+    const int generation = ++scanGeneration;
+
+    // First advertisements spread over one advertising interval
+    for (int i = 0; i < clocks.size(); ++i) {
+        QTimer::singleShot(kAdvIntervalMs * (i + 1) / int(clocks.size()), this, [=]() {
+            if (scanning && generation == scanGeneration)
+                emit deviceDiscovered(clocks.at(i));
+        });
+    }
+    scanTimer.start(windowMs);
+}
+
+void SimBackend::stopScan()
+{
+    scanTimer.stop();
+    scanning = false;
+    ++scanGeneration;
+}
+
+bool SimBackend::isKnownDevice(const QBluetoothDeviceInfo &info) const
+{
+    return known.contains(DeviceListModel::idOf(info));
+}
+
+BleTransport *SimBackend::createTransport(QObject *parent)
+{
+    return new SimTransport(this, parent);
+}
+
+SimBackend::Peripheral &SimBackend::peripheral(const QString &id)
+{
+    auto it = peripherals.find(id);
+    if (it == peripherals.end()) {
+        it = peripherals.insert(id, Peripheral());
+        it->buf.resize(kReasmMax);
+        mcfg_reasm_init(&it->reasm, reinterpret_cast<uint8_t *>(it->buf.data()), size_t(it->buf.size()));
+    }
+    return *it;
+}
+
+bool SimBackend::rollLoss()
+{
+    return simParams.loss > 0.0 && rng.generateDouble() < simParams.loss;
+}
+
+void SimBackend::onReady(const QString &id)
+{
+    known.insert(id);
+    peripheral(id).stats.connections++;
+}
+
+void SimBackend::onRetransmit(const QString &id)
+{
+    peripheral(id).stats.retransmits++;
+}
+
+bool SimBackend::deliver(const QString &id, const QByteArray &value)
+{
+    Peripheral &p = peripheral(id);
+    const auto *data = reinterpret_cast<const uint8_t *>(value.constData());
+    QByteArray message = value;
+
+    p.stats.packets++;
+    p.stats.bytes += value.size();
+
+    // Same checks as the firmware's config characteristic
+    if (mcfg_is_fragment(data, size_t(value.size()))) {
+        const int rc = mcfg_reasm_push(&p.reasm, data, size_t(value.size()), quint32(uptime.elapsed()));
+        if (rc == MCFG_FRAG_MORE)
+            return true;
+        if (rc != MCFG_OK) {
+            p.stats.errors++;
+            return false;
+        }
+        message = QByteArray(reinterpret_cast<const char *>(p.reasm.buf), qsizetype(p.reasm.len));
+    }
+
+    bool valid;
+    if (mcfg_is_binary(reinterpret_cast<const uint8_t *>(message.constData()), size_t(message.size()))) {
+        mcfg_config_t cfg;
+        valid = mcfg_decode(reinterpret_cast<const uint8_t *>(message.constData()),
+                            size_t(message.size()), &cfg) == MCFG_OK;
+    } else {
+        valid = QJsonDocument::fromJson(message).isObject();
+    }
+
+    if (!valid) {
+        p.stats.errors++;
+        return false;
+    }
+
+    p.stats.messages++;
+    p.stats.lastMessage = message;
+    emit messageReceived(id, message);
+    return true;
+}
+
+QVariantList SimBackend::statsList() const
+{
+    QVariantList list;
+    for (const QBluetoothDeviceInfo &info : clocks) {
+        const Stats s = stats(DeviceListModel::idOf(info));
+        list.append(QVariantMap{
+            { "name", info.name() },
+            { "address", DeviceListModel::idOf(info) },
+            { "connections", s.connections },
+            { "packets", s.packets },
+            { "retransmits", s.retransmits },
+            { "messages", s.messages },
+            { "errors", s.errors },
+            { "bytes", s.bytes },
+        });
+    }
+    return list;
+}
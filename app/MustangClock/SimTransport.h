@@ -0,0 +1,161 @@
+#ifndef SIMTRANSPORT_H
+#define SIMTRANSPORT_H
+
+// simtransport.h
+#pragma once
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QRandomGenerator>
+#include <QSet>
+#include <QTimer>
+#include <QVariantMap>
+
+#include "BleTransport.h"
+#include "mustang_cfg.h"
+
+/*
+ * Link and peripheral model, one set for every simulated clock. Parsed from
+ * "key=value,..." (keys as below, "default" for none), see SimBackend.
+ */
+struct SimParams {
+    int clocks = 1;
+    int mtu = 247;
+    int intervalMs = 30;        // connection interval chosen by the central
+    int latencyMs = 50;         // connection setup
+    double loss = 0.0;          // per packet, retransmitted next event
+    int packetsPerEvent = 4;
+    quint32 seed = 1;
+
+    static SimParams fromString(const QString &spec, bool *ok = nullptr);
+};
+
+class SimBackend;
+
+/*
+ * Link to a simulated clock, paced by connection events: each event carries
+ * up to packetsPerEvent packets, a lost packet is retried on the next event,
+ * a with-response write is answered one event later and blocks the link
+ * until then (one ATT request outstanding). Service discovery costs one
+ * request per event, a single one for a clock seen before.
+ */
+class SimTransport : public BleTransport
+{
+    Q_OBJECT
+public:
+    // Discovery requests without a cached layout
+    static constexpr int kDiscoveryRequests = 4;
+    static constexpr int kSupervisionTimeoutMs = 4000;
+
+    explicit SimTransport(SimBackend *backend, QObject *parent = nullptr);
+    ~SimTransport();
+
+    void connectToDevice(const QBluetoothDeviceInfo &info) override;
+    void disconnectFromDevice() override;
+    bool isReady() const override { return linkReady; }
+    int mtu() const override;
+    bool canWriteWithoutResponse() const override { return linkReady; }
+    bool layoutCached() const override { return cached; }
+    void writeConfig(const QByteArray &data, bool withResponse) override;
+    // Takes effect kUpdateInstantEvents connection events later
+    void requestConnectionUpdate(const QLowEnergyConnectionParameters &params) override;
+
+    static constexpr int kUpdateInstantEvents = 6;
+
+private:
+    void onConnectionEvent();
+    void dropLink();
+
+    struct Packet {
+        QByteArray data;
+        bool withResponse;
+    };
+
+    SimBackend *backend = nullptr;
+    QString id;
+    QTimer setupTimer;
+    QTimer eventTimer;
+    bool linkUp = false;
+    bool linkReady = false;
+    bool cached = false;
+    int discoveryLeft = 0;
+    QList<Packet> txQueue;
+    // Response due on the next event
+    bool awaitingResponse = false;
+    bool responseOk = false;
+    QByteArray responseValue;
+    int silentEvents = 0;
+    int intervalMs = 0;
+    int pendingIntervalMs = 0;
+    int eventsToUpdate = 0;
+};
+
+/*
+ * In-process stand-in for the adapter and any number of clocks. Scanning
+ * reports params.clocks clocks advertising the config service; each one
+ * reassembles and validates what it receives like the firmware does and
+ * keeps counters for benchmarks. Loss is drawn from a generator seeded with
+ * params.seed, so a run is reproducible.
+ */
+class SimBackend : public BleBackend
+{
+    Q_OBJECT
+public:
+    static constexpr int kAdvIntervalMs = 100;
+    static constexpr int kReasmMax = 2048;
+
+    struct Stats {
+        int connections = 0;
+        int packets = 0;
+        int retransmits = 0;
+        int messages = 0;
+        int errors = 0;
+        qsizetype bytes = 0;
+        QByteArray lastMessage;
+    };
+
+    explicit SimBackend(const SimParams &params, QObject *parent = nullptr);
+
+    const SimParams &params() const { return simParams; }
+
+    void startScan(int windowMs) override;
+    void stopScan() override;
+    bool isScanning() const override { return scanning; }
+    bool isKnownDevice(const QBluetoothDeviceInfo &info) const override;
+    BleTransport *createTransport(QObject *parent) override;
+
+    // Peripheral side, by DeviceListModel::idOf
+    Stats stats(const QString &id) const { return peripherals.value(id).stats; }
+    QVariantList statsList() const;
+
+    // Used by SimTransport
+    bool rollLoss();
+    void onReady(const QString &id);
+    void onRetransmit(const QString &id);
+    bool deliver(const QString &id, const QByteArray &value);
+
+signals:
+    void messageReceived(const QString &id, const QByteArray &message);
+
+private:
+    struct Peripheral {
+        Stats stats;
+        QByteArray buf;
+        mcfg_reasm_t reasm = {};
+    };
+
+    Peripheral &peripheral(const QString &id);
+
+    SimParams simParams;
+    QList<QBluetoothDeviceInfo> clocks;
+    QRandomGenerator rng;
+    QHash<QString, Peripheral> peripherals;
+    QSet<QString> known;
+    QTimer scanTimer;
+    QElapsedTimer uptime;
+    bool scanning = false;
+    int scanGeneration = 0;
+};
+
+#endif
@@ -15,11 +15,16 @@ GroupBox {
         TextField {
             id: ssidField
             placeholderText: "SSID"
+            // MCFG_SSID_MAX in protocol/mustang_cfg.h; characters, not bytes,
+            // so a longer UTF-8 name is still rejected when it is sent
+            maximumLength: 32
         }
 
         TextField {
             id: pskField
             placeholderText: "Password"
+            // MCFG_PSK_MAX
+            maximumLength: 64
             echoMode: TextInput.Password
         }
     }
@@ -0,0 +1,104 @@
+// cli.cpp - headless front-end, see CliRunner.h for the output format
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QFile>
+#include <QHash>
+#include <QJsonDocument>
+#include <QTextStream>
+
+#include "CliRunner.h"
+
+static bool readConfig(const QString &path, QVariantMap *config)
+{
+    QFile file(path);
+    const bool ok = path == QLatin1String("-")
+        ? file.open(stdin, QIODevice::ReadOnly)
+        : file.open(QIODevice::ReadOnly);
+    if (!ok)
+        return false;
+
+    QJsonParseError error;
+    const QJsonDocument doc = QJsonDocument::fromJson(file.readAll(), &error);
+    if (error.error != QJsonParseError::NoError || !doc.isObject())
+        return false;
+
+    *config = doc.object().toVariantMap();
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("mustangclock-cli");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        "Headless Mustang clock tool. Prints one JSON event per line on stdout.\n\n"
+        "Commands:\n"
+        "  scan                 list clocks in range\n"
+        "  connect              connect and report readiness latency\n"
+        "  send <config|->      send one config message (JSON file or stdin)\n"
+        "  provision <config|-> send the config to every clock found\n\n"
+        "Simulation (--simulate), comma separated key=value, \"default\" for none:\n"
+        "  clocks=1 mtu=247 interval=30 latency=50 loss=0 packets=4 seed=1");
+    parser.addHelpOption();
+    parser.addPositionalArgument("command", "scan, connect, send or provision");
+    parser.addPositionalArgument("config", "JSON config file, - for stdin", "[config]");
+
+    const QCommandLineOption addressOption({ "a", "address" }, "Target clock address.", "address");
+    const QCommandLineOption binaryOption({ "b", "binary" }, "Use the binary TLV encoding.");
+    const QCommandLineOption noResponseOption("no-response", "Pipeline fragments without response.");
+    const QCommandLineOption concurrencyOption({ "j", "concurrency" },
+                                               "Parallel links for provision.", "n", "3");
+    const QCommandLineOption timeoutOption({ "t", "timeout" }, "Overall timeout in ms.", "ms", "30000");
+    const QCommandLineOption simulateOption("simulate", "Run against simulated clocks.", "params");
+    parser.addOptions({ addressOption, binaryOption, noResponseOption, concurrencyOption, timeoutOption,
+                        simulateOption });
+    parser.process(app);
+
+    const QStringList args = parser.positionalArguments();
+    if (args.isEmpty())
+        parser.showHelp(1);
+
+    static const QHash<QString, CliRunner::Command> commands = {
+        { "scan", CliRunner::Command::Scan },
+        { "connect", CliRunner::Command::Connect },
+        { "send", CliRunner::Command::Send },
+        { "provision", CliRunner::Command::Provision },
+    };
+
+    CliRunner::Options opts;
+    if (!commands.contains(args.first())) {
+        QTextStream(stderr) << "Unknown command: " << args.first() << Qt::endl;
+        return 1;
+    }
+    opts.command = commands.value(args.first());
+    opts.address = parser.value(addressOption);
+    opts.binary = parser.isSet(binaryOption);
+    opts.noResponse = parser.isSet(noResponseOption);
+    opts.concurrency = parser.value(concurrencyOption).toInt();
+    opts.timeoutMs = parser.value(timeoutOption).toInt();
+
+    if (parser.isSet(simulateOption)) {
+        bool ok;
+        opts.simulate = true;
+        opts.sim = SimParams::fromString(parser.value(simulateOption), &ok);
+        if (!ok) {
+            QTextStream(stderr) << "Bad --simulate parameters: " << parser.value(simulateOption) << Qt::endl;
+            return 1;
+        }
+    }
+
+    if (opts.command == CliRunner::Command::Send || opts.command == CliRunner::Command::Provision) {
+        if (args.size() < 2 || !readConfig(args.at(1), &opts.config)) {
+            QTextStream(stderr) << "A readable JSON config object is required" << Qt::endl;
+            return 1;
+        }
+    }
+
+    CliRunner runner(opts);
+    QObject::connect(&runner, &CliRunner::done, &app, &QCoreApplication::exit, Qt::QueuedConnection);
+    runner.start();
+
+    return app.exec();
+}
@@ -8,32 +8,145 @@
 #include <Preferences.h>
 #include <ArduinoJson.h>
 #include "time.h"
+#include "esp_timer.h"
+#include "esp_sntp.h"
+#include "nvs.h"
+#include "src/mustang_cfg.h"
+#include "src/mustang_store.h"
+#include "src/mustang_alarm.h"
+#include "src/mustang_fx.h"
 
 /* ================= TM1637 ================= */
 #define CLK 13
 #define DIO 12
-TM1637Display display(CLK, DIO);
+TM1637Display display(CLK, DIO);   // owned by displayTask only
+
+/* ================= Display commands ================= */
+#define DISPLAY_F_DIGITS      0x01
+#define DISPLAY_F_BRIGHTNESS  0x02
+#define DISPLAY_F_FX          0x04   // start or stop an effect, see protocol/mustang_fx.h
+#define DISPLAY_F_COLON       0x08
+#define DISPLAY_F_STEP        0x10   // effect timer tick
+
+#define FX_LED_PIN    -1   // effect outputs (MFX_OUT_*), active high, -1 for none
+#define FX_BUZZER_PIN -1
+
+struct DisplayCmd {
+  uint8_t fields;         // DISPLAY_F_* mask
+  uint8_t digits[4];      // encoded segments, colon kept separately
+  bool colon;
+  uint8_t brightness;     // 0..7, bit 3 = on
+  const uint8_t *fx;      // effect program, nullptr stops; copied when picked up
+  uint8_t fxLen;
+};
+
+QueueHandle_t displayQueue;
+esp_timer_handle_t fxTimer;   // MFX_TICK_MS while an effect plays, posts DISPLAY_F_STEP
+
+/* ================= Main loop events ================= */
+// loop() sleeps until one of these is notified
+#define LOOP_EV_SECOND  0x01   // second boundary of the displayed time
+#define LOOP_EV_REFRESH 0x02   // time source changed, redraw and realign
+#define LOOP_EV_ALARM   0x04   // planned alarm instant reached
+#define LOOP_EV_ALARMS  0x08   // new alarm table in the store
+#define LOOP_EV_BUTTON  0x10   // wake button, snoozes a ringing alarm
+
+TaskHandle_t loopTaskHandle;
+esp_timer_handle_t secondTimer;
+
+/* ================= Alarms ================= */
+// Owned by loop(): one one-shot timer for the next ring, see protocol/mustang_alarm.h
+#define ALARM_SNOOZE_WINDOW_MS 60000   // button this long after a ring snoozes it
+
+malarm_sched_t alarms;
+esp_timer_handle_t alarmTimer;
+bool alarmsLoaded = false;
+unsigned long alarmRangAt;
+
+/* ================= Time -> segments ================= */
+// Pre-encoded digit pairs, built at compile time: low byte tens, high byte units
+constexpr uint8_t kDigitSegments[10] = {
+  0x3f, 0x06, 0x5b, 0x4f, 0x66, 0x6d, 0x7d, 0x07, 0x7f, 0x6f
+};
+
+struct SegmentPairs {
+  uint16_t pair[60];
+};
+
+constexpr SegmentPairs makeSegmentPairs() {
+  SegmentPairs p {};
+  for (int n = 0; n < 60; n++) {
+    p.pair[n] = kDigitSegments[n / 10] | (kDigitSegments[n % 10] << 8);
+  }
+  return p;
+}
+
+constexpr SegmentPairs kPairs = makeSegmentPairs();
+static_assert(kPairs.pair[59] == (0x6d | (0x6f << 8)), "segment pair table");
+
+// Branch- and division-free HH:MM encoder, colon merged by mask
+inline void encodeTime(uint8_t hh, uint8_t mm, bool colon, uint8_t *digits) {
+  uint16_t h = kPairs.pair[hh];
+  uint16_t m = kPairs.pair[mm];
+  digits[0] = h & 0xff;
+  digits[1] = (h >> 8) | (-(uint8_t)colon & 0x80);
+  digits[2] = m & 0xff;
+  digits[3] = m >> 8;
+}
 
 /* ================= BLE UUIDs ================= */
 #define SERVICE_UUID  "12345678-9abc-def0-f0de-bc9a78563412"
 #define CHAR_CFG_UUID "9abcdef0-1234-5678-7856-3412f0debc9a"
+#define CHAR_WIFI_UUID "9abcdef1-1234-5678-7856-3412f0debc9a"
+#define CFG_MAX_LEN   2048   // largest reassembled config message
+#define BLE_MTU       517
+
+/* ================= Advertising schedule ================= */
+// Fast after boot, disconnect or wake button, then slow (or off once provisioned)
+#define ADV_FAST_ITVL_MS          20
+#define ADV_FAST_WINDOW_MS        30000
+#define ADV_SLOW_ITVL_MS          1000
+#define ADV_STOP_WHEN_PROVISIONED 0
+#define ADV_WAKE_PIN              0      // BOOT button, active low, -1 for none
+#define ADV_EVENT_US              2000   // radio time of one event, three channels
+
+enum AdvPhase : uint8_t { ADV_OFF, ADV_FAST, ADV_SLOW, ADV_CONNECTED, ADV_PHASE_COUNT };
+
+/* ================= Wi-Fi ================= */
+#define WIFI_CONNECT_TIMEOUT_MS 10000
+#define WIFI_BACKOFF_MIN_MS     1000
+#define WIFI_BACKOFF_MAX_MS     60000
+#define WIFI_POLL_MS            250
+
+struct WifiCreds {
+  char ssid[MCFG_SSID_MAX + 1];
+  char psk[MCFG_PSK_MAX + 1];
+};
+
+QueueHandle_t wifiQueue;            // length 1, newest credentials win
+BLECharacteristic *wifiStatusChr;   // notify, see MCFG_WIFI_*
+
+/* ================= Config store ================= */
+// One blob in RAM, written by the BLE callbacks and flushed from loop()
+mstore_t store;
+portMUX_TYPE storeMux = portMUX_INITIALIZER_UNLOCKED;
+volatile bool storeCommit = false;
+bool storeAlarmsPending = false;   // table changed since loop() copied it, under storeMux
 
 /* ================= Globals ================= */
-Preferences prefs;
+Preferences prefs;   // legacy per-key layout, read once for migration
 
 String wifi_ssid;
 String wifi_psk;
 
-int alarm_h = 6;
-int alarm_m = 30;
-bool alarm_enabled = false;
-
 bool manual_time_valid = false;
 time_t manual_time_base;
-unsigned long manual_time_ms;
+int64_t manual_time_us;   // esp_timer (64-bit, no wraparound) at manual_time_base
 
 /* ================= Forward decl ================= */
-void connectWiFi();
+void postWifiCreds();
+void startAdvertising(AdvPhase phase);
+void notifyLoop(uint32_t events);
 
 /* ================= BLE Security ================= */
 class MySecurityCallbacks : public BLESecurityCallbacks {
@@ -54,69 +167,374 @@ class MySecurityCallbacks : public BLESecurityCallbacks {
   }
 };
 
-/* ================= BLE JSON handler ================= */
-class JsonConfigCallback : public BLECharacteristicCallbacks {
-  void onWrite(BLECharacteristic *c) override {
-    String val = c->getValue();
-    Serial.println(val.length());
-    if (!val.length()) return;
-
-    StaticJsonDocument<512> doc;
-    if (deserializeJson(doc, val)) {
-      Serial.println("JSON parse error");
-      return;
-    }
-    Serial.println(val);
+/* ================= Config apply ================= */
+void setManualTime(int hh, int mm) {
+  struct tm t {};
+  t.tm_year = 124; // 2024
+  t.tm_mon  = 0;
+  t.tm_mday = 1;
+  t.tm_hour = hh;
+  t.tm_min  = mm;
+  t.tm_sec  = 0;
+
+  manual_time_base = mktime(&t);
+  manual_time_us = esp_timer_get_time();
+  manual_time_valid = true;
+  notifyLoop(LOOP_EV_REFRESH);
+}
 
-    /* ---- WiFi ---- */
-    if (doc["wifi"]) {
-      if (doc["wifi"]["ssid"]) {
-        wifi_ssid = doc["wifi"]["ssid"].as<String>();
-        prefs.putString("ssid", wifi_ssid);
-      }
-      if (doc["wifi"]["psk"]) {
-        wifi_psk = doc["wifi"]["psk"].as<String>();
-        prefs.putString("psk", wifi_psk);
-      }
-      connectWiFi();
+// One config message, whatever its encoding, applied as a unit
+struct ConfigChange {
+  uint8_t present = 0;   // MCFG_HAS_* mask
+  String ssid;
+  String psk;
+  int time_h = -1;
+  int time_m = -1;
+  uint8_t alarm_count = 0;   // MCFG_TAG_ALARMS entries, with MCFG_HAS_ALARMS
+  uint8_t alarms[MCFG_ALARMS_MAX * MCFG_ALARM_ENTRY_LEN];
+  uint8_t fx_len = 0;        // MCFG_TAG_FX program, with MCFG_HAS_FX; 0 = default
+  uint8_t fx[MCFG_FX_MAX];
+};
+
+// A single legacy alarm (MCFG_TAG_ALARM, JSON "alarm") is a one-entry daily table
+void setSingleAlarm(ConfigChange &c, uint8_t hh, uint8_t mm, uint8_t flags) {
+  mcfg_alarm_entry(c.alarms, hh, mm, MCFG_ALARM_DAYS_ALL, flags, 0);
+  c.alarm_count = 1;
+  c.present |= MCFG_HAS_ALARMS;
+}
+
+// RAM only; unchanged values leave the store clean, flushConfig() writes it
+void storeConfig(const ConfigChange &c) {
+  uint32_t now = millis();
+  portENTER_CRITICAL(&storeMux);
+  if (c.present & MCFG_HAS_SSID) mstore_set_ssid(&store, c.ssid.c_str(), c.ssid.length(), now);
+  if (c.present & MCFG_HAS_PSK)  mstore_set_psk(&store, c.psk.c_str(), c.psk.length(), now);
+  if (c.present & MCFG_HAS_ALARMS) {
+    mstore_set_alarms(&store, c.alarms, c.alarm_count, now);
+    storeAlarmsPending = true;
+  }
+  if (c.present & MCFG_HAS_FX) mstore_set_fx(&store, c.fx, c.fx_len, now);
+  portEXIT_CRITICAL(&storeMux);
+  if (c.present & MCFG_HAS_COMMIT) storeCommit = true;
+}
+
+// Whole config in one blob and one NVS commit, after a quiet period or a commit
+void flushConfig() {
+  mstore_blob_t blob;
+  portENTER_CRITICAL(&storeMux);
+  bool due = mstore_due(&store, millis(), storeCommit);
+  if (due) blob = *mstore_seal(&store);
+  storeCommit = false;
+  portEXIT_CRITICAL(&storeMux);
+  if (!due) return;
+
+  unsigned long t0 = micros();
+  nvs_handle_t h;
+  esp_err_t err = nvs_open("cfg", NVS_READWRITE, &h);
+  if (err == ESP_OK) {
+    err = nvs_set_blob(h, MSTORE_KEY, &blob, sizeof(blob));
+    if (err == ESP_OK) err = nvs_commit(h);
+    nvs_close(h);
+  }
+  if (err != ESP_OK) {
+    // Retry after another debounce window
+    portENTER_CRITICAL(&storeMux);
+    mstore_touch(&store, millis());
+    portEXIT_CRITICAL(&storeMux);
+  }
+  Serial.printf("Config blob stored in %lu us%s\n", micros() - t0,
+                err == ESP_OK ? "" : " (NVS error)");
+}
+
+// Single blob read; older firmware kept one key per field, migrate those
+void loadConfig() {
+  mstore_blob_t blob;
+  size_t len = sizeof(blob);
+  nvs_handle_t h;
+  bool loaded = false;
+
+  if (nvs_open("cfg", NVS_READONLY, &h) == ESP_OK) {
+    loaded = nvs_get_blob(h, MSTORE_KEY, &blob, &len) == ESP_OK &&
+             mstore_load(&store, &blob, len);
+    nvs_close(h);
+  }
+
+  if (!loaded) {
+    mstore_init(&store);
+    prefs.begin("cfg", true);
+    uint32_t now = millis();
+    if (prefs.isKey("ssid")) {
+      String v = prefs.getString("ssid", "");
+      mstore_set_ssid(&store, v.c_str(), v.length(), now);
+    }
+    if (prefs.isKey("psk")) {
+      String v = prefs.getString("psk", "");
+      mstore_set_psk(&store, v.c_str(), v.length(), now);
     }
+    if (prefs.isKey("alarm_h")) {
+      mstore_set_alarm(&store, prefs.getInt("alarm_h", 6), prefs.getInt("alarm_m", 30),
+                       prefs.getBool("alarm_en", false) ? MCFG_ALARM_F_ENABLED : 0, now);
+    }
+    prefs.end();
+  }
 
-    /* ---- Time ---- */
-    if (doc["time"]) {
-      int hh = doc["time"]["hh"] | -1;
-      int mm = doc["time"]["mm"] | -1;
-      if (hh >= 0 && mm >= 0) {
-        struct tm t {};
-        t.tm_year = 124; // 2024
-        t.tm_mon  = 0;
-        t.tm_mday = 1;
-        t.tm_hour = hh;
-        t.tm_min  = mm;
-        t.tm_sec  = 0;
-
-        manual_time_base = mktime(&t);
-        manual_time_ms = millis();
-        manual_time_valid = true;
-      }
+  if (store.blob.present & MCFG_HAS_SSID) wifi_ssid = store.blob.ssid;
+  if (store.blob.present & MCFG_HAS_PSK)  wifi_psk = store.blob.psk;
+  // The table itself is copied by loop() once the time is known
+  storeAlarmsPending = true;
+  Serial.printf("Config loaded (%s), present 0x%02x\n",
+                loaded ? "blob" : "legacy keys", store.blob.present);
+}
+
+void applyConfig(const ConfigChange &c) {
+  storeConfig(c);
+
+  if (c.present & MCFG_HAS_SSID) wifi_ssid = c.ssid;
+  if (c.present & MCFG_HAS_PSK)  wifi_psk = c.psk;
+
+  if (c.present & MCFG_HAS_ALARMS) notifyLoop(LOOP_EV_ALARMS);
+
+  if (c.present & MCFG_HAS_TIME) {
+    setManualTime(c.time_h, c.time_m);
+  }
+
+  // Once per message, even when a batch changes both SSID and PSK;
+  // the Wi-Fi task connects, the BLE write returns right away
+  if (c.present & (MCFG_HAS_SSID | MCFG_HAS_PSK)) {
+    postWifiCreds();
+  }
+}
+
+/* ================= BLE binary handler ================= */
+// Decoded in place from the characteristic buffer, see protocol/mustang_cfg.h
+void onBinaryConfig(const uint8_t *data, size_t len) {
+  mcfg_config_t cfg;
+  unsigned long t0 = micros();
+  int rc = mcfg_decode(data, len, &cfg);
+  Serial.printf("BIN RX %u bytes, decode %lu us, rc=%d\n", len, micros() - t0, rc);
+  if (rc != MCFG_OK) return;
+
+  ConfigChange change;
+  change.present = cfg.present;
+  if (cfg.present & MCFG_HAS_SSID) change.ssid = String(cfg.ssid, cfg.ssid_len);
+  if (cfg.present & MCFG_HAS_PSK)  change.psk = String(cfg.psk, cfg.psk_len);
+  if (cfg.present & MCFG_HAS_TIME) {
+    change.time_h = cfg.time_hh;
+    change.time_m = cfg.time_mm;
+  }
+  change.present &= ~MCFG_HAS_ALARM;
+  if (cfg.present & MCFG_HAS_ALARM) {
+    setSingleAlarm(change, cfg.alarm_hh, cfg.alarm_mm, cfg.alarm_flags);
+  }
+  // The full table wins over a single alarm in the same message
+  if (cfg.present & MCFG_HAS_ALARMS) {
+    change.alarm_count = cfg.alarm_count;
+    memcpy(change.alarms, cfg.alarms, cfg.alarm_count * MCFG_ALARM_ENTRY_LEN);
+  }
+  // Checked once here, the display task can trust what the store hands out
+  if ((cfg.present & MCFG_HAS_FX) && cfg.fx_len &&
+      mfx_check(cfg.fx, cfg.fx_len) != MFX_OK) {
+    Serial.printf("Alarm effect rejected, %u bytes\n", cfg.fx_len);
+    change.present &= ~MCFG_HAS_FX;
+  } else if (cfg.present & MCFG_HAS_FX) {
+    change.fx_len = cfg.fx_len;
+    memcpy(change.fx, cfg.fx, cfg.fx_len);
+  }
+  applyConfig(change);
+
+  Serial.println("BLE binary config updated");
+}
+
+/* ================= BLE JSON handler ================= */
+void onJsonConfig(const uint8_t *data, size_t len) {
+  if (!len) return;
+
+  // Room for a full reassembled message plus the copied strings;
+  // static because BLE callbacks never overlap and the stack is small
+  static StaticJsonDocument<CFG_MAX_LEN * 2> doc;
+  unsigned long t0 = micros();
+  if (deserializeJson(doc, (const char *)data, len)) {
+    Serial.println("JSON parse error");
+    return;
+  }
+  Serial.printf("JSON RX %u bytes, decode %lu us\n", len, micros() - t0);
+
+  ConfigChange change;
+
+  /* ---- WiFi ---- */
+  if (doc["wifi"]) {
+    if (doc["wifi"]["ssid"]) {
+      change.ssid = doc["wifi"]["ssid"].as<String>();
+      change.present |= MCFG_HAS_SSID;
+    }
+    if (doc["wifi"]["psk"]) {
+      change.psk = doc["wifi"]["psk"].as<String>();
+      change.present |= MCFG_HAS_PSK;
     }
+  }
 
-    /* ---- Alarm ---- */
-    if (doc["alarm"]) {
-      if (doc["alarm"]["hh"]) {
-        alarm_h = doc["alarm"]["hh"];
-        prefs.putInt("alarm_h", alarm_h);
-      }
-      if (doc["alarm"]["mm"]) {
-        alarm_m = doc["alarm"]["mm"];
-        prefs.putInt("alarm_m", alarm_m);
-      }
-      if (doc["alarm"]["enabled"]) {
-        alarm_enabled = doc["alarm"]["enabled"];
-        prefs.putBool("alarm_en", alarm_enabled);
-      }
+  /* ---- Time ---- */
+  if (doc["time"]) {
+    change.time_h = doc["time"]["hh"] | -1;
+    change.time_m = doc["time"]["mm"] | -1;
+    if (change.time_h >= 0 && change.time_m >= 0) {
+      change.present |= MCFG_HAS_TIME;
     }
+  }
+
+  /* ---- Alarm ---- */
+  // Single alarm; missing fields keep the value of the first table entry.
+  // Tables with several alarms only come in binary (MCFG_TAG_ALARMS).
+  if (doc["alarm"]) {
+    uint8_t cur[MCFG_ALARM_ENTRY_LEN] = {6, 30, MCFG_ALARM_DAYS_ALL, 0, 0};
+    portENTER_CRITICAL(&storeMux);
+    if (store.blob.alarm_count) memcpy(cur, store.blob.alarms, sizeof(cur));
+    portEXIT_CRITICAL(&storeMux);
+    bool enabled = doc["alarm"]["enabled"] | (bool)(cur[3] & MCFG_ALARM_F_ENABLED);
+    setSingleAlarm(change, doc["alarm"]["hh"] | cur[0], doc["alarm"]["mm"] | cur[1],
+                   enabled ? MCFG_ALARM_F_ENABLED : 0);
+  }
+
+  /* ---- End of session, persist now ---- */
+  if (doc["commit"] | false) {
+    change.present |= MCFG_HAS_COMMIT;
+  }
 
-    Serial.println("BLE JSON config updated");
+  applyConfig(change);
+
+  Serial.println("BLE JSON config updated");
+}
+
+/* ================= BLE config characteristic ================= */
+// Messages larger than one ATT write arrive as fragments, see protocol/mustang_cfg.h
+uint8_t cfgBuf[CFG_MAX_LEN];
+mcfg_reasm_t cfgReasm;
+unsigned long cfgReasmStart;
+
+void onConfig(const uint8_t *data, size_t len) {
+  if (mcfg_is_binary(data, len)) {
+    onBinaryConfig(data, len);
+  } else {
+    onJsonConfig(data, len);
+  }
+}
+
+void onConfigFragment(const uint8_t *data, size_t len) {
+  if (data[1] == 0) {
+    cfgReasmStart = micros();
+  }
+
+  int rc = mcfg_reasm_push(&cfgReasm, data, len, millis());
+  if (rc == MCFG_FRAG_MORE) return;
+  if (rc != MCFG_OK) {
+    Serial.printf("Config fragment %u dropped, rc=%d\n", data[1], rc);
+    return;
+  }
+
+  unsigned long us = micros() - cfgReasmStart;
+  Serial.printf("Reassembled %u bytes in %u fragments, %lu us, %lu B/s\n",
+                cfgReasm.len, cfgReasm.next_seq, us,
+                us ? (unsigned long)((uint64_t)cfgReasm.len * 1000000 / us) : 0);
+  onConfig(cfgReasm.buf, cfgReasm.len);
+}
+
+/* ================= Advertising scheduler ================= */
+// Phase changes are requested from BLE/ISR context and applied in loop()
+const char *const kAdvPhaseNames[ADV_PHASE_COUNT] = {"off", "fast", "slow", "connected"};
+AdvPhase advPhase = ADV_OFF;
+unsigned long advPhaseSince;
+uint64_t advPhaseMs[ADV_PHASE_COUNT];
+volatile bool advConnected = false;
+volatile bool advWakeRequested = false;
+
+class AdvServerCallbacks : public BLEServerCallbacks {
+  void onConnect(BLEServer *) override {
+    advConnected = true;
+  }
+
+  void onDisconnect(BLEServer *) override {
+    advConnected = false;
+    advWakeRequested = true;   // fast, so the app can reconnect quickly
+  }
+};
+
+void IRAM_ATTR onAdvWake() {
+  BaseType_t woken = pdFALSE;
+  advWakeRequested = true;
+  if (loopTaskHandle) xTaskNotifyFromISR(loopTaskHandle, LOOP_EV_BUTTON, eSetBits, &woken);
+  portYIELD_FROM_ISR(woken);
+}
+
+// Average duty cycle since boot: events per phase times radio time per event
+void logAdvDuty() {
+  unsigned long total = millis();
+  uint64_t events = advPhaseMs[ADV_FAST] / (ADV_FAST_ITVL_MS + 10) +
+                    advPhaseMs[ADV_SLOW] / (ADV_SLOW_ITVL_MS + 10);
+  uint32_t ppm = total ? events * ADV_EVENT_US * 1000 / total : 0;
+  Serial.printf("Adv now %s; fast %lu s, slow %lu s, off %lu s, connected %lu s; "
+                "~%lu events, duty %lu.%04lu%%\n",
+                kAdvPhaseNames[advPhase],
+                (unsigned long)(advPhaseMs[ADV_FAST] / 1000),
+                (unsigned long)(advPhaseMs[ADV_SLOW] / 1000),
+                (unsigned long)(advPhaseMs[ADV_OFF] / 1000),
+                (unsigned long)(advPhaseMs[ADV_CONNECTED] / 1000),
+                (unsigned long)events, ppm / 10000, ppm % 10000);
+}
+
+void setAdvPhase(AdvPhase phase) {
+  unsigned long now = millis();
+  advPhaseMs[advPhase] += now - advPhaseSince;
+  advPhaseSince = now;
+  if (phase != advPhase) {
+    advPhase = phase;
+    logAdvDuty();
+  }
+}
+
+void startAdvertising(AdvPhase phase) {
+  uint32_t itvl = phase == ADV_FAST ? ADV_FAST_ITVL_MS : ADV_SLOW_ITVL_MS;
+  BLEAdvertising *adv = BLEDevice::getAdvertising();
+  adv->stop();
+  adv->setMinInterval(itvl * 1000 / 625);          // 0.625 ms units
+  adv->setMaxInterval((itvl + 10) * 1000 / 625);
+  adv->start();
+  Serial.printf("Advertising %s, %lu ms interval\n", kAdvPhaseNames[phase], itvl);
+  setAdvPhase(phase);
+}
+
+void scheduleAdvertising() {
+  if (advConnected) {
+    // Legacy advertising ends with the connection
+    if (advPhase != ADV_CONNECTED) setAdvPhase(ADV_CONNECTED);
+    return;
+  }
+
+  if (advWakeRequested) {
+    advWakeRequested = false;
+    startAdvertising(ADV_FAST);
+    return;
+  }
+
+  if (advPhase != ADV_FAST || millis() - advPhaseSince < ADV_FAST_WINDOW_MS) return;
+
+#if ADV_STOP_WHEN_PROVISIONED
+  if (!wifi_ssid.isEmpty()) {
+    BLEDevice::getAdvertising()->stop();
+    Serial.println("Provisioned, advertising stopped until woken");
+    setAdvPhase(ADV_OFF);
+    return;
+  }
+#endif
+  startAdvertising(ADV_SLOW);
+}
+
+class JsonConfigCallback : public BLECharacteristicCallbacks {
+  void onWrite(BLECharacteristic *c) override {
+    if (mcfg_is_fragment(c->getData(), c->getLength())) {
+      onConfigFragment(c->getData(), c->getLength());
+    } else {
+      onConfig(c->getData(), c->getLength());
+    }
   }
 };
 
@@ -124,6 +542,8 @@ class JsonConfigCallback : public BLECharacteristicCallbacks {
 void setupBLE() {
   BLEDevice::deinit(true); // force clear bonds
   BLEDevice::init("MUSTANG-CLOCK");
+  BLEDevice::setMTU(BLE_MTU);   // fewer fragments when the central agrees
+  mcfg_reasm_init(&cfgReasm, cfgBuf, sizeof(cfgBuf));
 
   // 🔐 Register security callbacks GLOBALLY (new API)
   BLEDevice::setSecurityCallbacks(new MySecurityCallbacks());
@@ -136,129 +556,444 @@ void setupBLE() {
   );
 
   BLEServer *server = BLEDevice::createServer();
+  server->setCallbacks(new AdvServerCallbacks());
   BLEService *service = server->createService(SERVICE_UUID);
 
   BLECharacteristic *cfg =
     service->createCharacteristic(
       CHAR_CFG_UUID,
-      BLECharacteristic::PROPERTY_WRITE
+      BLECharacteristic::PROPERTY_WRITE |
+      BLECharacteristic::PROPERTY_WRITE_NR   // app pipelines fragments without response
     );
 
   cfg->setCallbacks(new JsonConfigCallback());
   //cfg->addDescriptor(new BLE2902());
 
+  wifiStatusChr =
+    service->createCharacteristic(
+      CHAR_WIFI_UUID,
+      BLECharacteristic::PROPERTY_READ |
+      BLECharacteristic::PROPERTY_NOTIFY
+    );
+  wifiStatusChr->addDescriptor(new BLE2902());
+  uint8_t idle[MCFG_WIFI_STATUS_LEN] = {MCFG_WIFI_IDLE, 0};
+  wifiStatusChr->setValue(idle, sizeof(idle));
+
   service->start();
 
   BLEAdvertising *adv = BLEDevice::getAdvertising();
   adv->addServiceUUID(SERVICE_UUID);
-  adv->start();
+  startAdvertising(ADV_FAST);
+
+#if ADV_WAKE_PIN >= 0
+  pinMode(ADV_WAKE_PIN, INPUT_PULLUP);
+  attachInterrupt(digitalPinToInterrupt(ADV_WAKE_PIN), onAdvWake, FALLING);
+#endif
 
   Serial.println("BLE ready (secure, passkey)");
 }
 
 /* ================= WiFi + NTP ================= */
-void connectWiFi() {
-  if (wifi_ssid.isEmpty()) return;
+void postWifiCreds() {
+  WifiCreds creds = {};
+  strlcpy(creds.ssid, wifi_ssid.c_str(), sizeof(creds.ssid));
+  strlcpy(creds.psk, wifi_psk.c_str(), sizeof(creds.psk));
+  xQueueOverwrite(wifiQueue, &creds);
+}
+
+void notifyWifiStatus(uint8_t state, uint8_t attempt) {
+  Serial.printf("WiFi state %u, attempt %u\n", state, attempt);
+  if (!wifiStatusChr) return;
+  uint8_t status[MCFG_WIFI_STATUS_LEN] = {state, attempt};
+  wifiStatusChr->setValue(status, sizeof(status));
+  wifiStatusChr->notify();
+}
+
+// Owns the Wi-Fi radio: connects without blocking anyone else, retries with
+// exponential backoff, and restarts from scratch on new credentials
+void wifiTask(void *) {
+  WifiCreds creds = {};
+  uint8_t state = MCFG_WIFI_IDLE;
+  uint8_t attempt = 0;
+  uint32_t backoff = WIFI_BACKOFF_MIN_MS;
+  TickType_t deadline = 0;
+
+  for (;;) {
+    if (xQueueReceive(wifiQueue, &creds, pdMS_TO_TICKS(WIFI_POLL_MS)) == pdTRUE) {
+      WiFi.disconnect();
+      attempt = 0;
+      backoff = WIFI_BACKOFF_MIN_MS;
+      state = creds.ssid[0] ? MCFG_WIFI_BACKOFF : MCFG_WIFI_IDLE;
+      deadline = xTaskGetTickCount();
+      if (state == MCFG_WIFI_IDLE) notifyWifiStatus(state, attempt);
+    }
 
-  WiFi.begin(wifi_ssid.c_str(), wifi_psk.c_str());
-  if (WiFi.waitForConnectResult() == WL_CONNECTED) {
-    configTime(3600, 3600, "pool.ntp.org");
-    Serial.println("WiFi + NTP OK");
+    TickType_t now = xTaskGetTickCount();
+    bool expired = (int32_t)(now - deadline) >= 0;
+
+    switch (state) {
+    case MCFG_WIFI_BACKOFF:
+      if (!expired) break;
+      WiFi.begin(creds.ssid, creds.psk);
+      state = MCFG_WIFI_CONNECTING;
+      attempt = attempt < 255 ? attempt + 1 : attempt;
+      deadline = now + pdMS_TO_TICKS(WIFI_CONNECT_TIMEOUT_MS);
+      notifyWifiStatus(state, attempt);
+      break;
+
+    case MCFG_WIFI_CONNECTING:
+      if (WiFi.status() == WL_CONNECTED) {
+        configTime(3600, 3600, "pool.ntp.org");
+        Serial.println("WiFi + NTP OK");
+        state = MCFG_WIFI_CONNECTED;
+        backoff = WIFI_BACKOFF_MIN_MS;
+        notifyWifiStatus(state, attempt);
+      } else if (expired) {
+        WiFi.disconnect();
+        state = MCFG_WIFI_BACKOFF;
+        deadline = now + pdMS_TO_TICKS(backoff);
+        backoff = min<uint32_t>(backoff * 2, WIFI_BACKOFF_MAX_MS);
+        notifyWifiStatus(state, attempt);
+      }
+      break;
+
+    case MCFG_WIFI_CONNECTED:
+      // Link lost, reconnect on the backoff schedule
+      if (WiFi.status() != WL_CONNECTED) {
+        state = MCFG_WIFI_BACKOFF;
+        attempt = 0;
+        deadline = now;
+        notifyWifiStatus(state, attempt);
+      }
+      break;
+    }
   }
 }
 
 /* ================= Time source ================= */
-bool getTimeNow(struct tm &t) {
-  if (WiFi.isConnected() && getLocalTime(&t)) return true;
+// Never waits for an SNTP sync, the loop must not block
+bool getEpochNow(time_t &now) {
+  struct tm t;
+  if (WiFi.isConnected() && getLocalTime(&t, 0)) {
+    now = time(nullptr);
+    return true;
+  }
 
   if (manual_time_valid) {
-    time_t now = manual_time_base +
-                 (millis() - manual_time_ms) / 1000;
-    localtime_r(&now, &t);
+    now = manual_time_base + (esp_timer_get_time() - manual_time_us) / 1000000;
     return true;
   }
   return false;
 }
 
-/* ================= Alarm ================= */
-void checkAlarm(struct tm &t) {
-  static bool fired = false;
-  static unsigned long lastBlink = 0;
-  static int blinkCount = 0;
-  static int repeatCount = 0;
-  static bool blinking = false;
-
-  // Trigger alarm
-  if (alarm_enabled &&
-      t.tm_hour == alarm_h &&
-      t.tm_min == alarm_m &&
-      !fired) {
-    Serial.println("ALARM!");
-    fired = true;
-    blinking = true;
-    lastBlink = millis();
-    blinkCount = 0;
-    repeatCount = 0;
-  }
-
-  // Blink routine
-  if (blinking) {
-    unsigned long now = millis();
-    if (now - lastBlink >= 150) { // ~quick blink every 150ms
-      lastBlink = now;
-
-      // Toggle display on/off
-      if (blinkCount % 2 == 0) {
-        display.clear();
-      } else {
-        int v = t.tm_hour * 100 + t.tm_min;
-        display.showNumberDecEx(v, 0x40, true); // colon on
-      }
+bool getTimeNow(struct tm &t) {
+  time_t now;
+  if (!getEpochNow(now)) return false;
+  localtime_r(&now, &t);
+  return true;
+}
 
-      blinkCount++;
+// Until the displayed time reaches its next full second
+int64_t usToNextSecond() {
+  struct tm t;
+  if (WiFi.isConnected() && getLocalTime(&t, 0)) {
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    return 1000000 - tv.tv_usec;
+  }
+  if (manual_time_valid) {
+    return 1000000 - (esp_timer_get_time() - manual_time_us) % 1000000;
+  }
+  return 1000000;
+}
+
+void notifyLoop(uint32_t events) {
+  if (loopTaskHandle) xTaskNotify(loopTaskHandle, events, eSetBits);
+}
+
+// One-shot and rearmed every tick, so it follows NTP slews and manual sets
+void onSecondTimer(void *) {
+  notifyLoop(LOOP_EV_SECOND);
+}
 
-      // Three quick blinks per repetition -> 6 toggles
-      if (blinkCount >= 6) {
-        blinkCount = 0;
-        repeatCount++;
-        if (repeatCount >= 8) { // 8 repetitions
-          blinking = false;
+void armSecondTimer() {
+  esp_timer_stop(secondTimer);
+  esp_timer_start_once(secondTimer, usToNextSecond());
+}
+
+void onTimeSync(struct timeval *) {
+  notifyLoop(LOOP_EV_REFRESH);
+}
+
+/* ================= Display task ================= */
+void onFxStep(void *) {
+  DisplayCmd cmd = {};
+  cmd.fields = DISPLAY_F_STEP;
+  xQueueSend(displayQueue, &cmd, 0);
+}
+
+void writeFxOutputs(uint8_t out) {
+#if FX_LED_PIN >= 0
+  digitalWrite(FX_LED_PIN, (out & MFX_OUT_LED) ? HIGH : LOW);
+#endif
+#if FX_BUZZER_PIN >= 0
+  digitalWrite(FX_BUZZER_PIN, (out & MFX_OUT_BUZZER) ? HIGH : LOW);
+#endif
+}
+
+// Only this task touches the TM1637; bursts are coalesced into one frame.
+// Effect ticks come from fxTimer, so the task only wakes for real changes.
+// Ticks are counted from the effect start, not per step, so a late or
+// dropped step is caught up instead of stretching the effect.
+void displayTask(void *) {
+  DisplayCmd state = {};
+  DisplayCmd cmd;
+  mfx_player_t fx;
+  int64_t fxStart = 0;
+  uint32_t fxTicks = 0;
+  int64_t fxMaxLate = 0;
+
+  state.brightness = 0x0f;
+  mfx_init(&fx, state.brightness);
+
+  for (;;) {
+    uint8_t out = fx.out;
+
+    xQueueReceive(displayQueue, &cmd, portMAX_DELAY);
+    do {
+      if (cmd.fields & DISPLAY_F_DIGITS) memcpy(state.digits, cmd.digits, 4);
+      if (cmd.fields & DISPLAY_F_COLON) state.colon = cmd.colon;
+      if (cmd.fields & DISPLAY_F_BRIGHTNESS) {
+        state.brightness = cmd.brightness;
+        fx.base_level = cmd.brightness;   // what a running effect ends on
+      }
+      if (cmd.fields & DISPLAY_F_FX) {
+        esp_timer_stop(fxTimer);
+        if (!cmd.fx) {
+          mfx_stop(&fx);
+        } else if (mfx_start(&fx, cmd.fx, cmd.fxLen, state.brightness) < 0) {
+          Serial.println("Effect rejected, playing the default");
+          mfx_start(&fx, MFX_ALARM_DEFAULT, sizeof(MFX_ALARM_DEFAULT), state.brightness);
+        }
+        if (fx.running) {
+          fxStart = esp_timer_get_time();
+          fxTicks = 0;
+          fxMaxLate = 0;
+          esp_timer_start_periodic(fxTimer, MFX_TICK_MS * 1000);
         }
       }
+      if ((cmd.fields & DISPLAY_F_STEP) && fx.running) {
+        int64_t late = esp_timer_get_time() - fxStart;
+        uint32_t due = late / (MFX_TICK_MS * 1000);
+        late -= (int64_t)due * MFX_TICK_MS * 1000;
+        if (late > fxMaxLate) fxMaxLate = late;
+        while (fx.running && fxTicks < due) {
+          mfx_tick(&fx);
+          fxTicks++;
+        }
+        if (!fx.running) {
+          esp_timer_stop(fxTimer);
+          Serial.printf("Effect done, %lu ticks, max step latency %lld us\n",
+                        (unsigned long)fxTicks, fxMaxLate);
+        }
+      }
+    } while (xQueueReceive(displayQueue, &cmd, 0) == pdTRUE);
+
+    uint8_t frame[4];
+    memcpy(frame, state.digits, 4);
+    frame[1] |= state.colon ? 0x80 : 0;
+    uint8_t brightness = state.brightness;
+
+    // A running effect draws over the clock
+    if (fx.running) {
+      if (!fx.clock) memcpy(frame, fx.digits, 4);
+      brightness = fx.level;
     }
+    if (fx.out != out) writeFxOutputs(fx.out);
+
+    display.setBrightness(brightness & 0x07, brightness & 0x08);
+    display.setSegments(frame);
   }
+}
 
-  if (t.tm_min != alarm_m) fired = false; // reset for next day
+void postDisplay(const DisplayCmd &cmd) {
+  if (xQueueSend(displayQueue, &cmd, 0) != pdTRUE) {
+    Serial.println("Display queue full");
+  }
+}
+
+/* ================= Alarm ================= */
+void onAlarmTimer(void *) {
+  notifyLoop(LOOP_EV_ALARM);
+}
+
+// Copy a table the BLE side stored; plan only when the table is new, so an
+// NTP resync does not forget what already rang today or a running snooze
+void updateAlarms(uint32_t events, time_t now) {
+  uint8_t entries[MCFG_ALARMS_MAX * MCFG_ALARM_ENTRY_LEN];
+  uint8_t count = 0;
+  bool reload;
+
+  portENTER_CRITICAL(&storeMux);
+  reload = storeAlarmsPending || !alarmsLoaded;
+  if (reload) {
+    count = store.blob.alarm_count;
+    memcpy(entries, store.blob.alarms, sizeof(entries));
+    storeAlarmsPending = false;
+  }
+  portEXIT_CRITICAL(&storeMux);
+
+  if (reload) {
+    unsigned long t0 = micros();
+    malarm_set(&alarms, entries, count, now);
+    alarmsLoaded = true;
+    Serial.printf("Alarm table: %u entries, planned in %lu us\n", count, micros() - t0);
+  } else if (events & LOOP_EV_REFRESH) {
+    malarm_plan(&alarms, now);
+  }
+}
+
+void ringAlarm(time_t now) {
+  int idx = malarm_ring(&alarms, now);
+  if (idx == MALARM_NONE) return;   // timer ran early, rearmed below
+  Serial.printf("ALARM %d!\n", idx);
+  alarmRangAt = millis();
+
+  // The uploaded effect or the default one; the display task copies it
+  // before the next ring can rewrite this buffer
+  static uint8_t fx[MCFG_FX_MAX];
+  DisplayCmd cmd = {};
+  cmd.fields = DISPLAY_F_FX;
+  portENTER_CRITICAL(&storeMux);
+  cmd.fxLen = store.blob.fx_len;
+  memcpy(fx, store.blob.fx, sizeof(fx));
+  portEXIT_CRITICAL(&storeMux);
+  cmd.fx = fx;
+  if (!cmd.fxLen) {
+    cmd.fx = MFX_ALARM_DEFAULT;
+    cmd.fxLen = sizeof(MFX_ALARM_DEFAULT);
+  }
+  postDisplay(cmd);
+
+  // A one-shot has disabled itself; persist that unless a new table is on its way
+  uint8_t entries[MCFG_ALARMS_MAX * MCFG_ALARM_ENTRY_LEN];
+  uint8_t count = malarm_encode(&alarms, entries);
+  portENTER_CRITICAL(&storeMux);
+  if (!storeAlarmsPending) mstore_set_alarms(&store, entries, count, millis());
+  portEXIT_CRITICAL(&storeMux);
+}
+
+void snoozeAlarm(time_t now) {
+  if (!alarmRangAt || millis() - alarmRangAt > ALARM_SNOOZE_WINDOW_MS) return;
+  if (!malarm_snooze(&alarms, now)) return;
+  alarmRangAt = 0;
+  Serial.println("Alarm snoozed");
+
+  DisplayCmd cmd = {};
+  cmd.fields = DISPLAY_F_FX;   // no program stops the effect
+  postDisplay(cmd);
+}
+
+// Sleeps until the planned instant instead of checking every minute
+void armAlarmTimer(time_t now) {
+  time_t at;
+  esp_timer_stop(alarmTimer);
+  if (!malarm_next(&alarms, &at, nullptr)) return;
+  int64_t us = at > now ? (int64_t)(at - now - 1) * 1000000 + usToNextSecond() : 0;
+  esp_timer_start_once(alarmTimer, us);
 }
 
 /* ================= Display ================= */
-void updateDisplay(struct tm &t) {
-  int v = t.tm_hour * 100 + t.tm_min;
-  bool colon = (t.tm_sec % 2);
-  display.showNumberDecEx(v, colon ? 0x40 : 0x00, true);
+// Digits on the minute, the colon on every second
+void updateDisplay(struct tm &t, bool digits) {
+  DisplayCmd cmd = {};
+  cmd.fields = DISPLAY_F_COLON;
+  cmd.colon = t.tm_sec % 2;
+  if (digits) {
+    cmd.fields |= DISPLAY_F_DIGITS;
+    encodeTime(t.tm_hour, t.tm_min, false, cmd.digits);
+  }
+  postDisplay(cmd);
 }
 
 /* ================= setup / loop ================= */
 void setup() {
   Serial.begin(115200);
-  display.setBrightness(0x0f);
 
-  prefs.begin("cfg", false);
-  wifi_ssid = prefs.getString("ssid", "");
-  wifi_psk  = prefs.getString("psk", "");
-  alarm_h   = prefs.getInt("alarm_h", 6);
-  alarm_m   = prefs.getInt("alarm_m", 30);
-  alarm_enabled = prefs.getBool("alarm_en", false);
+  loopTaskHandle = xTaskGetCurrentTaskHandle();
+
+#if FX_LED_PIN >= 0
+  pinMode(FX_LED_PIN, OUTPUT);
+#endif
+#if FX_BUZZER_PIN >= 0
+  pinMode(FX_BUZZER_PIN, OUTPUT);
+#endif
+  esp_timer_create_args_t fxArgs = {};
+  fxArgs.callback = onFxStep;
+  fxArgs.name = "fx";
+  esp_timer_create(&fxArgs, &fxTimer);
+
+  esp_timer_create_args_t secondArgs = {};
+  secondArgs.callback = onSecondTimer;
+  secondArgs.name = "second";
+  esp_timer_create(&secondArgs, &secondTimer);
+
+  esp_timer_create_args_t alarmArgs = {};
+  alarmArgs.callback = onAlarmTimer;
+  alarmArgs.name = "alarm";
+  esp_timer_create(&alarmArgs, &alarmTimer);
+  malarm_init(&alarms);
+
+  sntp_set_time_sync_notification_cb(onTimeSync);
+
+  displayQueue = xQueueCreate(8, sizeof(DisplayCmd));
+  xTaskCreate(displayTask, "display", 3072, nullptr, 2, nullptr);
+
+  loadConfig();
+
+  wifiQueue = xQueueCreate(1, sizeof(WifiCreds));
+  xTaskCreate(wifiTask, "wifi", 4096, nullptr, 1, nullptr);
+  postWifiCreds();
 
-  connectWiFi();
   setupBLE();
+
+  armSecondTimer();
 }
 
 void loop() {
-  struct tm t;
-  if (getTimeNow(t)) {
-    updateDisplay(t);
-    checkAlarm(t);
+  static int lastMinute = -1;
+  static uint32_t wakes = 0;
+  static int64_t wakeWindow = esp_timer_get_time();
+  uint32_t events = 0;
+
+  xTaskNotifyWait(0, UINT32_MAX, &events, portMAX_DELAY);
+  wakes++;
+
+  if (events & (LOOP_EV_SECOND | LOOP_EV_REFRESH)) armSecondTimer();
+
+  time_t epoch;
+  if (getEpochNow(epoch)) {
+    struct tm t;
+    localtime_r(&epoch, &t);
+    int minute = t.tm_hour * 60 + t.tm_min;
+    bool newMinute = (events & LOOP_EV_REFRESH) || minute != lastMinute;
+    lastMinute = minute;
+    updateDisplay(t, newMinute);
+
+    if (events & (LOOP_EV_REFRESH | LOOP_EV_ALARMS | LOOP_EV_ALARM | LOOP_EV_BUTTON)) {
+      updateAlarms(events, epoch);
+      if (events & LOOP_EV_ALARM) ringAlarm(epoch);
+      if (events & LOOP_EV_BUTTON) snoozeAlarm(epoch);
+      armAlarmTimer(epoch);
+    }
+  }
+  scheduleAdvertising();
+  flushConfig();
+
+  int64_t now = esp_timer_get_time();
+  if (now - wakeWindow >= 60000000) {
+    Serial.printf("Loop wakes/min: %u\n", wakes);
+    wakes = 0;
+    wakeWindow = now;
   }
-  delay(500);
 }
@@ -0,0 +1 @@
+../../../../protocol/mustang_alarm.h
\ No newline at end of file
@@ -0,0 +1 @@
+../../../../protocol/mustang_cfg.h
\ No newline at end of file
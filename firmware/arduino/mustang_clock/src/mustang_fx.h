@@ -0,0 +1 @@
+../../../../protocol/mustang_fx.h
\ No newline at end of file
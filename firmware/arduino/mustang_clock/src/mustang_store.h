@@ -0,0 +1 @@
+../../../../protocol/mustang_store.h
\ No newline at end of file
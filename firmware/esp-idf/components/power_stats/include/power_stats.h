@@ -0,0 +1,33 @@
+#ifndef POWER_STATS_H
+#define POWER_STATS_H
+
+/*
+ * Automatic light sleep and wake accounting, shared by the clock firmwares.
+ *
+ * power_stats_init() configures DFS with light sleep, so the CPU sleeps
+ * whenever no task is ready and no PM lock is held. Light sleep callbacks
+ * count every wakeup and how long the CPU stayed awake; a periodic report
+ * logs wakeups per hour, awake time per wakeup and the sleep ratio, the
+ * numbers needed to estimate battery life.
+ */
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+typedef struct {
+    uint32_t wakeups;       // light sleep exits
+    int64_t sleptUs;        // time spent in light sleep
+    int64_t awakeUs;        // time between an exit and the next entry
+    int64_t spanUs;         // window the counters cover
+} power_stats_t;
+
+esp_err_t power_stats_init(void);
+
+// Counters since the last call, resets them
+void power_stats_take(power_stats_t *stats);
+// Counters of the running window, leaves them alone
+void power_stats_peek(power_stats_t *stats);
+void power_stats_log(const power_stats_t *stats);
+
+#endif
@@ -0,0 +1,144 @@
+#include <string.h>
+
+#include "esp_attr.h"
+#include "esp_check.h"
+#include "esp_log.h"
+#include "esp_pm.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "sdkconfig.h"
+
+#include "power_stats.h"
+
+#define TAG "POWER"
+
+#define US_PER_HOUR (3600LL * 1000000LL)
+
+/* ===== GLOBALS ===== */
+// Updated from the sleep callbacks with interrupts off, read under m_lock
+static portMUX_TYPE m_lock = portMUX_INITIALIZER_UNLOCKED;
+static power_stats_t m_stats;
+static int64_t m_windowStartUs;
+static int64_t m_lastWakeUs;
+
+#if CONFIG_POWER_STATS_REPORT_S > 0
+static esp_timer_handle_t m_reportTimer;
+#endif
+
+/* ===== SLEEP CALLBACKS ===== */
+#if CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+static esp_err_t IRAM_ATTR onSleepEnter(int64_t sleepTimeUs, void *arg)
+{
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL_ISR(&m_lock);
+    m_stats.awakeUs += now - m_lastWakeUs;
+    portEXIT_CRITICAL_ISR(&m_lock);
+    return ESP_OK;
+}
+
+static esp_err_t IRAM_ATTR onSleepExit(int64_t sleepTimeUs, void *arg)
+{
+    portENTER_CRITICAL_ISR(&m_lock);
+    m_stats.wakeups++;
+    m_stats.sleptUs += sleepTimeUs;
+    m_lastWakeUs = esp_timer_get_time();
+    portEXIT_CRITICAL_ISR(&m_lock);
+    return ESP_OK;
+}
+#endif
+
+#if CONFIG_POWER_STATS_REPORT_S > 0
+static void onReport(void *arg)
+{
+    power_stats_t stats;
+
+    power_stats_take(&stats);
+    power_stats_log(&stats);
+}
+#endif
+
+/* ===== PUBLIC ===== */
+esp_err_t power_stats_init(void)
+{
+    int64_t now = esp_timer_get_time();
+
+    m_windowStartUs = now;
+    m_lastWakeUs = now;
+
+#if CONFIG_POWER_LIGHT_SLEEP
+    const esp_pm_config_t pm = {
+        .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = CONFIG_XTAL_FREQ,
+        .light_sleep_enable = true,
+    };
+    esp_err_t err = esp_pm_configure(&pm);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "light sleep not available, err=%d", err);
+        return err;
+    }
+
+#if CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+    esp_pm_sleep_cbs_register_config_t cbs = {
+        .enter_cb = onSleepEnter,
+        .exit_cb = onSleepExit,
+    };
+    err = esp_pm_light_sleep_register_cbs(&cbs);
+    if (err != ESP_OK)
+        ESP_LOGW(TAG, "no sleep callbacks, wake counters stay at 0");
+#endif
+
+    ESP_LOGI(TAG, "light sleep on, %d-%d MHz", pm.min_freq_mhz, pm.max_freq_mhz);
+#endif
+
+#if CONFIG_POWER_STATS_REPORT_S > 0
+    const esp_timer_create_args_t args = {
+        .callback = onReport,
+        .name = "power_report",
+    };
+    ESP_RETURN_ON_ERROR(esp_timer_create(&args, &m_reportTimer), TAG, "report timer");
+    ESP_RETURN_ON_ERROR(esp_timer_start_periodic(m_reportTimer,
+                                                 CONFIG_POWER_STATS_REPORT_S * 1000000LL),
+                        TAG, "report start");
+#endif
+    return ESP_OK;
+}
+
+void power_stats_take(power_stats_t *stats)
+{
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&m_lock);
+    *stats = m_stats;
+    // The running awake stretch counts towards this window
+    stats->awakeUs += now - m_lastWakeUs;
+    stats->spanUs = now - m_windowStartUs;
+    memset(&m_stats, 0, sizeof(m_stats));
+    m_lastWakeUs = now;
+    m_windowStartUs = now;
+    portEXIT_CRITICAL(&m_lock);
+}
+
+void power_stats_peek(power_stats_t *stats)
+{
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&m_lock);
+    *stats = m_stats;
+    stats->awakeUs += now - m_lastWakeUs;
+    stats->spanUs = now - m_windowStartUs;
+    portEXIT_CRITICAL(&m_lock);
+}
+
+void power_stats_log(const power_stats_t *stats)
+{
+    if (stats->spanUs <= 0)
+        return;
+
+    ESP_LOGI(TAG, "%lu wakeups in %lld s (%lld/h), %lld us awake per wakeup, asleep %lld.%lld%%",
+             (unsigned long)stats->wakeups, stats->spanUs / 1000000,
+             stats->wakeups * US_PER_HOUR / stats->spanUs,
+             stats->wakeups ? stats->awakeUs / stats->wakeups : stats->awakeUs,
+             stats->sleptUs * 100 / stats->spanUs,
+             stats->sleptUs * 1000 / stats->spanUs % 10);
+}
@@ -0,0 +1,25 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+#ifndef CLOCK_CORE_H
+#define CLOCK_CORE_H
+
+/* Includes */
+#include "config_parser.h"
+
+/* Defines */
+#define CLOCK_CORE_QUEUE_LEN 4
+#define CLOCK_CORE_SNOOZE_WINDOW_MS 60000 /* after a ring, snooze accepted */
+
+/* Public function declarations */
+int clock_core_init(void);
+/* Non-blocking, safe to call from the NimBLE host task */
+int clock_core_post_config(const config_update_t *update);
+/* Wi-Fi credentials stored, safe to call from any task */
+bool clock_core_provisioned(void);
+/* Snooze the alarm that rang last, non-blocking */
+int clock_core_snooze(void);
+
+#endif // CLOCK_CORE_H
@@ -0,0 +1,88 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+/*
+ * Streaming config parser for the config characteristic.
+ *
+ * Consumes a write chunk by chunk (one call per os_mbuf in the chain), so
+ * payloads larger than one ATT MTU are decoded without flattening them.
+ * Accepts both the compact JSON sent by the app and the binary TLV format
+ * from protocol/mustang_cfg.h. Pure C, no NimBLE or FreeRTOS dependency.
+ */
+#ifndef CONFIG_PARSER_H
+#define CONFIG_PARSER_H
+
+/* Includes */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mustang_cfg.h"
+
+/* Defines */
+#define CONFIG_PARSER_OK 0
+#define CONFIG_PARSER_ERR_FORMAT -1
+#define CONFIG_PARSER_ERR_SYNTAX -2
+#define CONFIG_PARSER_ERR_VALUE -3
+#define CONFIG_PARSER_ERR_INCOMPLETE -4
+
+#define CONFIG_PARSER_KEY_MAX 16
+
+/* Decoded update, owns its strings so it can outlive the mbuf */
+typedef struct {
+    uint8_t present; /* MCFG_HAS_* mask */
+    char ssid[MCFG_SSID_MAX + 1];
+    char psk[MCFG_PSK_MAX + 1];
+    uint8_t time_hh;
+    uint8_t time_mm;
+    uint8_t alarm_hh;
+    uint8_t alarm_mm;
+    uint8_t alarm_flags;
+    uint8_t alarm_count; /* MCFG_HAS_ALARMS, binary only */
+    uint8_t alarms[MCFG_ALARMS_MAX * MCFG_ALARM_ENTRY_LEN];
+    uint8_t fx_len; /* MCFG_HAS_FX, binary only, 0 = default effect */
+    uint8_t fx[MCFG_FX_MAX];
+} config_update_t;
+
+typedef enum {
+    CONFIG_FMT_UNKNOWN,
+    CONFIG_FMT_JSON,
+    CONFIG_FMT_BINARY,
+} config_format_t;
+
+typedef struct {
+    config_format_t format;
+    int error;
+    size_t consumed;
+    config_update_t update;
+
+    /* Binary TLV state */
+    uint8_t bin_state;
+    uint8_t tag;
+    uint8_t len;
+    uint8_t fill;
+    uint8_t value[UINT8_MAX];
+
+    /* JSON state */
+    uint8_t json_state;
+    uint8_t depth;
+    uint8_t seen;
+    uint8_t skip;
+    bool escape;
+    bool in_key;
+    bool done;
+    char section[CONFIG_PARSER_KEY_MAX];
+    char key[CONFIG_PARSER_KEY_MAX];
+    char token[MCFG_PSK_MAX + 1];
+    uint8_t token_len;
+    bool token_overflow;
+} config_parser_t;
+
+/* Public function declarations */
+void config_parser_init(config_parser_t *p);
+int config_parser_feed(config_parser_t *p, const uint8_t *data, size_t len);
+int config_parser_finish(config_parser_t *p, config_update_t *out);
+
+#endif // CONFIG_PARSER_H
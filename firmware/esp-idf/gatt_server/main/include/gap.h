@@ -16,8 +16,23 @@
 #define BLE_GAP_URI_PREFIX_HTTPS 0x17
 #define BLE_GAP_LE_ROLE_PERIPHERAL 0x00
 
+/* Estimated radio time of one legacy advertising event, three channels */
+#define GAP_ADV_EVENT_US 2000
+
+/* Config link idle this long drops to the low-power profile */
+#define GAP_PROFILE_IDLE_MS 2000
+
+/* Connection parameter profiles */
+typedef enum {
+    GAP_PROFILE_NONE = 0,
+    GAP_PROFILE_FAST,      /* config transfer in flight */
+    GAP_PROFILE_LOW_POWER, /* connected and idle */
+} gap_conn_profile_t;
+
 /* Public function declarations */
 void adv_init(void);
 int gap_init(void);
+void gap_config_activity(uint16_t conn_handle, uint16_t len);
+gap_conn_profile_t gap_conn_profile(void);
 
 #endif // GAP_SVC_H
@@ -14,6 +14,13 @@
 /* NimBLE GAP APIs */
 #include "host/ble_gap.h"
 
+/* Defines */
+/* Largest config message accepted as fragments */
+#define CONFIG_REASM_MAX 2048
+
+/* Config service UUID, also advertised by GAP */
+extern const ble_uuid128_t config_svc_uuid;
+
 /* Public function declarations */
 void send_heart_rate_indication(void);
 void gatt_svr_register_cb(struct ble_gatt_register_ctxt *ctxt, void *arg);
@@ -20,5 +20,7 @@ uint8_t get_led_state(void);
 void led_on(void);
 void led_off(void);
 void led_init(void);
+/* Turns the LED off and frees its driver, led_init() brings it back */
+void led_deinit(void);
 
 #endif // LED_H
@@ -4,9 +4,11 @@
  * SPDX-License-Identifier: Unlicense OR CC0-1.0
  */
 /* Includes */
+#include "clock_core.h"
 #include "common.h"
 #include "gap.h"
 #include "gatt_svc.h"
+#include "power_stats.h"
 
 /* Library function declarations */
 void ble_store_config_init(void);
@@ -75,6 +77,15 @@ void app_main(void) {
         return;
     }
 
+    /*
+     * Light sleep between events, before the controller starts so its
+     * modem sleep takes the PM configuration into account
+     */
+    ret = power_stats_init();
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "running without light sleep, error code: %d", ret);
+    }
+
     /* NimBLE stack initialization */
     ret = nimble_port_init();
     if (ret != ESP_OK) {
@@ -83,6 +94,13 @@ void app_main(void) {
         return;
     }
 
+    /* Clock core initialization, consumes config writes from the GATT server */
+    rc = clock_core_init();
+    if (rc != 0) {
+        ESP_LOGE(TAG, "failed to initialize clock core, error code: %d", rc);
+        return;
+    }
+
     /* GAP service initialization */
     rc = gap_init();
     if (rc != 0) {
@@ -0,0 +1,501 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+/* Includes */
+#include "clock_core.h"
+#include "common.h"
+
+#include <sys/time.h>
+#include <time.h>
+
+#include "esp_timer.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "led.h"
+#include "mustang_alarm.h"
+#include "mustang_fx.h"
+#include "mustang_store.h"
+#include "power_stats.h"
+
+/* Private variables */
+static QueueHandle_t config_queue = NULL;
+
+/* Current configuration, owned by the clock core task */
+static config_update_t clock_config;
+static mstore_t store;
+static volatile bool provisioned;
+
+/*
+ * Alarm table; the task sleeps until its next planned ring. Nothing is
+ * planned or rung before the app has set the wall clock, which starts at
+ * the epoch on this board.
+ */
+static malarm_sched_t alarms;
+static bool clock_set;
+static volatile bool snooze_requested;
+static uint32_t rang_ms;
+
+/*
+ * Ring effect on the LED; started and stopped by the clock core task,
+ * stepped in the esp_timer task so it keeps time while this one is busy.
+ * When it ends the timer callback only sets fx_ended and wakes the task,
+ * which stops the timer and releases the LED.
+ */
+static mfx_player_t fx;
+static esp_timer_handle_t fx_timer;
+static portMUX_TYPE fx_mux = portMUX_INITIALIZER_UNLOCKED;
+static volatile bool fx_ended;
+
+/*
+ * The LED strip's RMT channel holds a PM lock while enabled and would keep
+ * the CPU out of light sleep, so the driver only exists while an effect
+ * plays. led_lock orders its creation and deletion with the timer steps.
+ */
+static SemaphoreHandle_t led_lock;
+static bool led_ready;
+
+/* Private function declarations */
+static uint32_t now_ms(void);
+static void load_config(void);
+static void load_legacy_config(nvs_handle_t handle);
+static void flush_config(void);
+static void apply_config(const config_update_t *update);
+static void plan_alarms(void);
+static uint32_t alarm_wait_ms(void);
+static TickType_t wait_ticks(uint32_t wait_ms);
+static void led_show(uint8_t out);
+static void fx_output(uint8_t out, bool running);
+static void fx_drive(uint8_t out);
+static void fx_timer_cb(void *arg);
+static void fx_reap(void);
+static void fx_play(void);
+static void fx_stop(void);
+static void ring_alarms(void);
+static void clock_core_task(void *param);
+
+/* Private functions */
+static uint32_t now_ms(void) { return (uint32_t)(esp_timer_get_time() / 1000); }
+
+/*
+ *  Load the config blob with a single read
+ *      Falls back to the per-key layout of older firmware and marks the
+ *      store dirty, so the first flush migrates it
+ */
+static void load_config(void) {
+    nvs_handle_t handle;
+    mstore_blob_t blob;
+    size_t len = sizeof(blob);
+
+    mstore_init(&store);
+    if (nvs_open("cfg", NVS_READONLY, &handle) != ESP_OK) {
+        return;
+    }
+
+    if (nvs_get_blob(handle, MSTORE_KEY, &blob, &len) == ESP_OK &&
+        mstore_load(&store, &blob, len)) {
+        ESP_LOGI(TAG, "config blob loaded, present=0x%02x",
+                 store.blob.present);
+    } else {
+        load_legacy_config(handle);
+    }
+    nvs_close(handle);
+
+    clock_config.present = store.blob.present;
+    memcpy(clock_config.ssid, store.blob.ssid, sizeof(clock_config.ssid));
+    memcpy(clock_config.psk, store.blob.psk, sizeof(clock_config.psk));
+    provisioned = clock_config.present & MCFG_HAS_SSID;
+}
+
+static void load_legacy_config(nvs_handle_t handle) {
+    char str[MCFG_PSK_MAX + 1];
+    uint8_t alarm[MCFG_ALARM_LEN];
+    size_t len;
+
+    len = sizeof(str);
+    if (nvs_get_str(handle, "ssid", str, &len) == ESP_OK) {
+        mstore_set_ssid(&store, str, strlen(str), now_ms());
+    }
+    len = sizeof(str);
+    if (nvs_get_str(handle, "psk", str, &len) == ESP_OK) {
+        mstore_set_psk(&store, str, strlen(str), now_ms());
+    }
+    len = sizeof(alarm);
+    if (nvs_get_blob(handle, "alarm", alarm, &len) == ESP_OK &&
+        len == sizeof(alarm)) {
+        mstore_set_alarm(&store, alarm[0], alarm[1], alarm[2], now_ms());
+    }
+}
+
+/* One blob, one nvs_commit, however many messages changed it */
+static void flush_config(void) {
+    nvs_handle_t handle;
+    const mstore_blob_t *blob;
+    int64_t t0 = esp_timer_get_time();
+    esp_err_t err;
+
+    err = nvs_open("cfg", NVS_READWRITE, &handle);
+    if (err == ESP_OK) {
+        blob = mstore_seal(&store);
+        err = nvs_set_blob(handle, MSTORE_KEY, blob, sizeof(*blob));
+        if (err == ESP_OK) {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+
+    /* Retry after another debounce window */
+    if (err != ESP_OK) {
+        mstore_touch(&store, now_ms());
+    }
+    ESP_LOGI(TAG, "config blob stored in %lld us, err=%d",
+             esp_timer_get_time() - t0, err);
+}
+
+static void apply_config(const config_update_t *update) {
+    if (update->present & MCFG_HAS_SSID) {
+        memcpy(clock_config.ssid, update->ssid, sizeof(clock_config.ssid));
+        ESP_LOGI(TAG, "wifi ssid: %s", clock_config.ssid);
+    }
+    if (update->present & MCFG_HAS_PSK) {
+        memcpy(clock_config.psk, update->psk, sizeof(clock_config.psk));
+        ESP_LOGI(TAG, "wifi psk: %u bytes", (unsigned)strlen(clock_config.psk));
+    }
+    if (update->present & MCFG_HAS_TIME) {
+        struct timeval tv = {
+            .tv_sec = update->time_hh * 3600 + update->time_mm * 60,
+        };
+
+        clock_config.time_hh = update->time_hh;
+        clock_config.time_mm = update->time_mm;
+        settimeofday(&tv, NULL);
+        clock_set = true;
+        plan_alarms();
+        ESP_LOGI(TAG, "time set: %02u:%02u", update->time_hh,
+                 update->time_mm);
+    }
+    if (update->present & MCFG_HAS_ALARM) {
+        ESP_LOGI(TAG, "alarm: %02u:%02u flags=0x%02x", update->alarm_hh,
+                 update->alarm_mm, update->alarm_flags);
+    }
+    if (update->present & MCFG_HAS_ALARMS) {
+        ESP_LOGI(TAG, "alarm table: %u entries", update->alarm_count);
+    }
+    if ((update->present & MCFG_HAS_FX) && update->fx_len != 0 &&
+        mfx_check(update->fx, update->fx_len) != MFX_OK) {
+        ESP_LOGW(TAG, "alarm effect rejected, %u bytes", update->fx_len);
+    } else if (update->present & MCFG_HAS_FX) {
+        mstore_set_fx(&store, update->fx, update->fx_len, now_ms());
+        ESP_LOGI(TAG, "alarm effect: %u bytes", update->fx_len);
+    }
+    clock_config.present |= update->present & ~MCFG_HAS_COMMIT;
+    provisioned = clock_config.present & MCFG_HAS_SSID;
+
+    /* Only the persisted fields, unchanged values do not dirty the store */
+    if (update->present & MCFG_HAS_SSID) {
+        mstore_set_ssid(&store, update->ssid, strlen(update->ssid), now_ms());
+    }
+    if (update->present & MCFG_HAS_PSK) {
+        mstore_set_psk(&store, update->psk, strlen(update->psk), now_ms());
+    }
+    /* A single alarm is a one-entry daily table, a full table wins */
+    if (update->present & MCFG_HAS_ALARM) {
+        mstore_set_alarm(&store, update->alarm_hh, update->alarm_mm,
+                         update->alarm_flags, now_ms());
+    }
+    if (update->present & MCFG_HAS_ALARMS) {
+        mstore_set_alarms(&store, update->alarms, update->alarm_count,
+                          now_ms());
+    }
+    if (update->present & (MCFG_HAS_ALARM | MCFG_HAS_ALARMS)) {
+        int64_t t0 = esp_timer_get_time();
+
+        malarm_load(&alarms, store.blob.alarms, store.blob.alarm_count);
+        plan_alarms();
+        ESP_LOGI(TAG, "alarms planned in %lld us", esp_timer_get_time() - t0);
+    }
+}
+
+/* Against the wall clock, once it was set */
+static void plan_alarms(void) {
+    if (clock_set) {
+        malarm_plan(&alarms, time(NULL));
+    }
+}
+
+/* Until the planned ring, UINT32_MAX when no alarm is enabled */
+static uint32_t alarm_wait_ms(void) {
+    struct timeval tv;
+    time_t at;
+    int64_t ms;
+
+    if (!clock_set || !malarm_next(&alarms, &at, NULL)) {
+        return UINT32_MAX;
+    }
+    gettimeofday(&tv, NULL);
+    ms = ((int64_t)at - tv.tv_sec) * 1000 - tv.tv_usec / 1000;
+    if (ms <= 0) {
+        return 0;
+    }
+    return ms < UINT32_MAX ? (uint32_t)ms : UINT32_MAX - 1;
+}
+
+/*
+ * Rounded up to a whole tick: at CONFIG_FREERTOS_HZ=100 pdMS_TO_TICKS()
+ * makes anything under 10 ms a zero timeout and the task would spin
+ */
+static TickType_t wait_ticks(uint32_t wait_ms) {
+    TickType_t ticks;
+
+    if (wait_ms == UINT32_MAX) {
+        return portMAX_DELAY;
+    }
+    ticks = pdMS_TO_TICKS(wait_ms);
+    return ticks == 0 && wait_ms != 0 ? 1 : ticks;
+}
+
+/* With led_lock held, nothing while the driver does not exist */
+static void led_show(uint8_t out) {
+    if (!led_ready) {
+        return;
+    }
+    if (out & MFX_OUT_LED) {
+        led_on();
+    } else {
+        led_off();
+    }
+}
+
+/*
+ *  Drive the LED from the effect outputs
+ *      Creates the LED driver when an effect starts and deletes it when the
+ *      effect ends. No buzzer on this board, MFX_OUT_BUZZER is ignored
+ */
+static void fx_output(uint8_t out, bool running) {
+    power_stats_t stats;
+
+    xSemaphoreTake(led_lock, portMAX_DELAY);
+    if (running && !led_ready) {
+        led_init();
+        led_ready = true;
+    }
+    led_show(out);
+    if (!running && led_ready) {
+        led_deinit();
+        led_ready = false;
+
+        /*
+         * No light sleep while the driver existed; the next reports show
+         * the wakeups and the sleep ratio coming back
+         */
+        power_stats_peek(&stats);
+        ESP_LOGI(TAG, "led released, light sleep can resume");
+        power_stats_log(&stats);
+    }
+    xSemaphoreGive(led_lock);
+}
+
+/* From the timer steps: never creates or deletes the driver */
+static void fx_drive(uint8_t out) {
+    xSemaphoreTake(led_lock, portMAX_DELAY);
+    led_show(out);
+    xSemaphoreGive(led_lock);
+}
+
+static void fx_timer_cb(void *arg) {
+    /* An empty update only wakes the task */
+    static const config_update_t wake;
+    int changed;
+    uint8_t out;
+    bool running;
+
+    portENTER_CRITICAL(&fx_mux);
+    changed = mfx_tick(&fx);
+    out = fx.out;
+    running = fx.running;
+    portEXIT_CRITICAL(&fx_mux);
+
+    if (running) {
+        if (changed & MFX_CHG_OUT) {
+            fx_drive(out);
+        }
+    } else if (!fx_ended) {
+        /* Retried on the next period if the queue is full */
+        fx_ended = clock_core_post_config(&wake) == 0;
+    }
+}
+
+/*
+ * In the clock core task, which also starts effects: an effect that ended
+ * is not replaced under its feet, and the driver is deleted outside the
+ * esp_timer task
+ */
+static void fx_reap(void) {
+    bool running;
+
+    if (!fx_ended) {
+        return;
+    }
+    fx_ended = false;
+
+    portENTER_CRITICAL(&fx_mux);
+    running = fx.running;
+    portEXIT_CRITICAL(&fx_mux);
+    if (!running) {
+        esp_timer_stop(fx_timer);
+        fx_output(0, false);
+    }
+}
+
+/* The uploaded effect, or the default one when none was */
+static void fx_play(void) {
+    const uint8_t *prog = MFX_ALARM_DEFAULT;
+    size_t len = sizeof(MFX_ALARM_DEFAULT);
+    uint8_t out;
+    bool running;
+
+    if ((store.blob.present & MCFG_HAS_FX) && store.blob.fx_len != 0) {
+        prog = store.blob.fx;
+        len = store.blob.fx_len;
+    }
+
+    esp_timer_stop(fx_timer);
+    fx_ended = false;
+    portENTER_CRITICAL(&fx_mux);
+    if (mfx_start(&fx, prog, len, 0) < 0) {
+        mfx_start(&fx, MFX_ALARM_DEFAULT, sizeof(MFX_ALARM_DEFAULT), 0);
+    }
+    out = fx.out;
+    running = fx.running;
+    portEXIT_CRITICAL(&fx_mux);
+
+    fx_output(out, running);
+    if (running) {
+        esp_timer_start_periodic(fx_timer, MFX_TICK_MS * 1000);
+    }
+}
+
+static void fx_stop(void) {
+    esp_timer_stop(fx_timer);
+    portENTER_CRITICAL(&fx_mux);
+    mfx_stop(&fx);
+    portEXIT_CRITICAL(&fx_mux);
+    fx_output(0, false);
+}
+
+static void ring_alarms(void) {
+    uint8_t entries[MCFG_ALARMS_MAX * MCFG_ALARM_ENTRY_LEN];
+    time_t now = time(NULL);
+    int idx;
+
+    if (!clock_set) {
+        snooze_requested = false;
+        return;
+    }
+    if (snooze_requested) {
+        snooze_requested = false;
+        if (rang_ms != 0 &&
+            now_ms() - rang_ms <= CLOCK_CORE_SNOOZE_WINDOW_MS &&
+            malarm_snooze(&alarms, now)) {
+            rang_ms = 0;
+            fx_stop();
+            ESP_LOGI(TAG, "alarm snoozed");
+        }
+    }
+
+    /* Nothing when the wait ended early, e.g. the clock was set back */
+    idx = malarm_ring(&alarms, now);
+    if (idx == MALARM_NONE) {
+        return;
+    }
+    rang_ms = now_ms() | 1;
+    ESP_LOGW(TAG, "alarm %d ringing", idx);
+    fx_play();
+
+    /* A one-shot has disabled itself, persist that */
+    mstore_set_alarms(&store, entries, malarm_encode(&alarms, entries),
+                      now_ms());
+}
+
+static void clock_core_task(void *param) {
+    /* Local variables */
+    config_update_t update;
+    uint32_t wait_ms;
+    uint32_t alarm_ms;
+    bool commit;
+
+    ESP_LOGI(TAG, "clock core task has been started!");
+
+    while (1) {
+        /*
+         * Sleep until the next message, the end of the debounce window or
+         * the next planned alarm, whichever comes first
+         */
+        wait_ms = mstore_wait_ms(&store, now_ms());
+        alarm_ms = alarm_wait_ms();
+        if (alarm_ms < wait_ms) {
+            wait_ms = alarm_ms;
+        }
+        commit = false;
+        if (xQueueReceive(config_queue, &update, wait_ticks(wait_ms)) ==
+            pdTRUE) {
+            apply_config(&update);
+            commit = update.present & MCFG_HAS_COMMIT;
+        }
+        fx_reap();
+        ring_alarms();
+        if (mstore_due(&store, now_ms(), commit)) {
+            flush_config();
+        }
+    }
+}
+
+/* Public functions */
+int clock_core_init(void) {
+    const esp_timer_create_args_t fx_args = {
+        .callback = fx_timer_cb,
+        .name = "alarm_fx",
+    };
+
+    /* No led_init() here, see fx_output() */
+    mfx_init(&fx, 0);
+    led_lock = xSemaphoreCreateMutex();
+    if (led_lock == NULL ||
+        esp_timer_create(&fx_args, &fx_timer) != ESP_OK) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    load_config();
+    malarm_load(&alarms, store.blob.alarms, store.blob.alarm_count);
+
+    config_queue = xQueueCreate(CLOCK_CORE_QUEUE_LEN, sizeof(config_update_t));
+    if (config_queue == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (xTaskCreate(clock_core_task, "Clock Core", 4 * 1024, NULL, 4, NULL) !=
+        pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return 0;
+}
+
+bool clock_core_provisioned(void) { return provisioned; }
+
+int clock_core_snooze(void) {
+    /* An empty update only wakes the task */
+    static const config_update_t wake;
+
+    snooze_requested = true;
+    return clock_core_post_config(&wake);
+}
+
+int clock_core_post_config(const config_update_t *update) {
+    if (config_queue == NULL ||
+        xQueueSend(config_queue, update, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "clock core busy, config update dropped");
+        return ESP_ERR_TIMEOUT;
+    }
+    return 0;
+}
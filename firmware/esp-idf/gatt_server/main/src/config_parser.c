@@ -0,0 +1,444 @@
+/*
+ * SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+/* Includes */
+#include "config_parser.h"
+
+#include <string.h>
+
+/* Private defines */
+#define BIN_MAGIC 0
+#define BIN_VERSION 1
+#define BIN_TAG 2
+#define BIN_LEN 3
+#define BIN_VALUE 4
+
+#define JSON_IDLE 0
+#define JSON_STRING 1
+#define JSON_LITERAL 2
+
+#define SEEN_TIME_HH 0x01
+#define SEEN_TIME_MM 0x02
+#define SEEN_ALARM_HH 0x04
+#define SEEN_ALARM_MM 0x08
+
+/* Private function declarations */
+static void fail(config_parser_t *p, int error);
+static void copy_string(char *dst, size_t cap, const char *src, size_t len);
+static void bin_complete_tlv(config_parser_t *p);
+static void bin_feed(config_parser_t *p, uint8_t b);
+static bool parse_int(const char *s, int *out);
+static void json_value(config_parser_t *p, bool is_string);
+static void json_structural(config_parser_t *p, uint8_t c);
+static void token_put(config_parser_t *p, char c);
+static void json_feed(config_parser_t *p, uint8_t c);
+
+/* Private functions */
+static void fail(config_parser_t *p, int error) {
+    if (p->error == CONFIG_PARSER_OK) {
+        p->error = error;
+    }
+}
+
+static void copy_string(char *dst, size_t cap, const char *src, size_t len) {
+    if (len >= cap) {
+        len = cap - 1;
+    }
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+}
+
+/*
+ *  Binary TLV
+ *      Values are collected into a bounded buffer and applied with the same
+ *      mcfg_apply() the flat decoder uses, then copied into the update
+ */
+static void bin_complete_tlv(config_parser_t *p) {
+    mcfg_config_t cfg = {0};
+    mcfg_tlv_t tlv = {.tag = p->tag, .len = p->len, .value = p->value};
+
+    if (mcfg_apply(&cfg, &tlv) != MCFG_OK) {
+        fail(p, CONFIG_PARSER_ERR_VALUE);
+        return;
+    }
+
+    if (cfg.present & MCFG_HAS_SSID) {
+        copy_string(p->update.ssid, sizeof(p->update.ssid), cfg.ssid,
+                    cfg.ssid_len);
+    }
+    if (cfg.present & MCFG_HAS_PSK) {
+        copy_string(p->update.psk, sizeof(p->update.psk), cfg.psk,
+                    cfg.psk_len);
+    }
+    if (cfg.present & MCFG_HAS_TIME) {
+        p->update.time_hh = cfg.time_hh;
+        p->update.time_mm = cfg.time_mm;
+    }
+    if (cfg.present & MCFG_HAS_ALARM) {
+        p->update.alarm_hh = cfg.alarm_hh;
+        p->update.alarm_mm = cfg.alarm_mm;
+        p->update.alarm_flags = cfg.alarm_flags;
+    }
+    if (cfg.present & MCFG_HAS_ALARMS) {
+        p->update.alarm_count = cfg.alarm_count;
+        memcpy(p->update.alarms, cfg.alarms,
+               cfg.alarm_count * MCFG_ALARM_ENTRY_LEN);
+    }
+    if (cfg.present & MCFG_HAS_FX) {
+        p->update.fx_len = cfg.fx_len;
+        memcpy(p->update.fx, cfg.fx, cfg.fx_len);
+    }
+    p->update.present |= cfg.present;
+}
+
+static void bin_feed(config_parser_t *p, uint8_t b) {
+    switch (p->bin_state) {
+    case BIN_MAGIC:
+        if (b != MCFG_MAGIC) {
+            fail(p, CONFIG_PARSER_ERR_FORMAT);
+        }
+        p->bin_state = BIN_VERSION;
+        break;
+
+    case BIN_VERSION:
+        if (b != MCFG_VERSION) {
+            fail(p, CONFIG_PARSER_ERR_FORMAT);
+        }
+        p->bin_state = BIN_TAG;
+        break;
+
+    case BIN_TAG:
+        p->tag = b;
+        p->bin_state = BIN_LEN;
+        break;
+
+    case BIN_LEN:
+        p->len = b;
+        p->fill = 0;
+        if (p->len == 0) {
+            bin_complete_tlv(p);
+            p->bin_state = BIN_TAG;
+        } else {
+            p->bin_state = BIN_VALUE;
+        }
+        break;
+
+    case BIN_VALUE:
+        p->value[p->fill++] = b;
+        if (p->fill == p->len) {
+            bin_complete_tlv(p);
+            p->bin_state = BIN_TAG;
+        }
+        break;
+    }
+}
+
+/*
+ *  JSON
+ *      Minimal streaming tokenizer for the app's two-level documents:
+ *      {"wifi":{"ssid":..,"psk":..},"time":{"hh":..,"mm":..},
+ *       "alarm":{"hh":..,"mm":..,"enabled":..},"commit":true}
+ */
+static bool parse_int(const char *s, int *out) {
+    int v = 0;
+    bool neg = false;
+
+    if (*s == '-') {
+        neg = true;
+        s++;
+    }
+    if (*s == '\0') {
+        return false;
+    }
+    for (; *s; s++) {
+        if (*s < '0' || *s > '9' || v > 9999) {
+            return false;
+        }
+        v = v * 10 + (*s - '0');
+    }
+    *out = neg ? -v : v;
+    return true;
+}
+
+static void json_value(config_parser_t *p, bool is_string) {
+    int v = 0;
+
+    /* Top level: only the end of a session, like MCFG_TAG_COMMIT */
+    if (p->depth == 1) {
+        if (!is_string && strcmp(p->key, "commit") == 0 &&
+            strcmp(p->token, "true") == 0) {
+            p->update.present |= MCFG_HAS_COMMIT;
+        }
+        return;
+    }
+
+    /* Otherwise only section members are interesting */
+    if (p->depth != 2) {
+        return;
+    }
+
+    if (strcmp(p->section, "wifi") == 0) {
+        if (!is_string) {
+            return;
+        }
+        if (strcmp(p->key, "ssid") == 0) {
+            if (p->token_overflow || p->token_len > MCFG_SSID_MAX) {
+                fail(p, CONFIG_PARSER_ERR_VALUE);
+                return;
+            }
+            copy_string(p->update.ssid, sizeof(p->update.ssid), p->token,
+                        p->token_len);
+            p->update.present |= MCFG_HAS_SSID;
+        } else if (strcmp(p->key, "psk") == 0) {
+            if (p->token_overflow) {
+                fail(p, CONFIG_PARSER_ERR_VALUE);
+                return;
+            }
+            copy_string(p->update.psk, sizeof(p->update.psk), p->token,
+                        p->token_len);
+            p->update.present |= MCFG_HAS_PSK;
+        }
+        return;
+    }
+
+    if (is_string) {
+        return;
+    }
+
+    if (strcmp(p->token, "true") == 0) {
+        v = 1;
+    } else if (strcmp(p->token, "false") == 0 ||
+               strcmp(p->token, "null") == 0) {
+        v = 0;
+    } else if (!parse_int(p->token, &v)) {
+        fail(p, CONFIG_PARSER_ERR_VALUE);
+        return;
+    }
+
+    if (strcmp(p->section, "time") == 0) {
+        if (strcmp(p->key, "hh") == 0 && v >= 0 && v <= 23) {
+            p->update.time_hh = v;
+            p->seen |= SEEN_TIME_HH;
+        } else if (strcmp(p->key, "mm") == 0 && v >= 0 && v <= 59) {
+            p->update.time_mm = v;
+            p->seen |= SEEN_TIME_MM;
+        } else {
+            fail(p, CONFIG_PARSER_ERR_VALUE);
+        }
+    } else if (strcmp(p->section, "alarm") == 0) {
+        if (strcmp(p->key, "hh") == 0 && v >= 0 && v <= 23) {
+            p->update.alarm_hh = v;
+            p->seen |= SEEN_ALARM_HH;
+        } else if (strcmp(p->key, "mm") == 0 && v >= 0 && v <= 59) {
+            p->update.alarm_mm = v;
+            p->seen |= SEEN_ALARM_MM;
+        } else if (strcmp(p->key, "enabled") == 0) {
+            if (v) {
+                p->update.alarm_flags |= MCFG_ALARM_F_ENABLED;
+            } else {
+                p->update.alarm_flags &= ~MCFG_ALARM_F_ENABLED;
+            }
+        } else {
+            fail(p, CONFIG_PARSER_ERR_VALUE);
+        }
+    }
+}
+
+static void json_structural(config_parser_t *p, uint8_t c) {
+    switch (c) {
+    case ' ':
+    case '\t':
+    case '\r':
+    case '\n':
+        break;
+
+    case '{':
+        if (p->done || p->depth >= 2) {
+            fail(p, CONFIG_PARSER_ERR_SYNTAX);
+            return;
+        }
+        if (p->depth == 1) {
+            memcpy(p->section, p->key, sizeof(p->section));
+        }
+        p->depth++;
+        p->in_key = true;
+        break;
+
+    case '}':
+        if (p->depth == 0) {
+            fail(p, CONFIG_PARSER_ERR_SYNTAX);
+            return;
+        }
+        p->depth--;
+        if (p->depth == 0) {
+            p->done = true;
+        }
+        if (p->depth == 1) {
+            p->section[0] = '\0';
+        }
+        break;
+
+    case ',':
+        p->in_key = true;
+        break;
+
+    case ':':
+        p->in_key = false;
+        break;
+
+    case '"':
+        p->json_state = JSON_STRING;
+        p->token_len = 0;
+        p->token_overflow = false;
+        p->escape = false;
+        p->skip = 0;
+        break;
+
+    default:
+        if (p->depth == 0 || p->in_key) {
+            fail(p, CONFIG_PARSER_ERR_SYNTAX);
+            return;
+        }
+        p->json_state = JSON_LITERAL;
+        p->token_len = 0;
+        p->token_overflow = false;
+        p->token[p->token_len++] = c;
+        break;
+    }
+}
+
+static void token_put(config_parser_t *p, char c) {
+    if (p->token_len < sizeof(p->token) - 1) {
+        p->token[p->token_len++] = c;
+    } else {
+        p->token_overflow = true;
+    }
+}
+
+static void json_feed(config_parser_t *p, uint8_t c) {
+    switch (p->json_state) {
+    case JSON_IDLE:
+        json_structural(p, c);
+        break;
+
+    case JSON_STRING:
+        if (p->skip) {
+            /* Hex digits of a \uXXXX escape */
+            p->skip--;
+        } else if (p->escape) {
+            p->escape = false;
+            switch (c) {
+            case 'n':
+                token_put(p, '\n');
+                break;
+            case 't':
+                token_put(p, '\t');
+                break;
+            case 'r':
+                token_put(p, '\r');
+                break;
+            case 'b':
+                token_put(p, '\b');
+                break;
+            case 'f':
+                token_put(p, '\f');
+                break;
+            case 'u':
+                token_put(p, '?');
+                p->skip = 4;
+                break;
+            default:
+                token_put(p, c);
+                break;
+            }
+        } else if (c == '\\') {
+            p->escape = true;
+        } else if (c == '"') {
+            p->token[p->token_len] = '\0';
+            p->json_state = JSON_IDLE;
+            if (p->in_key) {
+                copy_string(p->key, sizeof(p->key), p->token, p->token_len);
+            } else {
+                json_value(p, true);
+            }
+        } else {
+            token_put(p, c);
+        }
+        break;
+
+    case JSON_LITERAL:
+        if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || c == '-') {
+            token_put(p, c);
+            break;
+        }
+        p->token[p->token_len] = '\0';
+        p->json_state = JSON_IDLE;
+        json_value(p, false);
+        json_structural(p, c);
+        break;
+    }
+}
+
+/* Public functions */
+void config_parser_init(config_parser_t *p) { memset(p, 0, sizeof(*p)); }
+
+int config_parser_feed(config_parser_t *p, const uint8_t *data, size_t len) {
+    for (size_t i = 0; i < len && p->error == CONFIG_PARSER_OK; i++) {
+        uint8_t c = data[i];
+
+        if (p->format == CONFIG_FMT_UNKNOWN) {
+            if (c == MCFG_MAGIC) {
+                p->format = CONFIG_FMT_BINARY;
+            } else if (c == '{') {
+                p->format = CONFIG_FMT_JSON;
+            } else if (c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+                fail(p, CONFIG_PARSER_ERR_FORMAT);
+                break;
+            } else {
+                continue;
+            }
+        }
+
+        if (p->format == CONFIG_FMT_BINARY) {
+            bin_feed(p, c);
+        } else {
+            json_feed(p, c);
+        }
+    }
+
+    p->consumed += len;
+    return p->error;
+}
+
+int config_parser_finish(config_parser_t *p, config_update_t *out) {
+    if (p->error != CONFIG_PARSER_OK) {
+        return p->error;
+    }
+
+    if (p->format == CONFIG_FMT_BINARY && p->bin_state != BIN_TAG) {
+        return CONFIG_PARSER_ERR_INCOMPLETE;
+    }
+
+    if (p->format == CONFIG_FMT_JSON) {
+        if (!p->done) {
+            return CONFIG_PARSER_ERR_INCOMPLETE;
+        }
+        if ((p->seen & (SEEN_TIME_HH | SEEN_TIME_MM)) ==
+            (SEEN_TIME_HH | SEEN_TIME_MM)) {
+            p->update.present |= MCFG_HAS_TIME;
+        }
+        if ((p->seen & (SEEN_ALARM_HH | SEEN_ALARM_MM)) ==
+            (SEEN_ALARM_HH | SEEN_ALARM_MM)) {
+            p->update.present |= MCFG_HAS_ALARM;
+        }
+    }
+
+    if (p->format == CONFIG_FMT_UNKNOWN) {
+        return CONFIG_PARSER_ERR_INCOMPLETE;
+    }
+
+    *out = p->update;
+    return CONFIG_PARSER_OK;
+}
@@ -5,19 +5,75 @@
  */
 /* Includes */
 #include "gap.h"
+#include "clock_core.h"
 #include "common.h"
+#include "driver/gpio.h"
+#include "esp_sleep.h"
+#include "esp_timer.h"
 #include "gatt_svc.h"
 
+/* Private types */
+typedef enum {
+    ADV_PHASE_OFF = 0,
+    ADV_PHASE_FAST,
+    ADV_PHASE_SLOW,
+    ADV_PHASE_CONNECTED,
+    ADV_PHASE_COUNT,
+} adv_phase_t;
+
 /* Private function declarations */
 inline static void format_addr(char *addr_str, uint8_t addr[]);
 static void print_conn_desc(struct ble_gap_conn_desc *desc);
-static void start_advertising(void);
+static void start_advertising(adv_phase_t phase);
+static void set_adv_phase(adv_phase_t phase);
+static void log_adv_duty(void);
+static void adv_step_down(void);
+static void adv_wake_cb(struct ble_npl_event *ev);
+#if CONFIG_ADV_WAKE_GPIO >= 0
+static void adv_wake_isr(void *arg);
+#endif
+static const char *profile_name(gap_conn_profile_t profile);
+static int set_conn_profile(uint16_t conn_handle, gap_conn_profile_t profile);
+static void start_fast_link(uint16_t conn_handle);
+static void profile_idle_cb(struct ble_npl_event *ev);
 static int gap_event_handler(struct ble_gap_event *event, void *arg);
 
 /* Private variables */
 static uint8_t own_addr_type;
 static uint8_t addr_val[6] = {0};
-static uint8_t esp_uri[] = {BLE_GAP_URI_PREFIX_HTTPS, '/', '/', 'e', 's', 'p', 'r', 'e', 's', 's', 'i', 'f', '.', 'c', 'o', 'm'};
+
+/*
+ * Requested connection parameters per profile, intervals in 1.25 ms units,
+ * supervision timeout in 10 ms units. The central has the final say, the
+ * CONN_UPDATE event logs what it granted.
+ */
+static const struct ble_gap_upd_params profile_params[] = {
+    [GAP_PROFILE_FAST] = {.itvl_min = 6,  /* 7.5 ms */
+                          .itvl_max = 12, /* 15 ms */
+                          .latency = 0,
+                          .supervision_timeout = 400},
+    [GAP_PROFILE_LOW_POWER] = {.itvl_min = 80,  /* 100 ms */
+                               .itvl_max = 160, /* 200 ms */
+                               .latency = 4,
+                               .supervision_timeout = 600},
+};
+
+/* Advertising schedule and duty cycle accounting, host task only */
+static const char *const adv_phase_names[ADV_PHASE_COUNT] = {
+    "off", "fast", "slow", "connected"};
+static adv_phase_t adv_phase = ADV_PHASE_OFF;
+static int64_t adv_phase_since_us;
+static int64_t adv_phase_us[ADV_PHASE_COUNT];
+static int64_t adv_stats_start_us;
+static struct ble_npl_event adv_wake_event;
+
+/* Profile state, only touched from the NimBLE host task */
+static struct ble_npl_callout profile_idle_timer;
+static uint16_t profile_conn = BLE_HS_CONN_HANDLE_NONE;
+static gap_conn_profile_t active_profile = GAP_PROFILE_NONE;
+static uint32_t burst_bytes;
+static int64_t burst_start_us;
+static int64_t burst_last_us;
 
 /* Private functions */
 inline static void format_addr(char *addr_str, uint8_t addr[]) {
@@ -51,10 +107,21 @@ static void print_conn_desc(struct ble_gap_conn_desc *desc) {
              desc->sec_state.bonded);
 }
 
-static void start_advertising(void) {
+/*
+ *  Advertising schedule
+ *      - fast: CONFIG_ADV_FAST_INTERVAL_MS for CONFIG_ADV_FAST_WINDOW_MS
+ *        after boot, a disconnect or a wake button press
+ *      - slow: CONFIG_ADV_SLOW_INTERVAL_MS until the next connection
+ *      - off: provisioned with CONFIG_ADV_STOP_WHEN_PROVISIONED, until woken
+ */
+static void start_advertising(adv_phase_t phase) {
     /* Local variables */
     int rc = 0;
     const char *name;
+    uint32_t itvl_ms = phase == ADV_PHASE_FAST ? CONFIG_ADV_FAST_INTERVAL_MS
+                                               : CONFIG_ADV_SLOW_INTERVAL_MS;
+    int32_t duration_ms =
+        phase == ADV_PHASE_FAST ? CONFIG_ADV_FAST_WINDOW_MS : BLE_HS_FOREVER;
     struct ble_hs_adv_fields adv_fields = {0};
     struct ble_hs_adv_fields rsp_fields = {0};
     struct ble_gap_adv_params adv_params = {0};
@@ -62,24 +129,15 @@ static void start_advertising(void) {
     /* Set advertising flags */
     adv_fields.flags = BLE_HS_ADV_F_DISC_GEN | BLE_HS_ADV_F_BREDR_UNSUP;
 
-    /* Set device name */
-    name = ble_svc_gap_device_name();
-    adv_fields.name = (uint8_t *)name;
-    adv_fields.name_len = strlen(name);
-    adv_fields.name_is_complete = 1;
+    /* Advertise the config service so scanners can filter on it */
+    adv_fields.uuids128 = &config_svc_uuid;
+    adv_fields.num_uuids128 = 1;
+    adv_fields.uuids128_is_complete = 1;
 
     /* Set device tx power */
     adv_fields.tx_pwr_lvl = BLE_HS_ADV_TX_PWR_LVL_AUTO;
     adv_fields.tx_pwr_lvl_is_present = 1;
 
-    /* Set device appearance */
-    adv_fields.appearance = BLE_GAP_APPEARANCE_GENERIC_TAG;
-    adv_fields.appearance_is_present = 1;
-
-    /* Set device LE role */
-    adv_fields.le_role = BLE_GAP_LE_ROLE_PERIPHERAL;
-    adv_fields.le_role_is_present = 1;
-
     /* Set advertiement fields */
     rc = ble_gap_adv_set_fields(&adv_fields);
     if (rc != 0) {
@@ -87,17 +145,25 @@ static void start_advertising(void) {
         return;
     }
 
-    /* Set device address */
-    rsp_fields.device_addr = addr_val;
-    rsp_fields.device_addr_type = own_addr_type;
-    rsp_fields.device_addr_is_present = 1;
+    /*
+     * The 128-bit UUID fills most of the advertising packet, the name and
+     * the rest of the device info go into the scan response
+     */
+    name = ble_svc_gap_device_name();
+    rsp_fields.name = (uint8_t *)name;
+    rsp_fields.name_len = strlen(name);
+    rsp_fields.name_is_complete = 1;
 
-    /* Set URI */
-    rsp_fields.uri = esp_uri;
-    rsp_fields.uri_len = sizeof(esp_uri);
+    /* Set device appearance */
+    rsp_fields.appearance = BLE_GAP_APPEARANCE_GENERIC_TAG;
+    rsp_fields.appearance_is_present = 1;
+
+    /* Set device LE role */
+    rsp_fields.le_role = BLE_GAP_LE_ROLE_PERIPHERAL;
+    rsp_fields.le_role_is_present = 1;
 
     /* Set advertising interval */
-    rsp_fields.adv_itvl = BLE_GAP_ADV_ITVL_MS(500);
+    rsp_fields.adv_itvl = BLE_GAP_ADV_ITVL_MS(itvl_ms);
     rsp_fields.adv_itvl_is_present = 1;
 
     /* Set scan response fields */
@@ -112,17 +178,188 @@ static void start_advertising(void) {
     adv_params.disc_mode = BLE_GAP_DISC_MODE_GEN;
 
     /* Set advertising interval */
-    adv_params.itvl_min = BLE_GAP_ADV_ITVL_MS(500);
-    adv_params.itvl_max = BLE_GAP_ADV_ITVL_MS(510);
+    adv_params.itvl_min = BLE_GAP_ADV_ITVL_MS(itvl_ms);
+    adv_params.itvl_max = BLE_GAP_ADV_ITVL_MS(itvl_ms + 10);
+
+    /* Restarting with new parameters, e.g. woken while slow */
+    if (ble_gap_adv_active()) {
+        ble_gap_adv_stop();
+    }
 
-    /* Start advertising */
-    rc = ble_gap_adv_start(own_addr_type, NULL, BLE_HS_FOREVER, &adv_params,
+    /* Start advertising, the fast phase ends with ADV_COMPLETE */
+    rc = ble_gap_adv_start(own_addr_type, NULL, duration_ms, &adv_params,
                            gap_event_handler, NULL);
     if (rc != 0) {
         ESP_LOGE(TAG, "failed to start advertising, error code: %d", rc);
         return;
     }
-    ESP_LOGI(TAG, "advertising started!");
+    ESP_LOGI(TAG, "advertising started, %s, %lu ms interval!",
+             adv_phase_names[phase], (unsigned long)itvl_ms);
+    set_adv_phase(phase);
+}
+
+static void set_adv_phase(adv_phase_t phase) {
+    int64_t now_us = esp_timer_get_time();
+
+    if (adv_stats_start_us == 0) {
+        adv_stats_start_us = now_us;
+    } else {
+        adv_phase_us[adv_phase] += now_us - adv_phase_since_us;
+    }
+    adv_phase_since_us = now_us;
+
+    if (phase != adv_phase) {
+        adv_phase = phase;
+        log_adv_duty();
+    }
+}
+
+/*
+ * Average advertising duty cycle since boot: time spent in each phase
+ * divided by its event period (interval, half the interval spread and the
+ * 0-10 ms advDelay on average), times the radio time of one event
+ */
+static void log_adv_duty(void) {
+    /* Local variables */
+    int64_t total_us = esp_timer_get_time() - adv_stats_start_us;
+    int64_t events = 0;
+    int64_t duty_ppm = 0;
+
+    events += adv_phase_us[ADV_PHASE_FAST] /
+              ((CONFIG_ADV_FAST_INTERVAL_MS + 10) * 1000LL);
+    events += adv_phase_us[ADV_PHASE_SLOW] /
+              ((CONFIG_ADV_SLOW_INTERVAL_MS + 10) * 1000LL);
+    if (total_us > 0) {
+        duty_ppm = events * GAP_ADV_EVENT_US * 1000000LL / total_us;
+    }
+
+    ESP_LOGI(TAG,
+             "adv now %s; fast %lld s, slow %lld s, off %lld s, connected "
+             "%lld s; ~%lld events, duty %lld.%04lld%%",
+             adv_phase_names[adv_phase], adv_phase_us[ADV_PHASE_FAST] / 1000000,
+             adv_phase_us[ADV_PHASE_SLOW] / 1000000,
+             adv_phase_us[ADV_PHASE_OFF] / 1000000,
+             adv_phase_us[ADV_PHASE_CONNECTED] / 1000000, events,
+             duty_ppm / 10000, duty_ppm % 10000);
+}
+
+/* Fast window over without a connection */
+static void adv_step_down(void) {
+#if CONFIG_ADV_STOP_WHEN_PROVISIONED
+    if (clock_core_provisioned()) {
+        ESP_LOGI(TAG, "provisioned, advertising stopped until woken");
+        set_adv_phase(ADV_PHASE_OFF);
+        return;
+    }
+#endif
+    start_advertising(ADV_PHASE_SLOW);
+}
+
+/* Wake button, runs on the host task; also snoozes a ringing alarm */
+static void adv_wake_cb(struct ble_npl_event *ev) {
+    clock_core_snooze();
+    if (!ble_hs_synced() || adv_phase == ADV_PHASE_CONNECTED) {
+        return;
+    }
+    ESP_LOGI(TAG, "wake button, fast advertising");
+    start_advertising(ADV_PHASE_FAST);
+}
+
+#if CONFIG_ADV_WAKE_GPIO >= 0
+static void adv_wake_isr(void *arg) {
+    ble_npl_eventq_put(nimble_port_get_dflt_eventq(), &adv_wake_event);
+}
+#endif
+
+static const char *profile_name(gap_conn_profile_t profile) {
+    switch (profile) {
+    case GAP_PROFILE_FAST:
+        return "fast";
+    case GAP_PROFILE_LOW_POWER:
+        return "low-power";
+    default:
+        return "none";
+    }
+}
+
+static int set_conn_profile(uint16_t conn_handle, gap_conn_profile_t profile) {
+    /* Local variables */
+    int rc = 0;
+
+    if (conn_handle == profile_conn && profile == active_profile) {
+        return 0;
+    }
+
+    rc = ble_gap_update_params(conn_handle, &profile_params[profile]);
+    if (rc != 0) {
+        ESP_LOGW(TAG, "failed to request %s connection profile, error code: %d",
+                 profile_name(profile), rc);
+        return rc;
+    }
+
+    profile_conn = conn_handle;
+    active_profile = profile;
+    ESP_LOGI(TAG, "requested %s connection profile", profile_name(profile));
+    return rc;
+}
+
+/*
+ * Right after connecting the central discovers services and usually writes
+ * a config, so start with the fast profile: longest LL packets, the largest
+ * ATT MTU and the 2M PHY where the controller has it
+ */
+static void start_fast_link(uint16_t conn_handle) {
+    /* Local variables */
+    int rc = 0;
+
+    rc = ble_gap_set_data_len(conn_handle, BLE_HCI_SET_DATALEN_TX_OCTETS_MAX,
+                              BLE_HCI_SET_DATALEN_TX_TIME_MAX);
+    if (rc != 0) {
+        ESP_LOGW(TAG, "failed to set data length, error code: %d", rc);
+    }
+
+    /* The central may have started the exchange already */
+    rc = ble_gattc_exchange_mtu(conn_handle, NULL, NULL);
+    if (rc != 0 && rc != BLE_HS_EALREADY) {
+        ESP_LOGW(TAG, "failed to exchange mtu, error code: %d", rc);
+    }
+
+#if MYNEWT_VAL(BLE_LL_CFG_FEAT_LE_2M_PHY)
+    rc = ble_gap_set_prefered_le_phy(conn_handle, BLE_GAP_LE_PHY_2M_MASK,
+                                     BLE_GAP_LE_PHY_2M_MASK,
+                                     BLE_GAP_LE_PHY_CODED_ANY);
+    if (rc != 0) {
+        ESP_LOGW(TAG, "failed to prefer 2M PHY, error code: %d", rc);
+    }
+#endif
+
+    set_conn_profile(conn_handle, GAP_PROFILE_FAST);
+    ble_npl_callout_reset(&profile_idle_timer,
+                          ble_npl_time_ms_to_ticks32(GAP_PROFILE_IDLE_MS));
+}
+
+/* Config link went quiet: report the burst, drop to the low-power profile */
+static void profile_idle_cb(struct ble_npl_event *ev) {
+    /* Local variables */
+    int64_t span_us = burst_last_us - burst_start_us;
+
+    if (burst_bytes > 0) {
+        ESP_LOGI(TAG, "config burst: %lu bytes in %lld ms, %lld B/s (%s profile)",
+                 (unsigned long)burst_bytes, span_us / 1000,
+                 span_us > 0 ? (int64_t)burst_bytes * 1000000 / span_us : 0,
+                 profile_name(active_profile));
+        burst_bytes = 0;
+    }
+
+    if (profile_conn == BLE_HS_CONN_HANDLE_NONE) {
+        return;
+    }
+
+    /* Another procedure may be pending, try again later */
+    if (set_conn_profile(profile_conn, GAP_PROFILE_LOW_POWER) != 0) {
+        ble_npl_callout_reset(&profile_idle_timer,
+                              ble_npl_time_ms_to_ticks32(GAP_PROFILE_IDLE_MS));
+    }
 }
 
 /*
@@ -159,24 +396,15 @@ static int gap_event_handler(struct ble_gap_event *event, void *arg) {
             /* Print connection descriptor */
             print_conn_desc(&desc);
 
-            /* Try to update connection parameters */
-            struct ble_gap_upd_params params = {.itvl_min = desc.conn_itvl,
-                                                .itvl_max = desc.conn_itvl,
-                                                .latency = 3,
-                                                .supervision_timeout =
-                                                    desc.supervision_timeout};
-            rc = ble_gap_update_params(event->connect.conn_handle, &params);
-            if (rc != 0) {
-                ESP_LOGE(
-                    TAG,
-                    "failed to update connection parameters, error code: %d",
-                    rc);
-                return rc;
-            }
+            /* Legacy advertising ends with the connection */
+            set_adv_phase(ADV_PHASE_CONNECTED);
+
+            /* Fast profile until the link goes idle */
+            start_fast_link(event->connect.conn_handle);
         }
         /* Connection failed, restart advertising */
         else {
-            start_advertising();
+            start_advertising(ADV_PHASE_FAST);
         }
         return rc;
 
@@ -186,8 +414,15 @@ static int gap_event_handler(struct ble_gap_event *event, void *arg) {
         ESP_LOGI(TAG, "disconnected from peer; reason=%d",
                  event->disconnect.reason);
 
-        /* Restart advertising */
-        start_advertising();
+        if (event->disconnect.conn.conn_handle == profile_conn) {
+            ble_npl_callout_stop(&profile_idle_timer);
+            profile_conn = BLE_HS_CONN_HANDLE_NONE;
+            active_profile = GAP_PROFILE_NONE;
+            burst_bytes = 0;
+        }
+
+        /* Restart advertising, fast so the app can reconnect quickly */
+        start_advertising(ADV_PHASE_FAST);
         return rc;
 
     /* Connection parameters update event */
@@ -204,14 +439,35 @@ static int gap_event_handler(struct ble_gap_event *event, void *arg) {
             return rc;
         }
         print_conn_desc(&desc);
+        ESP_LOGI(TAG, "%s profile active, interval %d.%02d ms",
+                 profile_name(active_profile), desc.conn_itvl * 125 / 100,
+                 desc.conn_itvl * 125 % 100);
+        return rc;
+
+#if MYNEWT_VAL(BLE_LL_CFG_FEAT_LE_2M_PHY)
+    /* PHY update event */
+    case BLE_GAP_EVENT_PHY_UPDATE_COMPLETE:
+        ESP_LOGI(TAG, "phy update; status=%d tx_phy=%d rx_phy=%d",
+                 event->phy_updated.status, event->phy_updated.tx_phy,
+                 event->phy_updated.rx_phy);
         return rc;
+#endif
 
     /* Advertising complete event */
     case BLE_GAP_EVENT_ADV_COMPLETE:
-        /* Advertising completed, restart advertising */
+        /* Advertising completed: fast window over, or restart */
         ESP_LOGI(TAG, "advertise complete; reason=%d",
                  event->adv_complete.reason);
-        start_advertising();
+        if (adv_phase == ADV_PHASE_CONNECTED) {
+            return rc;
+        }
+        if (adv_phase == ADV_PHASE_FAST &&
+            event->adv_complete.reason == BLE_HS_ETIMEOUT) {
+            adv_step_down();
+        } else {
+            start_advertising(adv_phase == ADV_PHASE_SLOW ? ADV_PHASE_SLOW
+                                                          : ADV_PHASE_FAST);
+        }
         return rc;
 
     /* Notification sent event */
@@ -285,13 +541,56 @@ void adv_init(void) {
     ESP_LOGI(TAG, "device address: %s", addr_str);
 
     /* Start advertising. */
-    start_advertising();
+    start_advertising(ADV_PHASE_FAST);
+}
+
+/*
+ * Config write of len bytes on conn_handle: switch to the fast profile if
+ * the link had dropped to low power, and push back the idle timeout.
+ * Called from GATT access callbacks, i.e. the NimBLE host task.
+ */
+void gap_config_activity(uint16_t conn_handle, uint16_t len) {
+    int64_t now_us = esp_timer_get_time();
+
+    if (burst_bytes == 0) {
+        burst_start_us = now_us;
+    }
+    burst_bytes += len;
+    burst_last_us = now_us;
+
+    set_conn_profile(conn_handle, GAP_PROFILE_FAST);
+    ble_npl_callout_reset(&profile_idle_timer,
+                          ble_npl_time_ms_to_ticks32(GAP_PROFILE_IDLE_MS));
 }
 
+gap_conn_profile_t gap_conn_profile(void) { return active_profile; }
+
 int gap_init(void) {
     /* Local variables */
     int rc = 0;
 
+    /* Idle timer runs on the host task, like the GAP and GATT callbacks */
+    ble_npl_callout_init(&profile_idle_timer, nimble_port_get_dflt_eventq(),
+                         profile_idle_cb, NULL);
+
+    /* Wake button posts to the host task as well */
+    ble_npl_event_init(&adv_wake_event, adv_wake_cb, NULL);
+#if CONFIG_ADV_WAKE_GPIO >= 0
+    gpio_config_t wake_cfg = {
+        .pin_bit_mask = 1ULL << CONFIG_ADV_WAKE_GPIO,
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = GPIO_PULLUP_ENABLE,
+        .intr_type = GPIO_INTR_NEGEDGE,
+    };
+    gpio_config(&wake_cfg);
+    /* Already installed is fine */
+    gpio_install_isr_service(0);
+    gpio_isr_handler_add(CONFIG_ADV_WAKE_GPIO, adv_wake_isr, NULL);
+    /* The edge interrupt only fires while awake, let the press end light sleep */
+    gpio_wakeup_enable(CONFIG_ADV_WAKE_GPIO, GPIO_INTR_LOW_LEVEL);
+    esp_sleep_enable_gpio_wakeup();
+#endif
+
     /* Call NimBLE GAP initialization API */
     ble_svc_gap_init();
 
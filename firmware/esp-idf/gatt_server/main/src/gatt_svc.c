@@ -6,12 +6,16 @@
 /* Includes */
 #include "gatt_svc.h"
 #include "common.h"
+#include "esp_timer.h"
+#include "clock_core.h"
+#include "config_parser.h"
+#include "gap.h"
 
 static int config_chr_access(uint16_t conn_handle, uint16_t attr_handle,
     struct ble_gatt_access_ctxt *ctxt, void *arg);
 
 /* Automation IO service */
-static const ble_uuid128_t config_svc_uuid =
+const ble_uuid128_t config_svc_uuid =
     BLE_UUID128_INIT(0x12,0x34,0x56,0x78,
                      0x9a,0xbc,0xde,0xf0,
                      0xf0,0xde,0xbc,0x9a,
@@ -30,6 +34,11 @@ static const ble_uuid128_t config_chr_uuid =
                      0x78,0x56,0x34,0x12,
                      0xf0,0xde,0xbc,0x9a);
 
+/* Reassembly of fragmented config writes, see protocol/mustang_cfg.h */
+static uint8_t reasm_buf[CONFIG_REASM_MAX];
+static mcfg_reasm_t reasm = {.buf = reasm_buf, .cap = sizeof(reasm_buf)};
+static int64_t reasm_start_us;
+
 static const struct ble_gatt_svc_def gatt_svr_svcs[] = {
     {
         .type = BLE_GATT_SVC_TYPE_PRIMARY,
@@ -50,26 +59,125 @@ static const struct ble_gatt_svc_def gatt_svr_svcs[] = {
     {0}  /* <-- KRAJ SERVICES */
 };
 
+/*
+ *  Config parsing
+ *      Unfragmented writes are fed to the streaming parser straight from the
+ *      mbuf chain. Fragmented writes are reassembled into reasm_buf first,
+ *      then parsed in one go once the CRC matches. The decoded update is
+ *      handed to the clock core task; nothing is applied on the host task.
+ */
+static int parse_and_post(config_parser_t *parser) {
+    config_update_t update;
+    int rc = config_parser_finish(parser, &update);
+
+    if (rc != CONFIG_PARSER_OK) {
+        ESP_LOGW(TAG, "config rejected, rc=%d", rc);
+        return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+    }
+    if (clock_core_post_config(&update) != 0) {
+        return BLE_ATT_ERR_INSUFFICIENT_RES;
+    }
+    return 0;
+}
+
+static int config_fragment_access(struct os_mbuf *om) {
+    /* Access callbacks run on the NimBLE host task only */
+    static config_parser_t parser;
+    uint8_t hdr[MCFG_FRAG_FIRST_LEN];
+    uint16_t hdr_len = OS_MBUF_PKTLEN(om);
+    uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    uint16_t skip;
+    int rc;
+
+    /* Magic and sequence number at least, before hdr is looked at */
+    if (hdr_len < MCFG_FRAG_HEADER_LEN) {
+        ESP_LOGW(TAG, "fragment dropped, %u bytes", hdr_len);
+        return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+    }
+    if (hdr_len > sizeof(hdr)) {
+        hdr_len = sizeof(hdr);
+    }
+    os_mbuf_copydata(om, 0, hdr_len, hdr);
+
+    if (hdr[1] == 0) {
+        reasm_start_us = esp_timer_get_time();
+    }
+
+    rc = mcfg_reasm_start(&reasm, hdr, hdr_len, now_ms);
+    if (rc < 0) {
+        ESP_LOGW(TAG, "fragment %u dropped, rc=%d", hdr[1], rc);
+        return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+    }
+
+    /* Copy the payload segment by segment, skipping the fragment header */
+    skip = rc;
+    for (; om != NULL && rc >= 0; om = SLIST_NEXT(om, om_next)) {
+        if (om->om_len <= skip) {
+            skip -= om->om_len;
+            continue;
+        }
+        rc = mcfg_reasm_append(&reasm, om->om_data + skip, om->om_len - skip);
+        skip = 0;
+    }
+    if (rc >= 0) {
+        rc = mcfg_reasm_end(&reasm);
+    }
+
+    if (rc == MCFG_FRAG_MORE) {
+        return 0;
+    }
+    if (rc != MCFG_OK) {
+        ESP_LOGW(TAG, "fragmented config dropped, rc=%d", rc);
+        return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+    }
+
+    int64_t elapsed_us = esp_timer_get_time() - reasm_start_us;
+    ESP_LOGI(TAG, "reassembled %u bytes in %u fragments, %lld us, %lld B/s",
+             (unsigned)reasm.len, reasm.next_seq, elapsed_us,
+             elapsed_us > 0 ? (int64_t)reasm.len * 1000000 / elapsed_us : 0);
+
+    config_parser_init(&parser);
+    config_parser_feed(&parser, reasm.buf, reasm.len);
+    return parse_and_post(&parser);
+}
+
 static int
 config_chr_access(uint16_t conn_handle, uint16_t attr_handle,
                   struct ble_gatt_access_ctxt *ctxt, void *arg)
 {
+    /* Access callbacks run on the NimBLE host task only, keep it off the stack */
+    static config_parser_t parser;
+    struct os_mbuf *om;
+    uint8_t first = 0;
+
     if (ctxt->op != BLE_GATT_ACCESS_OP_WRITE_CHR) {
         return BLE_ATT_ERR_UNLIKELY;
     }
 
-    char buf[128] = {0};
-    int len = OS_MBUF_PKTLEN(ctxt->om);
+    gap_config_activity(conn_handle, OS_MBUF_PKTLEN(ctxt->om));
 
-    if (len >= sizeof(buf)) {
-        return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+    os_mbuf_copydata(ctxt->om, 0, 1, &first);
+    if (first == MCFG_FRAG_MAGIC) {
+        return config_fragment_access(ctxt->om);
     }
 
-    ble_hs_mbuf_to_flat(ctxt->om, buf, sizeof(buf) - 1, NULL);
+    int64_t t0 = esp_timer_get_time();
 
-    ESP_LOGI(TAG, "STRING RX (%d bytes): %s", len, buf);
+    config_parser_init(&parser);
+    for (om = ctxt->om; om != NULL; om = SLIST_NEXT(om, om_next)) {
+        if (config_parser_feed(&parser, om->om_data, om->om_len) !=
+            CONFIG_PARSER_OK) {
+            break;
+        }
+    }
 
-    return 0;
+    int64_t t1 = esp_timer_get_time();
+
+    ESP_LOGI(TAG, "%s RX (%u bytes) parsed in %lld us",
+             parser.format == CONFIG_FMT_BINARY ? "BINARY" : "JSON",
+             (unsigned)parser.consumed, t1 - t0);
+
+    return parse_and_post(&parser);
 }
 
 /*
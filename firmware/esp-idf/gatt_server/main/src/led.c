@@ -66,6 +66,14 @@ void led_init(void) {
     led_off();
 }
 
+void led_deinit(void) {
+    led_off();
+
+    /* Disables the RMT channel, which releases its PM lock */
+    ESP_ERROR_CHECK(led_strip_del(led_strip));
+    led_strip = NULL;
+}
+
 #elif CONFIG_BLINK_LED_GPIO
 
 void led_on(void) { gpio_set_level(CONFIG_BLINK_GPIO, true); }
@@ -79,6 +87,8 @@ void led_init(void) {
     gpio_set_direction(CONFIG_BLINK_GPIO, GPIO_MODE_OUTPUT);
 }
 
+void led_deinit(void) { led_off(); }
+
 #else
 #error "unsupported LED type"
 #endif
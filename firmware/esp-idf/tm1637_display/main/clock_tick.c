@@ -0,0 +1,86 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_log.h"
+
+#include "clock_tick.h"
+
+#define TAG "CLOCK_TICK"
+
+/* ===== GLOBALS ===== */
+static clock_subscriber_t m_subscribers[CLOCK_TICK_MAX_SUBSCRIBERS];
+static uint32_t m_subscriberCount;
+static portMUX_TYPE m_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static uint32_t m_seq;
+static uint32_t m_snapshot;   // hours << 16 | minutes << 8 | seconds
+
+/* ===== PUBLIC ===== */
+clock_subscriber_t *ClockTick_subscribe(const char *name)
+{
+    QueueHandle_t queue = xQueueCreate(CLOCK_TICK_QUEUE_LEN, sizeof(clock_tick_t));
+    if (queue == NULL)
+        return NULL;
+
+    clock_subscriber_t *sub = NULL;
+
+    portENTER_CRITICAL(&m_lock);
+    if (m_subscriberCount < CLOCK_TICK_MAX_SUBSCRIBERS) {
+        sub = &m_subscribers[m_subscriberCount];
+        sub->name = name;
+        sub->queue = queue;
+        sub->lastSeq = m_seq;
+        sub->dropped = 0;
+        // Publish only sees the slot once it is filled in
+        __atomic_store_n(&m_subscriberCount, m_subscriberCount + 1, __ATOMIC_RELEASE);
+    }
+    portEXIT_CRITICAL(&m_lock);
+
+    if (sub == NULL) {
+        ESP_LOGE(TAG, "no free subscriber slot for %s", name);
+        vQueueDelete(queue);
+    }
+
+    return sub;
+}
+
+bool ClockTick_wait(clock_subscriber_t *sub, clock_tick_t *tick, TickType_t timeout)
+{
+    if (xQueueReceive(sub->queue, tick, timeout) != pdTRUE)
+        return false;
+
+    if (tick->seq != sub->lastSeq + 1)
+        ESP_LOGW(TAG, "%s missed %" PRIu32 " tick(s)", sub->name, tick->seq - sub->lastSeq - 1);
+    sub->lastSeq = tick->seq;
+
+    return true;
+}
+
+void ClockTick_publish(const clock_time_t *time)
+{
+    clock_tick_t tick = {
+        .seq = ++m_seq,
+        .time = *time,
+    };
+
+    __atomic_store_n(&m_snapshot,
+                     ((uint32_t)time->hours << 16) | ((uint32_t)time->minutes << 8) | time->seconds,
+                     __ATOMIC_RELEASE);
+
+    uint32_t count = __atomic_load_n(&m_subscriberCount, __ATOMIC_ACQUIRE);
+    for (uint32_t i = 0; i < count; i++) {
+        if (xQueueSend(m_subscribers[i].queue, &tick, 0) != pdTRUE)
+            m_subscribers[i].dropped++;
+    }
+}
+
+clock_time_t ClockTick_now(void)
+{
+    uint32_t v = __atomic_load_n(&m_snapshot, __ATOMIC_ACQUIRE);
+    clock_time_t time = {
+        .hours = (v >> 16) & 0xff,
+        .minutes = (v >> 8) & 0xff,
+        .seconds = v & 0xff,
+    };
+    return time;
+}
@@ -0,0 +1,51 @@
+#ifndef __CLOCK_TICK__
+#define __CLOCK_TICK__
+
+/*
+ * One-to-many distribution of the clock tick.
+ *
+ * Every subscriber owns a small queue, ClockTick_publish pushes each tick
+ * into all of them, so every task sees every second. Ticks carry a
+ * sequence number; a subscriber that falls more than CLOCK_TICK_QUEUE_LEN
+ * ticks behind gets its overflow counted instead of silently losing time.
+ * The latest time is also published as an atomic snapshot for readers that
+ * only need "now".
+ */
+
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+#define CLOCK_TICK_MAX_SUBSCRIBERS 6
+#define CLOCK_TICK_QUEUE_LEN       4
+
+typedef struct {
+    uint8_t hours;
+    uint8_t minutes;
+    uint8_t seconds;
+} clock_time_t;
+
+typedef struct {
+    uint32_t seq;
+    clock_time_t time;
+} clock_tick_t;
+
+typedef struct {
+    const char *name;
+    QueueHandle_t queue;
+    uint32_t lastSeq;
+    uint32_t dropped;    // ticks lost to a full queue
+} clock_subscriber_t;
+
+// Safe to call at any time, also after ticks are already flowing
+clock_subscriber_t *ClockTick_subscribe(const char *name);
+bool ClockTick_wait(clock_subscriber_t *sub, clock_tick_t *tick, TickType_t timeout);
+
+// Called from the single tick source (timer task context)
+void ClockTick_publish(const clock_time_t *time);
+
+clock_time_t ClockTick_now(void);
+
+#endif
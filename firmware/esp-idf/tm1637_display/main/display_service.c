@@ -0,0 +1,265 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "driver/gpio.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+#include "display_service.h"
+
+#define TAG "DISPLAY"
+
+/* ===== GLOBALS ===== */
+static QueueHandle_t m_queue = NULL;
+static uint32_t m_dropped;
+
+static uint8_t m_pinClk;
+static uint8_t m_pinDIO;
+static tm1637_transport_t m_transport;
+
+/* Owned by the service task only */
+static display_cmd_t m_state = {
+    .brightness = 0x0b,
+};
+static uint8_t m_blinkStep;
+static uint16_t m_blinkRemaining;
+static mfx_player_t m_fx;
+
+static esp_timer_handle_t m_fxTimer;
+static int64_t m_fxStartUs;
+static uint32_t m_fxTicks;              // ticks played since m_fxStartUs
+
+/* ===== EFFECTS ===== */
+static void FxTimerCallback(void *arg)
+{
+    display_cmd_t cmd = { .fields = DISPLAY_F_STEP };
+
+    // A full queue only delays the step, stepEffect() catches up
+    xQueueSend(m_queue, &cmd, 0);
+}
+
+static void playEffect(const display_cmd_t *cmd)
+{
+    esp_timer_stop(m_fxTimer);
+
+    if (cmd->fx == NULL) {
+        mfx_stop(&m_fx);
+        return;
+    }
+    if (mfx_start(&m_fx, cmd->fx, cmd->fxLen, m_state.brightness) < 0) {
+        ESP_LOGW(TAG, "effect rejected, %u bytes", cmd->fxLen);
+        return;
+    }
+    if (m_fx.running) {
+        m_fxStartUs = esp_timer_get_time();
+        m_fxTicks = 0;
+        esp_timer_start_periodic(m_fxTimer, MFX_TICK_MS * 1000);
+    }
+}
+
+// Ticks follow the clock, not the step count, so a late wakeup or a dropped
+// step does not stretch the effect
+static void stepEffect(void)
+{
+    uint32_t due = (esp_timer_get_time() - m_fxStartUs) / (MFX_TICK_MS * 1000);
+
+    while (m_fx.running && m_fxTicks < due) {
+        mfx_tick(&m_fx);
+        m_fxTicks++;
+    }
+    if (!m_fx.running)
+        esp_timer_stop(m_fxTimer);
+}
+
+/* ===== RENDER ===== */
+// Returns true when the command restarts the blink pattern
+static bool merge(const display_cmd_t *cmd)
+{
+    if (cmd->fields & DISPLAY_F_DIGITS)
+        memcpy(m_state.digits, cmd->digits, DISPLAY_DIGITS);
+
+    if (cmd->fields & DISPLAY_F_BRIGHTNESS) {
+        m_state.brightness = cmd->brightness;
+        m_fx.base_level = cmd->brightness;   // what a running effect ends on
+    }
+
+    if (cmd->fields & DISPLAY_F_FX)
+        playEffect(cmd);
+
+    if (cmd->fields & DISPLAY_F_STEP)
+        stepEffect();
+
+    if (cmd->fields & DISPLAY_F_BLINK) {
+        m_state.blinkPattern = cmd->blinkPattern;
+        m_state.blinkSteps = cmd->blinkSteps;
+        m_blinkStep = 0;
+        m_blinkRemaining = cmd->blinkSteps;
+        return true;
+    }
+    return false;
+}
+
+static void render(void)
+{
+    static const uint8_t blank[DISPLAY_DIGITS] = {0};
+    bool visible = m_state.blinkPattern == 0 ||
+                   ((m_state.blinkPattern >> (m_blinkStep & 0x07)) & 0x01);
+    const uint8_t *digits = visible ? m_state.digits : blank;
+    uint8_t brightness = m_state.brightness;
+
+    // A running effect draws over the clock; outputs have no line on this board
+    if (m_fx.running) {
+        digits = m_fx.clock ? digits : m_fx.digits;
+        brightness = m_fx.level;
+    }
+
+    int64_t t0 = esp_timer_get_time();
+    TM1637_setBrightness(brightness & 0x07, brightness & 0x08);
+    TM1637_setSegments(digits, DISPLAY_DIGITS, 0);
+#if CONFIG_PM_ENABLE
+    // Frame out before the task blocks, the transport drops its PM lock
+    TM1637_waitIdle(-1);
+#endif
+    ESP_LOGD(TAG, "render blocked %lld us", esp_timer_get_time() - t0);
+}
+
+static void advanceBlink(void)
+{
+    m_blinkStep++;
+
+    if (m_state.blinkSteps != 0 && --m_blinkRemaining == 0)
+        m_state.blinkPattern = 0;
+}
+
+/* ===== SERVICE TASK ===== */
+static void DisplayServiceTask(void *pvParameters)
+{
+    display_cmd_t cmd;
+    TickType_t nextStep = 0;
+
+    TM1637_InitTransport(m_pinClk, m_pinDIO, DEFAULT_BIT_DELAY, m_transport);
+#if CONFIG_PM_ENABLE
+    // Lines keep their idle level through light sleep, no spurious frames
+    gpio_sleep_sel_dis(m_pinClk);
+    gpio_sleep_sel_dis(m_pinDIO);
+#endif
+    render();
+
+    while (1) {
+        TickType_t wait = portMAX_DELAY;
+
+        if (m_state.blinkPattern != 0) {
+            TickType_t now = xTaskGetTickCount();
+            wait = (int32_t)(nextStep - now) > 0 ? nextStep - now : 0;
+        }
+
+        if (xQueueReceive(m_queue, &cmd, wait) == pdTRUE) {
+            bool restart = merge(&cmd);
+
+            // Coalesce the rest of the burst into one frame
+            while (xQueueReceive(m_queue, &cmd, 0) == pdTRUE)
+                restart |= merge(&cmd);
+
+            if (restart)
+                nextStep = xTaskGetTickCount() + pdMS_TO_TICKS(DISPLAY_BLINK_STEP_MS);
+        } else {
+            advanceBlink();
+            nextStep += pdMS_TO_TICKS(DISPLAY_BLINK_STEP_MS);
+        }
+
+        render();
+    }
+}
+
+/* ===== PUBLIC ===== */
+bool Display_start(uint8_t pinClk,
+                   uint8_t pinDIO,
+                   tm1637_transport_t transport)
+{
+    m_pinClk = pinClk;
+    m_pinDIO = pinDIO;
+    m_transport = transport;
+
+    m_queue = xQueueCreate(DISPLAY_QUEUE_LEN, sizeof(display_cmd_t));
+    if (m_queue == NULL)
+        return false;
+
+    mfx_init(&m_fx, m_state.brightness);
+    const esp_timer_create_args_t fxArgs = {
+        .callback = FxTimerCallback,
+        .name = "display_fx",
+    };
+    if (esp_timer_create(&fxArgs, &m_fxTimer) != ESP_OK)
+        return false;
+
+    return xTaskCreate(DisplayServiceTask, "DisplayService", 3072, NULL, 2, NULL) == pdPASS;
+}
+
+bool Display_post(const display_cmd_t *cmd)
+{
+    if (xQueueSend(m_queue, cmd, 0) != pdTRUE) {
+        m_dropped++;
+        ESP_LOGW(TAG, "queue full, command dropped (%" PRIu32 ")", m_dropped);
+        return false;
+    }
+    return true;
+}
+
+bool Display_showNumberDecEx(int num, uint8_t dots, bool leading_zero)
+{
+    display_cmd_t cmd = { .fields = DISPLAY_F_DIGITS };
+
+    TM1637_formatNumberDecEx(num, dots, leading_zero, DISPLAY_DIGITS, cmd.digits);
+    return Display_post(&cmd);
+}
+
+bool Display_showTime(uint8_t hours, uint8_t minutes, bool colon)
+{
+    display_cmd_t cmd = { .fields = DISPLAY_F_DIGITS };
+
+    TM1637_encodeTime(hours, minutes, colon, true, cmd.digits);
+    return Display_post(&cmd);
+}
+
+bool Display_setBrightness(uint8_t brightness, bool on)
+{
+    display_cmd_t cmd = {
+        .fields = DISPLAY_F_BRIGHTNESS,
+        .brightness = (brightness & 0x07) | (on ? 0x08 : 0x00),
+    };
+    return Display_post(&cmd);
+}
+
+bool Display_blink(uint8_t pattern, uint16_t steps)
+{
+    display_cmd_t cmd = {
+        .fields = DISPLAY_F_BLINK,
+        .blinkPattern = pattern,
+        .blinkSteps = steps,
+    };
+    return Display_post(&cmd);
+}
+
+bool Display_play(const uint8_t *fx, uint8_t len)
+{
+    display_cmd_t cmd = {
+        .fields = DISPLAY_F_FX,
+        .fx = fx,
+        .fxLen = len,
+    };
+    return Display_post(&cmd);
+}
+
+bool Display_stopEffect(void)
+{
+    return Display_play(NULL, 0);
+}
+
+uint32_t Display_droppedCommands(void)
+{
+    return m_dropped;
+}
@@ -0,0 +1,57 @@
+#ifndef __DISPLAY_SERVICE__
+#define __DISPLAY_SERVICE__
+
+/*
+ * Display service: a single task owns the TM1637 and renders compact
+ * commands received over a FreeRTOS queue. Bursts are coalesced, only the
+ * latest state is clocked out once per tick, so producers never block on
+ * the bus and never interleave start()/stop() sequences.
+ *
+ * Effects (mustang_fx.h) are stepped by a periodic esp_timer while one
+ * plays; the timer only posts a step, the frame is still rendered here.
+ */
+
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "tm1637.h"
+#include "mustang_fx.h"
+
+#define DISPLAY_DIGITS        4
+#define DISPLAY_QUEUE_LEN     8
+#define DISPLAY_BLINK_STEP_MS 150
+
+/* Which members of display_cmd_t are valid */
+#define DISPLAY_F_DIGITS      0x01
+#define DISPLAY_F_BRIGHTNESS  0x02
+#define DISPLAY_F_BLINK       0x04
+#define DISPLAY_F_FX          0x08
+#define DISPLAY_F_STEP        0x10      // effect timer tick, posted internally
+
+typedef struct {
+    uint8_t fields;                     // DISPLAY_F_* mask
+    uint8_t digits[DISPLAY_DIGITS];     // encoded segments, dots included
+    uint8_t brightness;                 // 0..7, bit 3 = display on
+    uint8_t blinkPattern;               // on/off per step, LSB first, 0 = steady
+    uint16_t blinkSteps;                // steps to run, 0 = until replaced
+    const uint8_t *fx;                  // effect program, NULL stops the effect
+    uint8_t fxLen;
+} display_cmd_t;
+
+bool Display_start(uint8_t pinClk,
+                   uint8_t pinDIO,
+                   tm1637_transport_t transport);
+
+// Non-blocking, safe from any task
+bool Display_post(const display_cmd_t *cmd);
+bool Display_showNumberDecEx(int num, uint8_t dots, bool leading_zero);
+bool Display_showTime(uint8_t hours, uint8_t minutes, bool colon);
+bool Display_setBrightness(uint8_t brightness, bool on);
+bool Display_blink(uint8_t pattern, uint16_t steps);
+// fx has to stay valid until the service picks it up, it plays a copy
+bool Display_play(const uint8_t *fx, uint8_t len);
+bool Display_stopEffect(void);
+
+uint32_t Display_droppedCommands(void);
+
+#endif
@@ -2,106 +2,141 @@
 #include <stdbool.h>
 
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
-#include "freertos/timers.h"
 
 #include "driver/gpio.h"
 
-#include "tm1637.h"
+#include "clock_tick.h"
+#include "display_service.h"
+#include "mustang_alarm.h"
+#include "power_stats.h"
+#include "timekeeping.h"
 
-/* ===== TYPES ===== */
-typedef struct {
-    uint8_t hours;
-    uint8_t minutes;
-    uint8_t seconds;
-} clock_time_t;
+/* ===== CONFIG ===== */
+#define CLOCK_START_TIME (12 * 3600)   // 12:00:00
 
-/* ===== GLOBALS ===== */
-QueueHandle_t clockQueue = NULL;
-TimerHandle_t clockTimer = NULL;
-
-/* ===== TIMER CALLBACK ===== */
-static void ClockTimerCallback(TimerHandle_t xTimer)
-{
-    static clock_time_t time = { 12, 0, 0};
-
-    time.seconds++;
+// No config channel on this board yet, one alarm at 12:01 every day
+static const uint8_t ALARM_TABLE[] = {
+    12, 1, MCFG_ALARM_DAYS_ALL, MCFG_ALARM_F_ENABLED, 0,
+};
 
-    if (time.seconds >= 60) {
-        time.seconds = 0;
-        time.minutes++;
-    }
-    if (time.minutes >= 60) {
-        time.minutes = 0;
-        time.hours++;
-    }
-    if (time.hours >= 24) {
-        time.hours = 0;
-    }
-
-    xQueueOverwrite(clockQueue, &time);
-}
+/* ===== GLOBALS ===== */
+static malarm_sched_t m_alarms;          // owned by AlarmTask
+static esp_timer_handle_t m_alarmTimer;
+static TaskHandle_t m_alarmTask;
+static volatile bool m_alarmReplan;      // wall time was stepped
 
 /* ===== DISPLAY TASK ===== */
 void DisplayTask(void *pvParameters)
 {
-    clock_time_t time;
+    clock_subscriber_t *sub = pvParameters;
+    clock_tick_t tick;
     uint8_t colon = 0x1;
 
     while (1) {
-        if (xQueueReceive(clockQueue, &time, portMAX_DELAY)) {
-            // Formatiraj broj za prikaz HHMM
-            int v = time.hours * 100 + time.minutes;
+        if (ClockTick_wait(sub, &tick, portMAX_DELAY)) {
+            const clock_time_t time = tick.time;
 
             // Blink dvotočke svake sekunde
             colon ^= 0x1;
-            uint8_t colonMask = colon ? 0x80 : 0x00;  // 0x80 pali kolon
-            ESP_LOGI("DISPLAY TASK","colon %d colonMask = %d",colon,colonMask);
+            // Debug only, a log line per second keeps the CPU awake for the UART
+            ESP_LOGD("DISPLAY TASK","colon %d",colon);
 
-            // Pokaži broj s dvotočkom
-            TM1637_showNumberDecEx(v, colonMask, true, 4, 0);
+            // Pokaži vrijeme s dvotočkom
+            Display_showTime(time.hours, time.minutes, colon);
         }
     }
 }
 
 
 /* ===== ALARM TASK ===== */
+static void AlarmTimerCallback(void *arg)
+{
+    xTaskNotifyGive(m_alarmTask);
+}
+
+// One-shot for the planned ring, so the task sleeps instead of checking ticks
+static void armAlarm(void)
+{
+    time_t at;
+
+    esp_timer_stop(m_alarmTimer);
+    if (!malarm_next(&m_alarms, &at, NULL))
+        return;
+
+    int64_t delayUs = at * TIMEKEEPING_US_PER_SEC - Timekeeping_nowUs();
+    esp_timer_start_once(m_alarmTimer, delayUs > 0 ? delayUs : 0);
+}
+
+// The planned instant belongs to the old time, AlarmTask plans it again
+static void ClockStepped(void)
+{
+    m_alarmReplan = true;
+    if (m_alarmTask != NULL)
+        xTaskNotifyGive(m_alarmTask);
+}
+
 void AlarmTask(void *pvParameters)
 {
-    clock_time_t time;
+    int64_t t0 = esp_timer_get_time();
+
+    malarm_set(&m_alarms, ALARM_TABLE, sizeof(ALARM_TABLE) / MCFG_ALARM_ENTRY_LEN,
+               Timekeeping_nowUs() / TIMEKEEPING_US_PER_SEC);
+    ESP_LOGI("ALARM", "%u alarms planned in %lld us",
+             m_alarms.count, esp_timer_get_time() - t0);
+    armAlarm();
 
     while (1) {
-        if (xQueueReceive(clockQueue, &time, portMAX_DELAY)) {
-            if (time.hours == 12 &&
-                time.minutes == 1 &&
-                time.seconds == 0) {
-                ESP_LOGW("ALARM", "⏰ ALARM!");
-            }
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        time_t now = Timekeeping_nowUs() / TIMEKEEPING_US_PER_SEC;
+        if (m_alarmReplan) {
+            m_alarmReplan = false;
+            malarm_plan(&m_alarms, now);
+            ESP_LOGI("ALARM", "clock stepped, alarms planned again");
+        }
+
+        int idx = malarm_ring(&m_alarms, now);
+        if (idx != MALARM_NONE) {
+            ESP_LOGW("ALARM", "⏰ ALARM %d!", idx);
+            // Stepped by the display service's effect timer, see mustang_fx.h
+            Display_play(MFX_ALARM_DEFAULT, sizeof(MFX_ALARM_DEFAULT));
         }
+        armAlarm();
     }
 }
 
 /* ===== MAIN ===== */
 void app_main(void)
 {
-    TM1637_Init(GPIO_NUM_13, GPIO_NUM_12, DEFAULT_BIT_DELAY);
-    TM1637_setBrightness(0x03, true);
-    clockQueue = xQueueCreate(1, sizeof(clock_time_t));
-    configASSERT(clockQueue);
-
-    clockTimer = xTimerCreate(
-        "ClockTimer",
-        pdMS_TO_TICKS(1000),
-        pdTRUE,
-        NULL,
-        ClockTimerCallback
-    );
-    configASSERT(clockTimer);
-
-    xTimerStart(clockTimer, 0);
-
-    xTaskCreate(DisplayTask, "DisplayTask", 4096, NULL, 1, NULL);
-    xTaskCreate(AlarmTask,   "AlarmTask",   4096, NULL, 1, NULL);
+    // Sleep between ticks; the TM1637 holds its latched frame on its own
+    if (power_stats_init() != ESP_OK)
+        ESP_LOGW("MAIN", "running without light sleep");
+
+#if CONFIG_TM1637_TRANSPORT_RMT
+    Display_start(GPIO_NUM_13, GPIO_NUM_12, TM1637_TRANSPORT_RMT);
+#else
+    Display_start(GPIO_NUM_13, GPIO_NUM_12, TM1637_TRANSPORT_BITBANG);
+#endif
+    Display_setBrightness(0x03, true);
+
+    clock_subscriber_t *displaySub = ClockTick_subscribe("DisplayTask");
+    configASSERT(displaySub);
+
+    bool started = Timekeeping_start(CLOCK_START_TIME);
+    configASSERT(started);
+    Timekeeping_onStep(ClockStepped);
+
+    const esp_timer_create_args_t alarmArgs = {
+        .callback = AlarmTimerCallback,
+        .name = "alarm",
+    };
+    bool alarmTimer = esp_timer_create(&alarmArgs, &m_alarmTimer) == ESP_OK;
+    configASSERT(alarmTimer);
+
+    xTaskCreate(DisplayTask, "DisplayTask", 4096, displaySub, 1, NULL);
+    xTaskCreate(AlarmTask,   "AlarmTask",   4096, NULL,       1, &m_alarmTask);
 }
@@ -0,0 +1,134 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+#include "timekeeping.h"
+
+#define TAG "TIMEKEEPING"
+
+/* ===== GLOBALS ===== */
+static esp_timer_handle_t m_timer;
+
+// epoch_us = esp_timer_get_time() + m_offsetUs, guarded by a seqlock;
+// m_writeLock serializes writers (BLE and SNTP may both set the time)
+static volatile uint32_t m_offsetSeq;
+static volatile int64_t m_offsetUs;
+static portMUX_TYPE m_writeLock = portMUX_INITIALIZER_UNLOCKED;
+
+static int64_t m_lastSecond;    // last epoch second published
+static timekeeping_step_cb_t m_onStep;
+
+/* ===== PRIVATE ===== */
+static int64_t offsetUs(void)
+{
+    uint32_t seq;
+    int64_t offset;
+
+    do {
+        seq = __atomic_load_n(&m_offsetSeq, __ATOMIC_ACQUIRE);
+        offset = m_offsetUs;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) || seq != __atomic_load_n(&m_offsetSeq, __ATOMIC_RELAXED));
+
+    return offset;
+}
+
+static void armNextSecond(int64_t nowUs)
+{
+    int64_t untilBoundary = TIMEKEEPING_US_PER_SEC - (nowUs % TIMEKEEPING_US_PER_SEC);
+
+    esp_timer_start_once(m_timer, untilBoundary);
+}
+
+static void TickCallback(void *arg)
+{
+    int64_t nowUs = Timekeeping_nowUs();
+    int64_t second = nowUs / TIMEKEEPING_US_PER_SEC;
+
+    int64_t behind = second - m_lastSecond;
+
+    if (behind > 0 && behind <= CLOCK_TICK_QUEUE_LEN) {
+        if (behind > 1)
+            ESP_LOGW(TAG, "tick late, catching up %lld s", behind - 1);
+
+        // Every second is delivered even when the callback ran late
+        while (m_lastSecond < second) {
+            m_lastSecond++;
+            clock_time_t time = Timekeeping_timeOfDay(m_lastSecond * TIMEKEEPING_US_PER_SEC);
+            ClockTick_publish(&time);
+        }
+    } else if (behind != 0) {
+        // Wall time was stepped, resync instead of replaying
+        m_lastSecond = second;
+        clock_time_t time = Timekeeping_timeOfDay(nowUs);
+        ClockTick_publish(&time);
+    }
+
+    armNextSecond(nowUs);
+}
+
+/* ===== PUBLIC ===== */
+bool Timekeeping_start(int64_t epochSeconds)
+{
+    Timekeeping_setEpochUs(epochSeconds * TIMEKEEPING_US_PER_SEC);
+    m_lastSecond = epochSeconds;
+
+    const esp_timer_create_args_t args = {
+        .callback = TickCallback,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "clock_tick",
+    };
+    if (esp_timer_create(&args, &m_timer) != ESP_OK)
+        return false;
+
+    armNextSecond(Timekeeping_nowUs());
+    return true;
+}
+
+void Timekeeping_setEpochUs(int64_t epochUs)
+{
+    portENTER_CRITICAL(&m_writeLock);
+    int64_t offset = epochUs - esp_timer_get_time();
+
+    // The fence keeps the offset store from overtaking the odd sequence
+    __atomic_add_fetch(&m_offsetSeq, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    m_offsetUs = offset;
+    __atomic_add_fetch(&m_offsetSeq, 1, __ATOMIC_RELEASE);
+    portEXIT_CRITICAL(&m_writeLock);
+
+    // The pending tick was aimed at a boundary of the old offset
+    if (m_timer != NULL) {
+        esp_timer_stop(m_timer);
+        armNextSecond(Timekeeping_nowUs());
+    }
+    if (m_onStep != NULL)
+        m_onStep();
+}
+
+void Timekeeping_onStep(timekeeping_step_cb_t cb)
+{
+    m_onStep = cb;
+}
+
+int64_t Timekeeping_nowUs(void)
+{
+    return esp_timer_get_time() + offsetUs();
+}
+
+clock_time_t Timekeeping_timeOfDay(int64_t epochUs)
+{
+    int64_t sec = (epochUs / TIMEKEEPING_US_PER_SEC) % TIMEKEEPING_SEC_PER_DAY;
+    if (sec < 0)
+        sec += TIMEKEEPING_SEC_PER_DAY;
+
+    clock_time_t time = {
+        .hours = sec / 3600,
+        .minutes = (sec / 60) % 60,
+        .seconds = sec % 60,
+    };
+    return time;
+}
@@ -0,0 +1,33 @@
+#ifndef __TIMEKEEPING__
+#define __TIMEKEEPING__
+
+/*
+ * Wall time derived from the 64-bit monotonic esp_timer clock plus an
+ * epoch offset, so late timer callbacks never accumulate into drift.
+ * Reads are O(1) and lock-free (seqlock around the offset); the tick
+ * timer is re-armed for the next real second boundary each time.
+ */
+
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include "clock_tick.h"
+
+#define TIMEKEEPING_US_PER_SEC 1000000LL
+#define TIMEKEEPING_SEC_PER_DAY 86400LL
+
+bool Timekeeping_start(int64_t epochSeconds);
+
+// Adjust wall time without restarting the tick source; the pending tick is
+// re-aimed at the next second boundary of the new time
+void Timekeeping_setEpochUs(int64_t epochUs);
+
+// Called at the end of every Timekeeping_setEpochUs(), in the caller's task,
+// e.g. to plan alarms again against the new time
+typedef void (*timekeeping_step_cb_t)(void);
+void Timekeeping_onStep(timekeeping_step_cb_t cb);
+
+int64_t Timekeeping_nowUs(void);
+clock_time_t Timekeeping_timeOfDay(int64_t epochUs);
+
+#endif
@@ -2,65 +2,227 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <assert.h>
 
+#ifdef ESP_PLATFORM
 #include "driver/gpio.h"
+#include "esp_log.h"
 #include "esp_rom_sys.h"
+#endif
 
 #include "tm1637.h"
+#ifdef ESP_PLATFORM
+#include "tm1637_rmt.h"
+#endif
 
 #define TM1637_I2C_COMM1 0x40
 #define TM1637_I2C_COMM2 0xC0
 #define TM1637_I2C_COMM3 0x80
 
-#define CLK_LOW()   gpio_set_level(m_pinClk, 0)
-#define CLK_HIGH()  gpio_set_level(m_pinClk, 1)
+#define TM1637_FIXED_ADDR 0x04
+#define TM1637_DIGITS     4
 
-#define DIO_LOW()   gpio_set_level(m_pinDIO, 0)
-#define DIO_HIGH()  gpio_set_level(m_pinDIO, 1)
+// COMM1 + (COMM2 + digits) + COMM3, each prefixed by its length
+#define TM1637_BATCH_SIZE (2 + 2 + TM1637_DIGITS + 2)
 
-#define DIO_READ()  gpio_get_level(m_pinDIO)
+#define CLK_LOW()   m_port->clkWrite(0)
+#define CLK_HIGH()  m_port->clkWrite(1)
+
+#define DIO_LOW()   m_port->dioWrite(0)
+#define DIO_HIGH()  m_port->dioWrite(1)
+
+#define DIO_READ()  m_port->dioRead()
 
 static uint8_t m_pinClk;
 static uint8_t m_pinDIO;
 static uint8_t m_brightness;
 static  unsigned int m_bitDelay;
+static const tm1637_port_t *m_port;
+
+// Shadow of what the chip currently has latched
+static uint8_t m_shadow[TM1637_DIGITS];
+static uint8_t m_shadowValid;          // bit per digit
+static uint8_t m_latchedBrightness;
+static bool m_brightnessValid;
+
+static tm1637_transport_t m_transport;
+static tm1637_done_cb_t m_doneCb;
+static void *m_doneArg;
+
+// Commands of the update in progress, for transports that send a whole frame
+static uint8_t m_batch[TM1637_BATCH_SIZE];
+static uint8_t m_batchLen;
+
+#ifdef ESP_PLATFORM
+/* ===== ESP-IDF GPIO BACKEND ===== */
+static void espPinInit(uint8_t pinClk, uint8_t pinDIO)
+{
+    gpio_set_direction(pinClk, GPIO_MODE_OUTPUT);
+    gpio_set_direction(pinDIO, GPIO_MODE_OUTPUT);
+
+    gpio_set_level(pinClk, 0);
+    gpio_set_level(pinDIO, 0);
+}
+
+static void espClkWrite(uint8_t level)
+{
+    gpio_set_level(m_pinClk, level);
+}
+
+static void espDioWrite(uint8_t level)
+{
+    gpio_set_level(m_pinDIO, level);
+}
+
+static uint8_t espDioRead(void)
+{
+    return gpio_get_level(m_pinDIO);
+}
+
+static void espDelayUs(unsigned int us)
+{
+    esp_rom_delay_us(us);
+}
+
+static const tm1637_port_t espPort = {
+    .pinInit  = espPinInit,
+    .clkWrite = espClkWrite,
+    .dioWrite = espDioWrite,
+    .dioRead  = espDioRead,
+    .delayUs  = espDelayUs,
+};
+#endif
+
+// XGFEDCBA, shared by digitToSegment and the compile-time tables below
+#define DIGIT_SEG_0 0b00111111
+#define DIGIT_SEG_1 0b00000110
+#define DIGIT_SEG_2 0b01011011
+#define DIGIT_SEG_3 0b01001111
+#define DIGIT_SEG_4 0b01100110
+#define DIGIT_SEG_5 0b01101101
+#define DIGIT_SEG_6 0b01111101
+#define DIGIT_SEG_7 0b00000111
+#define DIGIT_SEG_8 0b01111111
+#define DIGIT_SEG_9 0b01101111
+#define DIGIT_SEG_A 0b01110111
+#define DIGIT_SEG_B 0b01111100 // b
+#define DIGIT_SEG_C 0b00111001
+#define DIGIT_SEG_D 0b01011110 // d
+#define DIGIT_SEG_E 0b01111001
+#define DIGIT_SEG_F 0b01110001
 
 const uint8_t digitToSegment[] = {
-    // XGFEDCBA
-    0b00111111, // 0
-    0b00000110, // 1
-    0b01011011, // 2
-    0b01001111, // 3
-    0b01100110, // 4
-    0b01101101, // 5
-    0b01111101, // 6
-    0b00000111, // 7
-    0b01111111, // 8
-    0b01101111, // 9
-    0b01110111, // A
-    0b01111100, // b
-    0b00111001, // C
-    0b01011110, // d
-    0b01111001, // E
-    0b01110001  // F
+    DIGIT_SEG_0, DIGIT_SEG_1, DIGIT_SEG_2, DIGIT_SEG_3,
+    DIGIT_SEG_4, DIGIT_SEG_5, DIGIT_SEG_6, DIGIT_SEG_7,
+    DIGIT_SEG_8, DIGIT_SEG_9, DIGIT_SEG_A, DIGIT_SEG_B,
+    DIGIT_SEG_C, DIGIT_SEG_D, DIGIT_SEG_E, DIGIT_SEG_F,
 };
 
 static const uint8_t minusSegments = 0b01000000;
 
+// Compile-time digit pair tables for the time renderer: low byte is the
+// tens digit, high byte the units digit, so HH:MM needs no division.
+#define SEG_DIGIT(d) ((d) == 0 ? DIGIT_SEG_0 : (d) == 1 ? DIGIT_SEG_1 : \
+                      (d) == 2 ? DIGIT_SEG_2 : (d) == 3 ? DIGIT_SEG_3 : \
+                      (d) == 4 ? DIGIT_SEG_4 : (d) == 5 ? DIGIT_SEG_5 : \
+                      (d) == 6 ? DIGIT_SEG_6 : (d) == 7 ? DIGIT_SEG_7 : \
+                      (d) == 8 ? DIGIT_SEG_8 : DIGIT_SEG_9)
+
+#define SEG_PAIR(n)       ((uint16_t)(SEG_DIGIT((n) / 10) | (SEG_DIGIT((n) % 10) << 8)))
+#define SEG_PAIR_BLANK(n) ((uint16_t)(((n) < 10 ? 0 : SEG_DIGIT((n) / 10)) | (SEG_DIGIT((n) % 10) << 8)))
+
+#define SEG_PAIR_ROW(p, t) p(10 * (t) + 0), p(10 * (t) + 1), p(10 * (t) + 2), p(10 * (t) + 3), \
+                           p(10 * (t) + 4), p(10 * (t) + 5), p(10 * (t) + 6), p(10 * (t) + 7), \
+                           p(10 * (t) + 8), p(10 * (t) + 9)
+
+static const uint16_t minutePairs[60] = {
+    SEG_PAIR_ROW(SEG_PAIR, 0), SEG_PAIR_ROW(SEG_PAIR, 1), SEG_PAIR_ROW(SEG_PAIR, 2),
+    SEG_PAIR_ROW(SEG_PAIR, 3), SEG_PAIR_ROW(SEG_PAIR, 4), SEG_PAIR_ROW(SEG_PAIR, 5),
+};
+
+// Hours with the leading zero blanked (" 9:05")
+static const uint16_t hourPairsBlank[24] = {
+    SEG_PAIR_ROW(SEG_PAIR_BLANK, 0), SEG_PAIR_ROW(SEG_PAIR_BLANK, 1),
+    SEG_PAIR_BLANK(20), SEG_PAIR_BLANK(21), SEG_PAIR_BLANK(22), SEG_PAIR_BLANK(23),
+};
+
+void TM1637_setPort(const tm1637_port_t *port)
+{
+    m_port = port;
+}
+
 void TM1637_Init(uint8_t pinClk,
                  uint8_t pinDIO,
                  unsigned int bitDelay)
+{
+    TM1637_InitTransport(pinClk, pinDIO, bitDelay, TM1637_TRANSPORT_BITBANG);
+}
+
+tm1637_transport_t TM1637_InitTransport(uint8_t pinClk,
+                                        uint8_t pinDIO,
+                                        unsigned int bitDelay,
+                                        tm1637_transport_t transport)
 {
     // Copy the pin numbers
     m_pinClk = pinClk;
     m_pinDIO = pinDIO;
     m_bitDelay = bitDelay;
+    m_transport = TM1637_TRANSPORT_BITBANG;
+    m_batchLen = 0;
+
+    TM1637_invalidate();
+
+#ifdef ESP_PLATFORM
+    if (transport == TM1637_TRANSPORT_RMT) {
+        if (TM1637_rmtInit(pinClk, pinDIO, bitDelay) == ESP_OK) {
+            TM1637_rmtSetDoneCallback(m_doneCb, m_doneArg);
+            m_transport = TM1637_TRANSPORT_RMT;
+            return m_transport;
+        }
+        ESP_LOGW("TM1637", "RMT transport unavailable, falling back to bit-bang");
+    }
+
+    if (m_port == NULL)
+        m_port = &espPort;
+#else
+    (void)transport;
+#endif
+    assert(m_port != NULL);
+
+    m_port->pinInit(m_pinClk, m_pinDIO);
+
+    return m_transport;
+}
+
+tm1637_transport_t TM1637_getTransport()
+{
+    return m_transport;
+}
+
+void TM1637_setDoneCallback(tm1637_done_cb_t cb, void *arg)
+{
+    m_doneCb = cb;
+    m_doneArg = arg;
+#ifdef ESP_PLATFORM
+    if (m_transport == TM1637_TRANSPORT_RMT)
+        TM1637_rmtSetDoneCallback(cb, arg);
+#endif
+}
 
-    gpio_set_direction(m_pinClk, GPIO_MODE_OUTPUT);
-    gpio_set_direction(m_pinDIO, GPIO_MODE_OUTPUT);
+bool TM1637_waitIdle(int timeoutMs)
+{
+#ifdef ESP_PLATFORM
+    if (m_transport == TM1637_TRANSPORT_RMT)
+        return TM1637_rmtWaitIdle(timeoutMs) == ESP_OK;
+#endif
+    (void)timeoutMs;
+    return true;
+}
 
-    gpio_set_level(m_pinClk, 0);
-    gpio_set_level(m_pinDIO, 0);
+void TM1637_invalidate()
+{
+    m_shadowValid = 0;
+    m_brightnessValid = false;
 }
 
 void TM1637_setBrightness(uint8_t brightness, bool on)
@@ -68,29 +230,98 @@ void TM1637_setBrightness(uint8_t brightness, bool on)
     m_brightness = (brightness & 0x7) | (on ? 0x08 : 0x00);
 }
 
+static void sendCommand(uint8_t cmd, const uint8_t *data, uint8_t length)
+{
+    if (m_transport == TM1637_TRANSPORT_BITBANG) {
+        start();
+        writeByte(cmd);
+        for (uint8_t k = 0; k < length; k++)
+            writeByte(data[k]);
+        stop();
+        return;
+    }
+
+    m_batch[m_batchLen++] = length + 1;
+    m_batch[m_batchLen++] = cmd;
+    memcpy(&m_batch[m_batchLen], data, length);
+    m_batchLen += length;
+}
+
+static void flush(bool sent)
+{
+    if (!sent)
+        return;
+
+#ifdef ESP_PLATFORM
+    if (m_transport == TM1637_TRANSPORT_RMT) {
+        esp_err_t err = TM1637_rmtTransmit(m_batch, m_batchLen);
+        m_batchLen = 0;
+
+        // The shadow already holds this frame; forget it so the next update
+        // rewrites everything instead of skipping it as unchanged
+        if (err != ESP_OK) {
+            ESP_LOGW("TM1637", "frame not sent (%s), full rewrite next",
+                     esp_err_to_name(err));
+            TM1637_invalidate();
+        }
+        return;
+    }
+#endif
+
+    if (m_doneCb)
+        m_doneCb(m_doneArg);
+}
+
+static void writeData(uint8_t addr, const uint8_t *data, uint8_t length)
+{
+    // Write COMM1, fixed address mode for a single digit
+    sendCommand(TM1637_I2C_COMM1 | (length == 1 ? TM1637_FIXED_ADDR : 0), NULL, 0);
+
+    // Write COMM2 + first digit address, then the data bytes
+    sendCommand(TM1637_I2C_COMM2 + (addr & 0x03), data, length);
+}
+
 void TM1637_setSegments(const uint8_t *segments,
                         uint8_t length,
                         uint8_t pos)
 {
-    // Write COMM1
-    start();
-    writeByte(TM1637_I2C_COMM1);
-    stop();
-
-    // Write COMM2 + first digit address
-    start();
-    writeByte(TM1637_I2C_COMM2 + (pos & 0x03));
+    uint8_t first = TM1637_DIGITS;
+    uint8_t last = 0;
+
+    pos &= 0x03;
+    if (length > TM1637_DIGITS - pos)
+        length = TM1637_DIGITS - pos;
+
+    // Find the span of digits that differ from what is latched
+    for (uint8_t k = 0; k < length; k++) {
+        uint8_t d = pos + k;
+        if ((m_shadowValid & (1 << d)) && m_shadow[d] == segments[k])
+            continue;
+
+        if (first == TM1637_DIGITS)
+            first = d;
+        last = d;
+        m_shadow[d] = segments[k];
+        m_shadowValid |= 1 << d;
+    }
 
-    // Write the data bytes
-    for (uint8_t k = 0; k < length; k++)
-        writeByte(segments[k]);
+    bool sent = false;
 
-    stop();
+    if (first != TM1637_DIGITS) {
+        writeData(first, &m_shadow[first], last - first + 1);
+        sent = true;
+    }
 
     // Write COMM3 + brightness
-    start();
-    writeByte(TM1637_I2C_COMM3 + (m_brightness & 0x0f));
-    stop();
+    if (!m_brightnessValid || m_latchedBrightness != m_brightness) {
+        sendCommand(TM1637_I2C_COMM3 + (m_brightness & 0x0f), NULL, 0);
+
+        m_latchedBrightness = m_brightness;
+        m_brightnessValid = true;
+        sent = true;
+    }
+
+    flush(sent);
 }
 
 void TM1637_clear()
@@ -116,6 +347,42 @@ void TM1637_showNumberDecEx(int num,
     showNumberBaseEx(num < 0 ? -10 : 10, num < 0 ? -num : num, dots, leading_zero, length, pos);
 }
 
+void TM1637_formatNumberDecEx(int num,
+                              uint8_t dots,
+                              bool leading_zero,
+                              uint8_t length,
+                              uint8_t *digits)
+{
+    formatNumberBaseEx(num < 0 ? -10 : 10, num < 0 ? -num : num, dots, leading_zero, length, digits);
+}
+
+void TM1637_encodeTime(uint8_t hours,
+                       uint8_t minutes,
+                       bool colon,
+                       bool leading_zero,
+                       uint8_t *digits)
+{
+    const uint16_t *hourTable = leading_zero ? minutePairs : hourPairsBlank;
+    uint16_t h = hourTable[hours];
+    uint16_t m = minutePairs[minutes];
+
+    digits[0] = h & 0xff;
+    digits[1] = (h >> 8) | (-(uint8_t)colon & 0x80);
+    digits[2] = m & 0xff;
+    digits[3] = m >> 8;
+}
+
+void TM1637_showTime(uint8_t hours,
+                     uint8_t minutes,
+                     bool colon,
+                     bool leading_zero)
+{
+    uint8_t digits[4];
+
+    TM1637_encodeTime(hours, minutes, colon, leading_zero, digits);
+    TM1637_setSegments(digits, 4, 0);
+}
+
 void TM1637_showNumberHexEx(uint16_t num,
                             uint8_t dots,
                             bool leading_zero,
@@ -127,7 +394,7 @@ void TM1637_showNumberHexEx(uint16_t num,
 
 void bitDelay()
 {
-    esp_rom_delay_us(m_bitDelay);
+    m_port->delayUs(m_bitDelay);
 }
 
 void start()
@@ -203,6 +470,19 @@ void showNumberBaseEx(int8_t base,
                              bool leading_zero,
                              uint8_t length,
                              uint8_t pos)
+{
+    uint8_t digits[4];
+
+    formatNumberBaseEx(base, num, dots, leading_zero, length, digits);
+    TM1637_setSegments(digits, length, pos);
+}
+
+void formatNumberBaseEx(int8_t base,
+                        uint16_t num,
+                        uint8_t dots,
+                        bool leading_zero,
+                        uint8_t length,
+                        uint8_t *digits)
 {
     bool negative = false;
     if (base < 0)
@@ -211,8 +491,6 @@ void showNumberBaseEx(int8_t base,
         negative = true;
     }
 
-    uint8_t digits[4];
-
     if (num == 0 && !leading_zero)
     {
         // Singular case - take care separately
@@ -253,6 +531,4 @@ void showNumberBaseEx(int8_t base,
     {
         showDots(dots, digits);
     }
-
-    TM1637_setSegments(digits, length, pos);
 }
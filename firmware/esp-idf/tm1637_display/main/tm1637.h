@@ -15,14 +15,48 @@
 
 #define DEFAULT_BIT_DELAY 100
 
+/*
+ * Pin/delay backend used by the bit-bang code.
+ * On ESP-IDF the GPIO backend is selected automatically by TM1637_Init,
+ * on host builds a backend (e.g. the one from tm1637_sim.h) has to be
+ * registered with TM1637_setPort before TM1637_Init.
+ */
+typedef struct {
+    void (*pinInit)(uint8_t pinClk, uint8_t pinDIO);
+    void (*clkWrite)(uint8_t level);
+    void (*dioWrite)(uint8_t level);
+    uint8_t (*dioRead)(void);
+    void (*delayUs)(unsigned int us);
+} tm1637_port_t;
+
+void TM1637_setPort(const tm1637_port_t *port);
+
+typedef enum {
+    TM1637_TRANSPORT_BITBANG,   // CPU toggles the pins, blocks for the frame
+    TM1637_TRANSPORT_RMT,       // frame clocked out by the RMT peripheral
+} tm1637_transport_t;
+
+// Called after each bus transfer; from ISR context on the RMT transport
+typedef void (*tm1637_done_cb_t)(void *arg);
+
 void TM1637_Init(uint8_t pinClk,
                  uint8_t pinDIO,
                  unsigned int bitDelay);
+// Returns the transport actually in use (bit-bang if RMT setup fails)
+tm1637_transport_t TM1637_InitTransport(uint8_t pinClk,
+                                        uint8_t pinDIO,
+                                        unsigned int bitDelay,
+                                        tm1637_transport_t transport);
+tm1637_transport_t TM1637_getTransport();
+void TM1637_setDoneCallback(tm1637_done_cb_t cb, void *arg);
+bool TM1637_waitIdle(int timeoutMs);
 void TM1637_setBrightness(uint8_t brightness, bool on);
 void TM1637_setSegments(const uint8_t *segments,
                         uint8_t length,
                         uint8_t pos);
 void TM1637_clear();
+// Forget the latched state so the next update rewrites everything
+void TM1637_invalidate();
 void TM1637_showNumberDec(int num,
                           bool leading_zero,
                           uint8_t length,
@@ -32,6 +66,22 @@ void TM1637_showNumberDecEx(int num,
                             bool leading_zero,
                             uint8_t length,
                             uint8_t pos);
+// Same formatting as TM1637_showNumberDecEx, without touching the bus
+void TM1637_formatNumberDecEx(int num,
+                              uint8_t dots,
+                              bool leading_zero,
+                              uint8_t length,
+                              uint8_t *digits);
+// Table-driven HH:MM renderer, hours 0..23 and minutes 0..59 (not checked)
+void TM1637_encodeTime(uint8_t hours,
+                       uint8_t minutes,
+                       bool colon,
+                       bool leading_zero,
+                       uint8_t *digits);
+void TM1637_showTime(uint8_t hours,
+                     uint8_t minutes,
+                     bool colon,
+                     bool leading_zero);
 void TM1637_showNumberHexEx(uint16_t num,
                             uint8_t dots,
                             bool leading_zero,
@@ -50,5 +100,11 @@ void showNumberBaseEx(int8_t base,
                              bool leading_zero,
                              uint8_t length,
                              uint8_t pos);
+void formatNumberBaseEx(int8_t base,
+                        uint16_t num,
+                        uint8_t dots,
+                        bool leading_zero,
+                        uint8_t length,
+                        uint8_t *digits);
 
-#endif
\ No newline at end of file
+#endif
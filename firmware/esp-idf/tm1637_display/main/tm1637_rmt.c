@@ -0,0 +1,318 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "driver/rmt_tx.h"
+#include "esp_check.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "tm1637_rmt.h"
+
+#define TAG "TM1637_RMT"
+
+#define TM1637_RMT_RESOLUTION_HZ 1000000    // 1 tick = 1 us, same unit as bitDelay
+#define TM1637_RMT_MAX_STEPS     512
+#define TM1637_RMT_MAX_SYMBOLS   (TM1637_RMT_MAX_STEPS / 2 + 8)
+#define TM1637_RMT_MAX_DURATION  32767
+
+#define STEP_CLK 0x01
+#define STEP_DIO 0x02
+
+static rmt_channel_handle_t m_clkChan;
+static rmt_channel_handle_t m_dioChan;
+static rmt_encoder_handle_t m_clkEncoder;
+static rmt_encoder_handle_t m_dioEncoder;
+static rmt_sync_manager_handle_t m_sync;
+static SemaphoreHandle_t m_idleSem;
+
+static unsigned int m_bitDelay;
+static tm1637_done_cb_t m_doneCb;
+static void *m_doneArg;
+static volatile uint8_t m_channelsDone;
+static bool m_busy;
+
+// One step = one bitDelay with fixed CLK/DIO levels, mirrors the bit-bang timing
+static uint8_t m_steps[TM1637_RMT_MAX_STEPS];
+static size_t m_stepCount;
+static uint8_t m_dio;
+
+static rmt_symbol_word_t m_clkSymbols[TM1637_RMT_MAX_SYMBOLS];
+static rmt_symbol_word_t m_dioSymbols[TM1637_RMT_MAX_SYMBOLS];
+
+/* ===== WAVEFORM ENCODER ===== */
+static void emit(uint8_t clk, uint8_t dio)
+{
+    m_dio = dio;
+    if (m_stepCount < TM1637_RMT_MAX_STEPS)
+        m_steps[m_stepCount++] = (clk ? STEP_CLK : 0) | (dio ? STEP_DIO : 0);
+}
+
+static void encodeStart(void)
+{
+    emit(1, 1);
+    emit(1, 0);
+}
+
+static void encodeStop(void)
+{
+    emit(0, m_dio);
+    emit(0, 0);
+    emit(1, 0);
+}
+
+static void encodeByte(uint8_t b)
+{
+    for (uint8_t i = 0; i < 8; i++) {
+        uint8_t bit = b & 0x01;
+
+        emit(0, m_dio);
+        emit(0, bit);
+        emit(1, bit);
+
+        b >>= 1;
+    }
+
+    // ACK slot, DIO released
+    emit(0, 1);
+    emit(1, 1);
+    emit(0, 1);
+}
+
+static void pushHalf(rmt_symbol_word_t *out, size_t *count, bool *half,
+                     uint8_t level, uint32_t duration)
+{
+    if (*count >= TM1637_RMT_MAX_SYMBOLS)
+        return;
+
+    if (!*half) {
+        out[*count].level0 = level;
+        out[*count].duration0 = duration;
+        *half = true;
+    } else {
+        out[*count].level1 = level;
+        out[*count].duration1 = duration;
+        (*count)++;
+        *half = false;
+    }
+}
+
+static void pushRun(rmt_symbol_word_t *out, size_t *count, bool *half,
+                    uint8_t level, uint32_t duration)
+{
+    while (duration > TM1637_RMT_MAX_DURATION) {
+        pushHalf(out, count, half, level, TM1637_RMT_MAX_DURATION);
+        duration -= TM1637_RMT_MAX_DURATION;
+    }
+    pushHalf(out, count, half, level, duration);
+}
+
+// Run-length encode one line of the step table into RMT symbols
+static size_t packLine(uint8_t mask, rmt_symbol_word_t *out)
+{
+    size_t count = 0;
+    bool half = false;
+    uint8_t runLevel = 0;
+    uint32_t runSteps = 0;
+
+    for (size_t i = 0; i < m_stepCount; i++) {
+        uint8_t level = (m_steps[i] & mask) ? 1 : 0;
+
+        if (runSteps && level != runLevel) {
+            pushRun(out, &count, &half, runLevel, runSteps * m_bitDelay);
+            runSteps = 0;
+        }
+        runLevel = level;
+        runSteps++;
+    }
+    if (runSteps)
+        pushRun(out, &count, &half, runLevel, runSteps * m_bitDelay);
+
+    // Odd number of runs: zero duration terminates the stream
+    if (half && count < TM1637_RMT_MAX_SYMBOLS) {
+        out[count].level1 = out[count].level0;
+        out[count].duration1 = 0;
+        count++;
+    }
+
+    return count;
+}
+
+/* ===== RMT ===== */
+#if CONFIG_PM_ENABLE
+// Enabled channels hold a PM lock, so they only stay enabled for one frame
+static esp_err_t enableChannels(bool enable)
+{
+    esp_err_t (*op)(rmt_channel_handle_t) = enable ? rmt_enable : rmt_disable;
+
+    ESP_RETURN_ON_ERROR(op(m_clkChan), TAG, "clk %s", enable ? "enable" : "disable");
+    return op(m_dioChan);
+}
+#endif
+
+// A frame that failed to submit: drop what one channel may have queued,
+// release the PM lock and let the next TM1637_rmtWaitIdle() through
+static void abortFrame(void)
+{
+    // Disabling an already disabled channel only returns an error
+    rmt_disable(m_clkChan);
+    rmt_disable(m_dioChan);
+#if !CONFIG_PM_ENABLE
+    rmt_enable(m_clkChan);
+    rmt_enable(m_dioChan);
+#endif
+
+    m_busy = false;
+    xSemaphoreGive(m_idleSem);
+}
+
+static bool onTransDone(rmt_channel_handle_t channel,
+                        const rmt_tx_done_event_data_t *edata,
+                        void *user_ctx)
+{
+    BaseType_t woken = pdFALSE;
+
+    if (__atomic_add_fetch(&m_channelsDone, 1, __ATOMIC_RELAXED) == 2) {
+        xSemaphoreGiveFromISR(m_idleSem, &woken);
+        if (m_doneCb)
+            m_doneCb(m_doneArg);
+    }
+
+    return woken == pdTRUE;
+}
+
+static esp_err_t newChannel(uint8_t pin, bool openDrain,
+                            rmt_channel_handle_t *chan,
+                            rmt_encoder_handle_t *encoder)
+{
+    rmt_tx_channel_config_t config = {
+        .gpio_num = pin,
+        .clk_src = RMT_CLK_SRC_DEFAULT,
+        .resolution_hz = TM1637_RMT_RESOLUTION_HZ,
+        .mem_block_symbols = SOC_RMT_MEM_WORDS_PER_CHANNEL,
+        .trans_queue_depth = 1,
+        .flags.io_od_mode = openDrain,
+    };
+    ESP_RETURN_ON_ERROR(rmt_new_tx_channel(&config, chan), TAG, "tx channel");
+
+    rmt_tx_event_callbacks_t cbs = {
+        .on_trans_done = onTransDone,
+    };
+    ESP_RETURN_ON_ERROR(rmt_tx_register_event_callbacks(*chan, &cbs, NULL), TAG, "callbacks");
+
+    rmt_copy_encoder_config_t encConfig = {};
+    ESP_RETURN_ON_ERROR(rmt_new_copy_encoder(&encConfig, encoder), TAG, "encoder");
+
+    return rmt_enable(*chan);
+}
+
+esp_err_t TM1637_rmtInit(uint8_t pinClk,
+                         uint8_t pinDIO,
+                         unsigned int bitDelay)
+{
+    m_bitDelay = bitDelay ? bitDelay : 1;
+
+    m_idleSem = xSemaphoreCreateBinary();
+    if (m_idleSem == NULL)
+        return ESP_ERR_NO_MEM;
+    xSemaphoreGive(m_idleSem);
+
+    ESP_RETURN_ON_ERROR(newChannel(pinClk, false, &m_clkChan, &m_clkEncoder), TAG, "clk");
+    ESP_RETURN_ON_ERROR(newChannel(pinDIO, true, &m_dioChan, &m_dioEncoder), TAG, "dio");
+
+    rmt_channel_handle_t channels[] = { m_clkChan, m_dioChan };
+    rmt_sync_manager_config_t syncConfig = {
+        .tx_channel_array = channels,
+        .array_size = 2,
+    };
+    ESP_RETURN_ON_ERROR(rmt_new_sync_manager(&syncConfig, &m_sync), TAG, "sync");
+
+#if CONFIG_PM_ENABLE
+    // The sync manager needs them enabled once, at creation
+    ESP_RETURN_ON_ERROR(enableChannels(false), TAG, "idle");
+#endif
+
+    ESP_LOGI(TAG, "RMT transport ready, bit delay %u us", m_bitDelay);
+    return ESP_OK;
+}
+
+void TM1637_rmtSetDoneCallback(tm1637_done_cb_t cb, void *arg)
+{
+    m_doneCb = cb;
+    m_doneArg = arg;
+}
+
+esp_err_t TM1637_rmtWaitIdle(int timeoutMs)
+{
+    if (!m_busy)
+        return ESP_OK;
+
+    TickType_t ticks = timeoutMs < 0 ? portMAX_DELAY : pdMS_TO_TICKS(timeoutMs);
+    if (xSemaphoreTake(m_idleSem, ticks) != pdTRUE)
+        return ESP_ERR_TIMEOUT;
+
+    m_busy = false;
+#if CONFIG_PM_ENABLE
+    return enableChannels(false);
+#else
+    return ESP_OK;
+#endif
+}
+
+esp_err_t TM1637_rmtTransmit(const uint8_t *commands, size_t size)
+{
+    // Symbol buffers are read by the driver until the previous transfer ends
+    ESP_RETURN_ON_ERROR(TM1637_rmtWaitIdle(-1), TAG, "wait");
+
+    m_stepCount = 0;
+    m_dio = 1;
+
+    size_t i = 0;
+    while (i < size) {
+        uint8_t length = commands[i++];
+
+        encodeStart();
+        for (uint8_t k = 0; k < length && i < size; k++)
+            encodeByte(commands[i++]);
+        encodeStop();
+    }
+
+    if (m_stepCount >= TM1637_RMT_MAX_STEPS) {
+        ESP_LOGE(TAG, "frame too long (%u steps)", (unsigned)m_stepCount);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    size_t clkCount = packLine(STEP_CLK, m_clkSymbols);
+    size_t dioCount = packLine(STEP_DIO, m_dioSymbols);
+
+    // Both lines idle high after the final stop condition
+    rmt_transmit_config_t txConfig = {
+        .loop_count = 0,
+        .flags.eot_level = 1,
+    };
+
+    esp_err_t ret = ESP_OK;
+
+#if CONFIG_PM_ENABLE
+    ESP_GOTO_ON_ERROR(enableChannels(true), fail, TAG, "enable");
+#endif
+
+    m_channelsDone = 0;
+    m_busy = true;
+    xSemaphoreTake(m_idleSem, 0);
+
+    rmt_sync_reset(m_sync);
+    ESP_GOTO_ON_ERROR(rmt_transmit(m_clkChan, m_clkEncoder, m_clkSymbols,
+                                   clkCount * sizeof(rmt_symbol_word_t), &txConfig),
+                      fail, TAG, "clk transmit");
+    ESP_GOTO_ON_ERROR(rmt_transmit(m_dioChan, m_dioEncoder, m_dioSymbols,
+                                   dioCount * sizeof(rmt_symbol_word_t), &txConfig),
+                      fail, TAG, "dio transmit");
+
+    return ESP_OK;
+
+fail:
+    abortFrame();
+    return ret;
+}
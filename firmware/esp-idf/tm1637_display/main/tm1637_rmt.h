@@ -0,0 +1,29 @@
+#ifndef __TM1637_RMT__
+#define __TM1637_RMT__
+
+/*
+ * RMT transport for the TM1637.
+ *
+ * A whole update (COMM1/COMM2/COMM3 frames) is encoded into CLK and DIO
+ * symbol streams up front and clocked out by two synchronised RMT TX
+ * channels, so the calling task does not busy-wait for the transfer.
+ * DIO runs open-drain; the chip's ACK is not sampled on this path.
+ */
+
+#include <stddef.h>
+#include <inttypes.h>
+
+#include "esp_err.h"
+
+#include "tm1637.h"
+
+esp_err_t TM1637_rmtInit(uint8_t pinClk,
+                         uint8_t pinDIO,
+                         unsigned int bitDelay);
+void TM1637_rmtSetDoneCallback(tm1637_done_cb_t cb, void *arg);
+
+// commands: [length, byte0 .. byteN-1] records, one per start/stop frame
+esp_err_t TM1637_rmtTransmit(const uint8_t *commands, size_t size);
+esp_err_t TM1637_rmtWaitIdle(int timeoutMs);
+
+#endif
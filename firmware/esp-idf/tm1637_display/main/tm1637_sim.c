@@ -0,0 +1,270 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "tm1637_sim.h"
+
+#define TM1637_I2C_COMM1 0x40
+#define TM1637_I2C_COMM2 0xC0
+#define TM1637_I2C_COMM3 0x80
+
+#define TM1637_FIXED_ADDR 0x04
+
+/* ===== BUS STATE ===== */
+static uint8_t m_clk;
+static uint8_t m_dioHost;     // level driven by the MCU
+static uint8_t m_dioPull;     // chip pulls DIO low during the ACK slot
+static uint64_t m_timeUs;
+static uint64_t m_busTimeUs;
+
+/* ===== TRACE ===== */
+static tm1637_sim_edge_t m_edges[TM1637_SIM_MAX_EDGES];
+static size_t m_edgeCount;
+static uint32_t m_droppedEdges;
+
+/* ===== DECODER ===== */
+static bool m_inFrame;
+static uint8_t m_bitCount;    // 0..7 data bits, 8 = ACK slot armed, 9 = ACK clocked
+static uint8_t m_shift;
+static tm1637_sim_frame_t m_current;
+
+static tm1637_sim_frame_t m_frames[TM1637_SIM_MAX_FRAMES];
+static size_t m_frameCount;
+static uint32_t m_droppedFrames;
+
+static tm1637_sim_display_t m_display;
+static uint8_t m_address;
+
+static uint8_t dioLevel(void)
+{
+    return m_dioHost && !m_dioPull;
+}
+
+static void recordEdge(void)
+{
+    if (m_edgeCount < TM1637_SIM_MAX_EDGES) {
+        m_edges[m_edgeCount].timeUs = m_timeUs;
+        m_edges[m_edgeCount].clk = m_clk;
+        m_edges[m_edgeCount].dio = dioLevel();
+        m_edgeCount++;
+    } else {
+        m_droppedEdges++;
+    }
+}
+
+static void applyFrame(const tm1637_sim_frame_t *frame)
+{
+    if (frame->length == 0)
+        return;
+
+    uint8_t cmd = frame->bytes[0];
+
+    switch (cmd & 0xC0) {
+    case TM1637_I2C_COMM1:
+        m_display.comm1Count++;
+        m_display.fixedAddress = (cmd & TM1637_FIXED_ADDR) != 0;
+        break;
+
+    case TM1637_I2C_COMM2:
+        m_display.comm2Count++;
+        m_address = cmd & 0x07;
+        for (uint8_t k = 1; k < frame->length; k++) {
+            if (m_address < TM1637_SIM_DIGITS)
+                m_display.segments[m_address] = frame->bytes[k];
+            if (!m_display.fixedAddress)
+                m_address++;
+        }
+        break;
+
+    case TM1637_I2C_COMM3:
+        m_display.comm3Count++;
+        m_display.brightness = cmd & 0x07;
+        m_display.on = (cmd & 0x08) != 0;
+        break;
+
+    default:
+        break;
+    }
+}
+
+static void frameStart(void)
+{
+    m_inFrame = true;
+    m_bitCount = 0;
+    m_shift = 0;
+    memset(&m_current, 0, sizeof(m_current));
+    m_current.acked = true;
+    m_current.startUs = m_timeUs;
+}
+
+static void frameStop(void)
+{
+    m_inFrame = false;
+    m_current.endUs = m_timeUs;
+    m_busTimeUs += m_current.endUs - m_current.startUs;
+
+    applyFrame(&m_current);
+
+    if (m_frameCount < TM1637_SIM_MAX_FRAMES)
+        m_frames[m_frameCount++] = m_current;
+    else
+        m_droppedFrames++;
+}
+
+static void onClkEdge(uint8_t level)
+{
+    if (!m_inFrame)
+        return;
+
+    if (level) {
+        if (m_bitCount < 8) {
+            // Data is sampled LSB first on the rising edge
+            m_shift |= (dioLevel() ? 1 : 0) << m_bitCount;
+            m_bitCount++;
+        } else if (m_bitCount == 8) {
+            m_bitCount = 9;
+        }
+    } else {
+        if (m_bitCount == 8) {
+            // Falling edge after the 8th bit: chip acknowledges
+            m_dioPull = 1;
+        } else if (m_bitCount == 9) {
+            m_dioPull = 0;
+            if (m_current.length < TM1637_SIM_MAX_FRAME_BYTES)
+                m_current.bytes[m_current.length++] = m_shift;
+            m_bitCount = 0;
+            m_shift = 0;
+        }
+    }
+}
+
+/* ===== PORT ===== */
+static void simPinInit(uint8_t pinClk, uint8_t pinDIO)
+{
+    (void)pinClk;
+    (void)pinDIO;
+
+    m_clk = 0;
+    m_dioHost = 0;
+    m_dioPull = 0;
+    recordEdge();
+}
+
+static void simClkWrite(uint8_t level)
+{
+    level = level ? 1 : 0;
+    if (level == m_clk)
+        return;
+
+    m_clk = level;
+    onClkEdge(level);
+    recordEdge();
+}
+
+static void simDioWrite(uint8_t level)
+{
+    level = level ? 1 : 0;
+    uint8_t before = dioLevel();
+    m_dioHost = level;
+    uint8_t after = dioLevel();
+
+    if (before == after)
+        return;
+
+    recordEdge();
+
+    if (m_clk) {
+        if (!after)
+            frameStart();
+        else if (m_inFrame)
+            frameStop();
+    }
+}
+
+static uint8_t simDioRead(void)
+{
+    // A read in the ACK slot must see the chip holding DIO low
+    if (m_inFrame && m_bitCount == 9 && dioLevel())
+        m_current.acked = false;
+
+    return dioLevel();
+}
+
+static void simDelayUs(unsigned int us)
+{
+    m_timeUs += us;
+}
+
+static const tm1637_port_t simPort = {
+    .pinInit  = simPinInit,
+    .clkWrite = simClkWrite,
+    .dioWrite = simDioWrite,
+    .dioRead  = simDioRead,
+    .delayUs  = simDelayUs,
+};
+
+/* ===== PUBLIC ===== */
+const tm1637_port_t *TM1637_simPort(void)
+{
+    return &simPort;
+}
+
+void TM1637_simReset(void)
+{
+    m_timeUs = 0;
+    m_busTimeUs = 0;
+    m_edgeCount = 0;
+    m_droppedEdges = 0;
+    m_frameCount = 0;
+    m_droppedFrames = 0;
+    m_inFrame = false;
+    m_bitCount = 0;
+    m_shift = 0;
+    m_address = 0;
+    memset(&m_display, 0, sizeof(m_display));
+}
+
+uint64_t TM1637_simTimeUs(void)
+{
+    return m_timeUs;
+}
+
+uint64_t TM1637_simBusTimeUs(void)
+{
+    return m_busTimeUs;
+}
+
+size_t TM1637_simEdgeCount(void)
+{
+    return m_edgeCount;
+}
+
+const tm1637_sim_edge_t *TM1637_simEdges(void)
+{
+    return m_edges;
+}
+
+uint32_t TM1637_simDroppedEdges(void)
+{
+    return m_droppedEdges;
+}
+
+size_t TM1637_simFrameCount(void)
+{
+    return m_frameCount;
+}
+
+const tm1637_sim_frame_t *TM1637_simFrame(size_t index)
+{
+    return index < m_frameCount ? &m_frames[index] : NULL;
+}
+
+uint32_t TM1637_simDroppedFrames(void)
+{
+    return m_droppedFrames;
+}
+
+const tm1637_sim_display_t *TM1637_simDisplay(void)
+{
+    return &m_display;
+}
@@ -0,0 +1,71 @@
+#ifndef __TM1637_SIM__
+#define __TM1637_SIM__
+
+/*
+ * Host-side TM1637 simulation backend.
+ *
+ * Records every CLK/DIO edge produced by tm1637.c into a trace, emulates the
+ * chip's ACK and decodes the start/stop framing back into COMM1/COMM2/COMM3
+ * commands and segment bytes. Time only advances through delayUs, so frame
+ * durations are exact bus time for the configured bit delay.
+ *
+ * Host build:  cc -I. tm1637.c tm1637_sim.c app.c
+ *
+ *     TM1637_setPort(TM1637_simPort());
+ *     TM1637_Init(0, 1, DEFAULT_BIT_DELAY);
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <inttypes.h>
+
+#include "tm1637.h"
+
+#define TM1637_SIM_MAX_EDGES        8192
+#define TM1637_SIM_MAX_FRAMES       128
+#define TM1637_SIM_MAX_FRAME_BYTES  8
+#define TM1637_SIM_DIGITS           6
+
+typedef struct {
+    uint64_t timeUs;
+    uint8_t clk;
+    uint8_t dio;
+} tm1637_sim_edge_t;
+
+typedef struct {
+    uint8_t bytes[TM1637_SIM_MAX_FRAME_BYTES];
+    uint8_t length;
+    bool acked;         // every byte in the frame was ACKed
+    uint64_t startUs;
+    uint64_t endUs;
+} tm1637_sim_frame_t;
+
+typedef struct {
+    uint8_t segments[TM1637_SIM_DIGITS];
+    uint8_t brightness;
+    bool on;
+    bool fixedAddress;
+    uint32_t comm1Count;
+    uint32_t comm2Count;
+    uint32_t comm3Count;
+} tm1637_sim_display_t;
+
+const tm1637_port_t *TM1637_simPort(void);
+
+// Clears trace, frames, clock and latched display state
+void TM1637_simReset(void);
+
+uint64_t TM1637_simTimeUs(void);
+uint64_t TM1637_simBusTimeUs(void);
+
+size_t TM1637_simEdgeCount(void);
+const tm1637_sim_edge_t *TM1637_simEdges(void);
+uint32_t TM1637_simDroppedEdges(void);
+
+size_t TM1637_simFrameCount(void);
+const tm1637_sim_frame_t *TM1637_simFrame(size_t index);
+uint32_t TM1637_simDroppedFrames(void);
+
+const tm1637_sim_display_t *TM1637_simDisplay(void);
+
+#endif
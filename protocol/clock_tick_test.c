@@ -0,0 +1,194 @@
+/*
+ * Host check of the tm1637_display clock tick broadcast.
+ *
+ *   cc -std=c99 -Wall -Iprotocol/host -Ifirmware/esp-idf/tm1637_display/main \
+ *       -o clock_tick_test protocol/clock_tick_test.c \
+ *       firmware/esp-idf/tm1637_display/main/clock_tick.c \
+ *       firmware/esp-idf/tm1637_display/main/timekeeping.c \
+ *       protocol/host/esp_host.c
+ *   ./clock_tick_test [ticks] [seed]
+ *
+ * The real tick source (timekeeping.c on the simulated esp_timer of
+ * protocol/host) publishes to several subscribers, starting just before
+ * midnight so second, minute, hour and day rollovers come early and often.
+ * Callbacks run late by a random jitter, sometimes miss whole seconds and
+ * now and then stall past the catch-up window.
+ *
+ * Subscribers that drain after every callback must see every second, in
+ * order, with consecutive sequence numbers and nothing dropped: the missed
+ * seconds of a late callback are all delivered, a stall past the window
+ * resyncs to the current second. One subscriber stops draining for a while;
+ * its overflow has to be counted and reported by ClockTick_wait() without
+ * touching the others. Exits non-zero on the first mismatch.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "timekeeping.h"
+
+/* Defines */
+#define TEST_TICKS_DEFAULT 200000
+#define TEST_SUBSCRIBERS   3                         /* drained every callback */
+#define TEST_START_S       (20000LL * 86400 + 86390) /* 10 s before midnight */
+#define TEST_JITTER_US     5000
+#define TEST_STALL_S       (CLOCK_TICK_QUEUE_LEN + 6)
+#define TEST_PAUSE_CALLS   20                        /* stalled subscriber */
+
+typedef struct {
+    clock_subscriber_t *sub;
+    uint32_t seq;
+    unsigned ticks;
+} test_sub_t;
+
+static uint32_t rng_state;
+static int failures;
+
+/* Private functions */
+static uint32_t rnd(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static void expect(bool ok, const char *what, const char *name, int64_t second) {
+    if (!ok && failures++ < 10) {
+        fprintf(stderr, "FAIL %s (%s, second %lld)\n", what, name,
+                (long long)second);
+    }
+}
+
+static bool same_time(clock_time_t a, clock_time_t b) {
+    return a.hours == b.hours && a.minutes == b.minutes && a.seconds == b.seconds;
+}
+
+static clock_time_t time_of(int64_t second) {
+    return Timekeeping_timeOfDay(second * TIMEKEEPING_US_PER_SEC);
+}
+
+/* Jitter, sometimes missed seconds the catch-up covers, rarely a stall */
+static int64_t lateness(void) {
+    uint32_t r = rnd() % 10000;
+
+    if (r == 0) {
+        return TEST_STALL_S * TIMEKEEPING_US_PER_SEC;
+    }
+    if (r < 50) {
+        return (int64_t)(1 + rnd() % (CLOCK_TICK_QUEUE_LEN - 1)) *
+                   TIMEKEEPING_US_PER_SEC + rnd() % TEST_JITTER_US;
+    }
+    return rnd() % TEST_JITTER_US;
+}
+
+/* Everything published since the last drain must be seconds from..to */
+static void drain(test_sub_t *t, int64_t from, int64_t to) {
+    clock_tick_t tick;
+    int64_t want = from;
+
+    while (ClockTick_wait(t->sub, &tick, 0)) {
+        expect(want <= to, "tick past the current second", t->sub->name, want);
+        expect(same_time(tick.time, time_of(want)), "tick time",
+               t->sub->name, want);
+        expect(tick.seq == t->seq + 1, "consecutive sequence", t->sub->name,
+               want);
+        t->seq = tick.seq;
+        want++;
+        t->ticks++;
+    }
+    expect(want == to + 1, "every second delivered", t->sub->name, to);
+    expect(t->sub->dropped == 0, "nothing dropped", t->sub->name, to);
+}
+
+int main(int argc, char **argv) {
+    long total = argc > 1 ? atol(argv[1]) : TEST_TICKS_DEFAULT;
+    test_sub_t subs[TEST_SUBSCRIBERS];
+    clock_subscriber_t *stalled;
+    clock_tick_t tick;
+    int64_t published = TEST_START_S;
+    unsigned catchups = 0;
+    unsigned resyncs = 0;
+    unsigned minutes = 0;
+    unsigned days = 0;
+    long callbacks = 0;
+
+    rng_state = argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 0) : 0x5449434b;
+    if (rng_state == 0) {
+        rng_state = 1;
+    }
+
+    host_timer_reset(0);
+    for (int i = 0; i < TEST_SUBSCRIBERS; i++) {
+        static const char *const names[TEST_SUBSCRIBERS] = {"display", "alarm",
+                                                            "ble"};
+        subs[i] = (test_sub_t){.sub = ClockTick_subscribe(names[i])};
+    }
+    stalled = ClockTick_subscribe("stalled");
+    if (stalled == NULL || subs[TEST_SUBSCRIBERS - 1].sub == NULL ||
+        !Timekeeping_start(TEST_START_S)) {
+        fprintf(stderr, "FAIL start\n");
+        return 1;
+    }
+
+    while (callbacks < total && failures == 0) {
+        int64_t second;
+        int64_t from;
+
+        host_timer_fire(lateness());
+        callbacks++;
+        second = Timekeeping_nowUs() / TIMEKEEPING_US_PER_SEC;
+
+        /* Late within the window: every second; past it: resync to now */
+        from = published + 1;
+        if (second - published > CLOCK_TICK_QUEUE_LEN) {
+            from = second;
+            resyncs++;
+        } else if (second - published > 1) {
+            catchups++;
+        }
+        for (int64_t s = from; s <= second; s++) {
+            minutes += time_of(s).seconds == 0;
+            days += same_time(time_of(s), time_of(0));
+        }
+        if (second >= from) {
+            published = second;
+        }
+
+        /* Drain order changes, nobody depends on another */
+        for (int i = 0, first = rnd() % TEST_SUBSCRIBERS; i < TEST_SUBSCRIBERS;
+             i++) {
+            test_sub_t *t = &subs[(first + i) % TEST_SUBSCRIBERS];
+
+            drain(t, from, published);
+        }
+        expect(same_time(ClockTick_now(), time_of(published)),
+               "snapshot is the last tick", "now", published);
+
+        /* A subscriber that stops reading loses ticks, counted, then recovers */
+        if (callbacks % 1000 >= TEST_PAUSE_CALLS) {
+            unsigned warnings = host_log_warnings;
+            uint32_t dropped = stalled->dropped;
+
+            while (ClockTick_wait(stalled, &tick, 0)) {
+            }
+            if (callbacks % 1000 == TEST_PAUSE_CALLS) {
+                expect(dropped > 0, "overflow counted", "stalled", published);
+            } else if (callbacks % 1000 == TEST_PAUSE_CALLS + 1) {
+                expect(host_log_warnings > warnings, "gap reported", "stalled",
+                       published);
+                stalled->dropped = 0;
+            }
+        }
+    }
+
+    printf("%ld callbacks, %u ticks each, %u catch-ups, %u resyncs, "
+           "%u minute and %u day rollovers\n",
+           callbacks, subs[0].ticks, catchups, resyncs, minutes, days);
+    if (failures) {
+        printf("FAIL: %d mismatches\n", failures);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
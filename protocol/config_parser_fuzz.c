@@ -0,0 +1,490 @@
+/*
+ * Host fuzz and throughput harness of the GATT server's streaming parser.
+ *
+ *   cc -std=c99 -Wall -fsanitize=address,undefined -Iprotocol \
+ *       -Ifirmware/esp-idf/gatt_server/main/include \
+ *       -o config_parser_fuzz protocol/config_parser_fuzz.c \
+ *       firmware/esp-idf/gatt_server/main/src/config_parser.c
+ *   ./config_parser_fuzz [messages] [seed]
+ *
+ * A corpus of messages like the app sends (compact and spaced-out JSON with
+ * escapes and "commit" flags, binary TLV with every tag, unknown tags and
+ * commits) is fed to config_parser.c whole, one byte at a time and in random
+ * chunks, the way os_mbuf chains arrive. Every chunk is a heap copy of exactly its length,
+ * so the sanitizer catches a read past it. Then every truncation of each
+ * message and random mutations of it, plus pure noise.
+ *
+ * Checked for each input: the result does not depend on the chunking;
+ * generated messages decode to what was generated; binary input is accepted
+ * exactly when mcfg_decode() accepts it, with the same fields; a JSON
+ * message cut short is never accepted, nor is input that starts with
+ * anything but whitespace, '{' or MCFG_MAGIC. Throughput of the three
+ * feeding patterns is reported over the valid corpus. Exits non-zero on
+ * the first mismatch.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "config_parser.h"
+
+/* Defines */
+#define TEST_MESSAGES_DEFAULT 5000
+#define TEST_MSG_MAX          1024
+#define TEST_MUTATIONS        8      /* per message */
+#define TEST_BENCH_ROUNDS     20
+
+typedef struct {
+    uint8_t buf[TEST_MSG_MAX];
+    size_t len;
+    config_update_t want;   /* what it has to decode to */
+} test_msg_t;
+
+static uint32_t rng_state;
+static int failures;
+
+/* Private functions */
+static uint32_t rnd(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static size_t bounded_len(const char *s, size_t max) {
+    const char *end = memchr(s, '\0', max);
+
+    return end != NULL ? (size_t)(end - s) : max;
+}
+
+static void expect(bool ok, const char *what, const uint8_t *buf, size_t len) {
+    if (!ok && failures++ < 10) {
+        fprintf(stderr, "FAIL %s:", what);
+        for (size_t i = 0; i < len && i < 48; i++) {
+            fprintf(stderr, " %02x", buf[i]);
+        }
+        fprintf(stderr, "%s (%u bytes)\n", len > 48 ? " ..." : "",
+                (unsigned)len);
+    }
+}
+
+/* Chunks of 0 (whole), 1 (byte by byte) or random sizes, each its own copy */
+static int parse(const uint8_t *buf, size_t len, size_t chunk,
+                 config_update_t *out) {
+    config_parser_t parser;
+    size_t off = 0;
+
+    config_parser_init(&parser);
+    do {
+        size_t n = chunk == 0 ? len - off : chunk;
+        uint8_t *copy;
+
+        if (chunk == SIZE_MAX) {
+            n = 1 + rnd() % 40;
+        }
+        if (n > len - off) {
+            n = len - off;
+        }
+        copy = malloc(n ? n : 1);
+        memcpy(copy, buf + off, n);
+        config_parser_feed(&parser, copy, n);
+        free(copy);
+        off += n;
+    } while (off < len);
+
+    memset(out, 0, sizeof(*out));
+    return config_parser_finish(&parser, out);
+}
+
+/* Same verdict and update however the input is split */
+static int parse_all_ways(const uint8_t *buf, size_t len,
+                          config_update_t *out) {
+    config_update_t other;
+    int rc = parse(buf, len, 0, out);
+    int rc1 = parse(buf, len, 1, &other);
+
+    expect(rc1 == rc && (rc != CONFIG_PARSER_OK ||
+                         memcmp(&other, out, sizeof(other)) == 0),
+           "byte by byte differs from whole", buf, len);
+    rc1 = parse(buf, len, SIZE_MAX, &other);
+    expect(rc1 == rc && (rc != CONFIG_PARSER_OK ||
+                         memcmp(&other, out, sizeof(other)) == 0),
+           "random chunks differ from whole", buf, len);
+    return rc;
+}
+
+/* Binary input against the flat decoder */
+static void check_binary(const uint8_t *buf, size_t len, int rc,
+                         const config_update_t *got) {
+    mcfg_config_t cfg;
+    bool flat_ok = mcfg_decode(buf, len, &cfg) == MCFG_OK;
+
+    expect((rc == CONFIG_PARSER_OK) == flat_ok,
+           flat_ok ? "binary rejected, mcfg_decode accepts"
+                   : "binary accepted, mcfg_decode rejects",
+           buf, len);
+    if (rc != CONFIG_PARSER_OK || !flat_ok) {
+        return;
+    }
+    expect(got->present == cfg.present, "binary present mask", buf, len);
+    if (cfg.present & MCFG_HAS_SSID) {
+        expect(strlen(got->ssid) == bounded_len(cfg.ssid, cfg.ssid_len) &&
+                   memcmp(got->ssid, cfg.ssid, strlen(got->ssid)) == 0,
+               "binary ssid", buf, len);
+    }
+    if (cfg.present & MCFG_HAS_PSK) {
+        expect(strlen(got->psk) == bounded_len(cfg.psk, cfg.psk_len) &&
+                   memcmp(got->psk, cfg.psk, strlen(got->psk)) == 0,
+               "binary psk", buf, len);
+    }
+    if (cfg.present & MCFG_HAS_TIME) {
+        expect(got->time_hh == cfg.time_hh && got->time_mm == cfg.time_mm,
+               "binary time", buf, len);
+    }
+    if (cfg.present & MCFG_HAS_ALARM) {
+        expect(got->alarm_hh == cfg.alarm_hh && got->alarm_mm == cfg.alarm_mm &&
+                   got->alarm_flags == cfg.alarm_flags,
+               "binary alarm", buf, len);
+    }
+    if (cfg.present & MCFG_HAS_ALARMS) {
+        expect(got->alarm_count == cfg.alarm_count &&
+                   memcmp(got->alarms, cfg.alarms,
+                          cfg.alarm_count * MCFG_ALARM_ENTRY_LEN) == 0,
+               "binary alarm table", buf, len);
+    }
+    if (cfg.present & MCFG_HAS_FX) {
+        expect(got->fx_len == cfg.fx_len &&
+                   memcmp(got->fx, cfg.fx, cfg.fx_len) == 0,
+               "binary effect", buf, len);
+    }
+}
+
+static void check(const uint8_t *buf, size_t len, const config_update_t *want,
+                  bool truncated) {
+    config_update_t got;
+    int rc = parse_all_ways(buf, len, &got);
+    size_t lead = 0;
+
+    while (lead < len && (buf[lead] == ' ' || buf[lead] == '\n' ||
+                          buf[lead] == '\r' || buf[lead] == '\t')) {
+        lead++;
+    }
+    if (lead == len || (buf[lead] != '{' && buf[lead] != MCFG_MAGIC)) {
+        expect(rc != CONFIG_PARSER_OK, "accepted without a format", buf, len);
+        return;
+    }
+    if (buf[0] == MCFG_MAGIC) {
+        check_binary(buf, len, rc, &got);
+    } else if (buf[lead] == '{' && truncated) {
+        expect(rc != CONFIG_PARSER_OK, "truncated JSON accepted", buf, len);
+    }
+    if (want != NULL) {
+        expect(rc == CONFIG_PARSER_OK &&
+                   memcmp(&got, want, sizeof(got)) == 0,
+               "generated message", buf, len);
+    }
+}
+
+/* JSON the way the app builds it, sometimes spaced out between tokens */
+static void json_raw(test_msg_t *m, const char *s) {
+    size_t n = strlen(s);
+
+    memcpy(m->buf + m->len, s, n);
+    m->len += n;
+}
+
+static void json_put(test_msg_t *m, const char *s) {
+    json_raw(m, s);
+    if (rnd() % 4 == 0) {
+        m->buf[m->len++] = " \n\t"[rnd() % 3];
+    }
+}
+
+/* Random string value; escapes decode the way the parser keeps them */
+static void json_string(test_msg_t *m, char *decoded, size_t max) {
+    size_t n = rnd() % (max + 1);
+    size_t out = 0;
+    char enc[8];
+
+    json_raw(m, "\"");
+    for (size_t i = 0; i < n; i++) {
+        uint32_t r = rnd() % 20;
+
+        if (r == 0) {
+            json_raw(m, "\\\"");
+            decoded[out++] = '"';
+        } else if (r == 1) {
+            json_raw(m, "\\n");
+            decoded[out++] = '\n';
+        } else if (r == 2) {
+            json_raw(m, "\\u00e9");
+            decoded[out++] = '?';
+        } else {
+            enc[0] = (char)('a' + rnd() % 26);
+            enc[1] = '\0';
+            json_raw(m, enc);
+            decoded[out++] = enc[0];
+        }
+    }
+    decoded[out] = '\0';
+    json_put(m, "\"");
+}
+
+static void gen_json(test_msg_t *m) {
+    char num[16];
+    bool first = true;
+    uint32_t parts = 1 + rnd() % 7;
+    uint32_t commit = rnd() % 6;   /* 0-1 first, 2-3 last, true when even */
+
+    memset(m, 0, sizeof(*m));
+    json_put(m, "{");
+    if (commit < 2) {
+        json_put(m, commit == 0 ? "\"commit\":true," : "\"commit\":false,");
+    }
+    if (parts & 1) {
+        json_put(m, "\"wifi\":{\"ssid\":");
+        json_string(m, m->want.ssid, MCFG_SSID_MAX);
+        json_put(m, ",\"psk\":");
+        json_string(m, m->want.psk, MCFG_PSK_MAX);
+        json_put(m, "}");
+        m->want.present |= MCFG_HAS_SSID | MCFG_HAS_PSK;
+        first = false;
+    }
+    if (parts & 2) {
+        m->want.time_hh = rnd() % 24;
+        m->want.time_mm = rnd() % 60;
+        snprintf(num, sizeof(num), "%u", m->want.time_hh);
+        json_put(m, first ? "\"time\":{\"hh\":" : ",\"time\":{\"hh\":");
+        json_put(m, num);
+        snprintf(num, sizeof(num), "%u", m->want.time_mm);
+        json_put(m, ",\"mm\":");
+        json_put(m, num);
+        json_put(m, "}");
+        m->want.present |= MCFG_HAS_TIME;
+        first = false;
+    }
+    if (parts & 4) {
+        m->want.alarm_hh = rnd() % 24;
+        m->want.alarm_mm = rnd() % 60;
+        m->want.alarm_flags = rnd() & 1 ? MCFG_ALARM_F_ENABLED : 0;
+        snprintf(num, sizeof(num), "%u", m->want.alarm_hh);
+        json_put(m, first ? "\"alarm\":{\"hh\":" : ",\"alarm\":{\"hh\":");
+        json_put(m, num);
+        snprintf(num, sizeof(num), "%u", m->want.alarm_mm);
+        json_put(m, ",\"mm\":");
+        json_put(m, num);
+        json_put(m, ",\"enabled\":");
+        json_put(m, m->want.alarm_flags ? "true" : "false");
+        json_put(m, "}");
+        m->want.present |= MCFG_HAS_ALARM;
+    }
+    if (commit == 2 || commit == 3) {
+        json_put(m, commit == 2 ? ",\"commit\":true" : ",\"commit\":false");
+    }
+    if (commit == 0 || commit == 2) {
+        m->want.present |= MCFG_HAS_COMMIT;
+    }
+    /* Closing brace last, no trailing space: every prefix is incomplete */
+    m->buf[m->len++] = '}';
+}
+
+static void gen_binary(test_msg_t *m) {
+    mcfg_writer_t w;
+    uint8_t value[UINT8_MAX];
+    uint32_t n = rnd() % 6;
+
+    memset(m, 0, sizeof(*m));
+    mcfg_writer_init(&w, m->buf, sizeof(m->buf));
+    for (uint32_t i = 0; i < n; i++) {
+        uint8_t len;
+
+        switch (rnd() % 8) {
+        case 0:
+            len = rnd() % (MCFG_SSID_MAX + 1);
+            for (uint8_t k = 0; k < len; k++) {
+                value[k] = (uint8_t)('A' + rnd() % 26);
+            }
+            mcfg_put(&w, MCFG_TAG_WIFI_SSID, value, len);
+            memcpy(m->want.ssid, value, len);
+            m->want.ssid[len] = '\0';
+            m->want.present |= MCFG_HAS_SSID;
+            break;
+        case 1:
+            len = rnd() % (MCFG_PSK_MAX + 1);
+            for (uint8_t k = 0; k < len; k++) {
+                value[k] = (uint8_t)('a' + rnd() % 26);
+            }
+            mcfg_put(&w, MCFG_TAG_WIFI_PSK, value, len);
+            memcpy(m->want.psk, value, len);
+            m->want.psk[len] = '\0';
+            m->want.present |= MCFG_HAS_PSK;
+            break;
+        case 2:
+            m->want.time_hh = rnd() % 24;
+            m->want.time_mm = rnd() % 60;
+            mcfg_put_time(&w, m->want.time_hh, m->want.time_mm);
+            m->want.present |= MCFG_HAS_TIME;
+            break;
+        case 3:
+            m->want.alarm_hh = rnd() % 24;
+            m->want.alarm_mm = rnd() % 60;
+            m->want.alarm_flags = rnd() & 3;
+            mcfg_put_alarm(&w, m->want.alarm_hh, m->want.alarm_mm,
+                           m->want.alarm_flags);
+            m->want.present |= MCFG_HAS_ALARM;
+            break;
+        case 4:
+            m->want.alarm_count = rnd() % (MCFG_ALARMS_MAX + 1);
+            for (uint8_t k = 0; k < m->want.alarm_count; k++) {
+                mcfg_alarm_entry(m->want.alarms + k * MCFG_ALARM_ENTRY_LEN,
+                                 rnd() % 24, rnd() % 60, rnd() & 0x7f,
+                                 rnd() & 3, rnd() % 30);
+            }
+            mcfg_put_alarms(&w, m->want.alarms, m->want.alarm_count);
+            m->want.present |= MCFG_HAS_ALARMS;
+            break;
+        case 5:
+            m->want.fx_len = rnd() % (MCFG_FX_MAX + 1);
+            for (uint8_t k = 0; k < m->want.fx_len; k++) {
+                m->want.fx[k] = (uint8_t)rnd();
+            }
+            mcfg_put_fx(&w, m->want.fx, m->want.fx_len);
+            m->want.present |= MCFG_HAS_FX;
+            break;
+        case 6:
+            len = rnd() % 16;
+            mcfg_put(&w, (uint8_t)(0x40 + rnd() % 0x40), value, len);
+            break;
+        default:
+            mcfg_put_commit(&w);
+            m->want.present |= MCFG_HAS_COMMIT;
+            break;
+        }
+    }
+    m->len = w.len;
+}
+
+static void mutate(uint8_t *buf, size_t *len) {
+    switch (rnd() % 4) {
+    case 0:
+        buf[rnd() % *len] ^= (uint8_t)(1u << (rnd() % 8));
+        break;
+    case 1:
+        buf[rnd() % *len] = (uint8_t)rnd();
+        break;
+    case 2:
+        /* Length bytes and structure are where it hurts */
+        buf[rnd() % *len] = "{}:,\"\\\x00\xff"[rnd() % 8];
+        break;
+    default:
+        if (*len < TEST_MSG_MAX) {
+            size_t at = rnd() % (*len + 1);
+            memmove(buf + at + 1, buf + at, *len - at);
+            buf[at] = (uint8_t)rnd();
+            (*len)++;
+        }
+        break;
+    }
+}
+
+static double bench(const test_msg_t *msgs, int count, size_t chunk,
+                    size_t *bytes) {
+    config_update_t out;
+    clock_t t0 = clock();
+    double s;
+
+    *bytes = 0;
+    for (int round = 0; round < TEST_BENCH_ROUNDS; round++) {
+        for (int i = 0; i < count; i++) {
+            config_parser_t parser;
+
+            config_parser_init(&parser);
+            if (chunk == 0) {
+                config_parser_feed(&parser, msgs[i].buf, msgs[i].len);
+            } else {
+                for (size_t off = 0; off < msgs[i].len; off += chunk) {
+                    size_t n = msgs[i].len - off < chunk ? msgs[i].len - off
+                                                         : chunk;
+                    config_parser_feed(&parser, msgs[i].buf + off, n);
+                }
+            }
+            config_parser_finish(&parser, &out);
+            *bytes += msgs[i].len;
+        }
+    }
+    s = (double)(clock() - t0) / CLOCKS_PER_SEC;
+    return s > 0 ? *bytes / s : 0;
+}
+
+int main(int argc, char **argv) {
+    int count = argc > 1 ? atoi(argv[1]) : TEST_MESSAGES_DEFAULT;
+    test_msg_t *msgs = calloc((size_t)count, sizeof(*msgs));
+    unsigned inputs = 0;
+    size_t bytes;
+
+    rng_state = argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 0) : 0x43464750;
+    if (rng_state == 0) {
+        rng_state = 1;
+    }
+    if (msgs == NULL) {
+        return 1;
+    }
+
+    for (int i = 0; i < count && failures == 0; i++) {
+        test_msg_t *m = &msgs[i];
+        uint8_t buf[TEST_MSG_MAX];
+
+        if (i % 2) {
+            gen_json(m);
+        } else {
+            gen_binary(m);
+        }
+        check(m->buf, m->len, &m->want, false);
+        inputs++;
+
+        for (size_t cut = 0; cut < m->len; cut++) {
+            check(m->buf, cut, NULL, true);
+            inputs++;
+        }
+        for (int k = 0; k < TEST_MUTATIONS; k++) {
+            size_t len = m->len;
+
+            memcpy(buf, m->buf, len);
+            for (int n = 1 + rnd() % 3; n > 0; n--) {
+                mutate(buf, &len);
+            }
+            check(buf, len, NULL, false);
+            inputs++;
+        }
+
+        /* Noise, sometimes behind a valid first byte */
+        bytes = rnd() % 64;
+        for (size_t k = 0; k < bytes; k++) {
+            buf[k] = (uint8_t)rnd();
+        }
+        if (bytes > 0 && rnd() % 2) {
+            buf[0] = rnd() % 2 ? '{' : MCFG_MAGIC;
+        }
+        check(buf, bytes, NULL, false);
+        inputs++;
+    }
+    printf("%u inputs from %d messages, each fed whole, bytewise and "
+           "chunked\n",
+           inputs, count);
+
+    printf("throughput: whole %.1f MB/s, 20-byte chunks %.1f MB/s, ",
+           bench(msgs, count, 0, &bytes) / 1e6,
+           bench(msgs, count, 20, &bytes) / 1e6);
+    printf("bytewise %.1f MB/s (%u bytes x %d)\n",
+           bench(msgs, count, 1, &bytes) / 1e6,
+           (unsigned)(bytes / TEST_BENCH_ROUNDS), TEST_BENCH_ROUNDS);
+
+    free(msgs);
+    if (failures) {
+        printf("FAIL: %d mismatches\n", failures);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
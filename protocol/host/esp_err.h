@@ -0,0 +1,12 @@
+/* Host stand-in for the ESP-IDF header, for the protocol/ host tests */
+#ifndef HOST_ESP_ERR_H
+#define HOST_ESP_ERR_H
+
+typedef int esp_err_t;
+
+#define ESP_OK          0
+#define ESP_FAIL        -1
+#define ESP_ERR_NO_MEM  0x101
+#define ESP_ERR_TIMEOUT 0x107
+
+#endif /* HOST_ESP_ERR_H */
@@ -0,0 +1,156 @@
+/*
+ * Host implementations behind the stand-in headers in protocol/host:
+ * a simulated esp_timer clock and non-blocking FreeRTOS queues. Linked
+ * into the host tests that build firmware sources as they are.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/queue.h"
+
+/* Defines */
+#define HOST_TIMERS_MAX 8
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void *arg;
+    bool armed;
+    int64_t due_us;
+    uint64_t period_us;   /* 0 = one-shot */
+};
+
+struct host_queue {
+    uint32_t length;
+    uint32_t item_size;
+    uint32_t head;
+    uint32_t count;
+    uint8_t items[];
+};
+
+unsigned host_log_warnings;
+unsigned host_log_errors;
+
+static struct esp_timer timers[HOST_TIMERS_MAX];
+static int timer_count;
+static int64_t now_us;
+
+/* esp_timer */
+int64_t esp_timer_get_time(void) { return now_us; }
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args,
+                           esp_timer_handle_t *out) {
+    if (timer_count == HOST_TIMERS_MAX) {
+        return ESP_ERR_NO_MEM;
+    }
+    timers[timer_count] = (struct esp_timer){
+        .callback = args->callback,
+        .arg = args->arg,
+    };
+    *out = &timers[timer_count++];
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    timer->armed = true;
+    timer->due_us = now_us + (int64_t)timeout_us;
+    timer->period_us = 0;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer,
+                                   uint64_t period_us) {
+    esp_timer_start_once(timer, period_us);
+    timer->period_us = period_us;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    timer->armed = false;
+    return ESP_OK;
+}
+
+void host_timer_reset(int64_t start_us) {
+    memset(timers, 0, sizeof(timers));
+    timer_count = 0;
+    now_us = start_us;
+    host_log_warnings = 0;
+    host_log_errors = 0;
+}
+
+int64_t host_timer_next_us(void) {
+    int64_t next = INT64_MAX;
+
+    for (int i = 0; i < timer_count; i++) {
+        if (timers[i].armed && timers[i].due_us < next) {
+            next = timers[i].due_us;
+        }
+    }
+    return next;
+}
+
+bool host_timer_fire(int64_t late_us) {
+    struct esp_timer *timer = NULL;
+
+    for (int i = 0; i < timer_count; i++) {
+        if (timers[i].armed && (timer == NULL || timers[i].due_us < timer->due_us)) {
+            timer = &timers[i];
+        }
+    }
+    if (timer == NULL) {
+        return false;
+    }
+
+    /* The clock never goes back, a late timer only moves it further */
+    if (timer->due_us + late_us > now_us) {
+        now_us = timer->due_us + late_us;
+    }
+    if (timer->period_us != 0) {
+        timer->due_us += (int64_t)timer->period_us;
+    } else {
+        timer->armed = false;
+    }
+    timer->callback(timer->arg);
+    return true;
+}
+
+/* FreeRTOS queues */
+QueueHandle_t xQueueCreate(uint32_t length, uint32_t item_size) {
+    QueueHandle_t queue = calloc(1, sizeof(*queue) + length * item_size);
+
+    if (queue != NULL) {
+        queue->length = length;
+        queue->item_size = item_size;
+    }
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue) { free(queue); }
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait) {
+    uint32_t tail;
+
+    (void)wait;
+    if (queue->count == queue->length) {
+        return pdFALSE;
+    }
+    tail = (queue->head + queue->count) % queue->length;
+    memcpy(queue->items + tail * queue->item_size, item, queue->item_size);
+    queue->count++;
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t wait) {
+    (void)wait;
+    if (queue->count == 0) {
+        return pdFALSE;
+    }
+    memcpy(item, queue->items + queue->head * queue->item_size,
+           queue->item_size);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    return pdTRUE;
+}
+
+uint32_t uxQueueMessagesWaiting(QueueHandle_t queue) { return queue->count; }
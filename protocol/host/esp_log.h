@@ -0,0 +1,19 @@
+/*
+ * Host stand-in for the ESP-IDF header, for the protocol/ host tests.
+ * Messages are dropped; warnings and errors are counted, so a test can
+ * tell whether the code under test complained.
+ */
+#ifndef HOST_ESP_LOG_H
+#define HOST_ESP_LOG_H
+
+#include <inttypes.h>
+
+extern unsigned host_log_warnings;
+extern unsigned host_log_errors;
+
+#define ESP_LOGE(tag, ...) ((void)(tag), host_log_errors++)
+#define ESP_LOGW(tag, ...) ((void)(tag), host_log_warnings++)
+#define ESP_LOGI(tag, ...) ((void)(tag))
+#define ESP_LOGD(tag, ...) ((void)(tag))
+
+#endif /* HOST_ESP_LOG_H */
@@ -0,0 +1,46 @@
+/*
+ * Host stand-in for esp_timer, for the protocol/ host tests.
+ *
+ * Time does not run by itself: esp_timer_get_time() returns the simulated
+ * clock, and the test moves it with host_timer_fire(), which runs the
+ * earliest armed timer as late as the test asks for.
+ */
+#ifndef HOST_ESP_TIMER_H
+#define HOST_ESP_TIMER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+typedef struct esp_timer *esp_timer_handle_t;
+typedef void (*esp_timer_cb_t)(void *arg);
+
+typedef enum {
+    ESP_TIMER_TASK,
+    ESP_TIMER_ISR,
+} esp_timer_dispatch_t;
+
+typedef struct {
+    esp_timer_cb_t callback;
+    void *arg;
+    esp_timer_dispatch_t dispatch_method;
+    const char *name;
+    bool skip_unhandled_events;
+} esp_timer_create_args_t;
+
+int64_t esp_timer_get_time(void);
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args,
+                           esp_timer_handle_t *out);
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us);
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us);
+esp_err_t esp_timer_stop(esp_timer_handle_t timer);
+
+/* Test side */
+void host_timer_reset(int64_t now_us);
+/* Due time of the earliest armed timer, INT64_MAX if none */
+int64_t host_timer_next_us(void);
+/* Move the clock to the earliest due time plus late_us and run that timer */
+bool host_timer_fire(int64_t late_us);
+
+#endif /* HOST_ESP_TIMER_H */
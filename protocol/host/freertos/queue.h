@@ -0,0 +1,19 @@
+/*
+ * Host stand-in for FreeRTOS queues, for the protocol/ host tests.
+ * Nothing blocks: a full send and an empty receive fail at once,
+ * whatever the timeout.
+ */
+#ifndef HOST_FREERTOS_QUEUE_H
+#define HOST_FREERTOS_QUEUE_H
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_queue *QueueHandle_t;
+
+QueueHandle_t xQueueCreate(uint32_t length, uint32_t item_size);
+void vQueueDelete(QueueHandle_t queue);
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait);
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t wait);
+uint32_t uxQueueMessagesWaiting(QueueHandle_t queue);
+
+#endif /* HOST_FREERTOS_QUEUE_H */
@@ -0,0 +1,321 @@
+/*
+ * Mustang clock alarm scheduler.
+ *
+ * Shared by the Arduino sketch and the ESP-IDF firmwares. Holds up to
+ * MCFG_ALARMS_MAX alarms, each with a weekday mask, one-shot or recurring,
+ * and its own snooze length; entries use the MCFG_TAG_ALARMS wire format
+ * from mustang_cfg.h.
+ *
+ * Nothing compares alarms against the clock on every tick. Whenever
+ * something changes (table, ring, snooze, wall clock set) malarm_plan()
+ * works out the next instant any alarm is due, and malarm_next() hands it
+ * out in O(1); the owner arms a single one-shot timer for it and sleeps
+ * until then.
+ *
+ * Alarms are local wall times, resolved with mktime()/localtime_r() in the
+ * current TZ:
+ *   - a time skipped by a DST jump forward rings at the first minute after
+ *     the jump
+ *   - a time repeated by a DST jump back rings once, at the first
+ *     occurrence the clock reaches moving forward
+ *   - an alarm rings at most once per local day
+ * Setting the wall clock does not move the planned instant, call
+ * malarm_plan() again after settimeofday() or an NTP sync.
+ */
+#ifndef MUSTANG_ALARM_H
+#define MUSTANG_ALARM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "mustang_cfg.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Defines */
+#define MALARM_NONE  -1
+#define MALARM_NEVER INT32_MIN   /* rang_day before the first ring */
+
+/* Local days searched per alarm: yesterday (a repeated hour across
+ * midnight), today and a full week */
+#define MALARM_FIRST_DAY -1
+#define MALARM_LAST_DAY  7
+
+typedef struct {
+    uint8_t hh;
+    uint8_t mm;
+    uint8_t days;                /* MCFG_ALARM_DAYS_ALL bits */
+    uint8_t flags;               /* MCFG_ALARM_F_* */
+    uint8_t snooze_min;
+} malarm_t;
+
+typedef struct {
+    malarm_t alarm[MCFG_ALARMS_MAX];
+    int32_t rang_day[MCFG_ALARMS_MAX];   /* local day of the last ring */
+    uint8_t count;
+    int8_t last;                 /* alarm that rang last, for snooze */
+    int8_t snooze_idx;           /* snoozed alarm or MALARM_NONE */
+    time_t snooze_at;
+
+    /* Planned by malarm_plan() */
+    int8_t next_idx;             /* MALARM_NONE when nothing is due */
+    bool next_snooze;
+    int32_t next_day;            /* local day the ring counts for */
+    time_t next_at;
+} malarm_sched_t;
+
+/* Helpers */
+/* Days since 1970-01-01 of a proleptic Gregorian date */
+static inline int32_t malarm_days_from_civil(int y, int m, int d) {
+    y -= m <= 2;
+    int32_t era = (y >= 0 ? y : y - 399) / 400;
+    int32_t yoe = y - era * 400;
+    int32_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    int32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+    return era * 146097 + doe - 719468;
+}
+
+/* 1970-01-01 was a Thursday */
+static inline int malarm_weekday(int32_t day) {
+    return (int)((day % 7 + 11) % 7);
+}
+
+/* Local wall time of t as day * 1440 + minute of the day */
+static inline int64_t malarm_wall(time_t t, int32_t *day) {
+    struct tm tm;
+    int32_t d;
+
+    localtime_r(&t, &tm);
+    d = malarm_days_from_civil(tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday);
+    if (day) {
+        *day = d;
+    }
+    return (int64_t)d * 1440 + tm.tm_hour * 60 + tm.tm_min;
+}
+
+/*
+ * First instant after now at which a is due on local day `day`, whose
+ * date is in tm. False when it has already passed.
+ */
+static inline bool malarm_on_day(const malarm_t *a, int32_t day, struct tm tm,
+                                 time_t now, time_t *at) {
+    int64_t want = (int64_t)day * 1440 + a->hh * 60 + a->mm;
+    int64_t wall;
+    time_t t;
+    time_t best = 0;
+    bool found = false;
+
+    tm.tm_hour = a->hh;
+    tm.tm_min = a->mm;
+    tm.tm_sec = 0;
+    tm.tm_isdst = -1;
+    t = mktime(&tm);
+    if (t == (time_t)-1) {
+        return false;
+    }
+
+    wall = malarm_wall(t, NULL);
+    if (wall != want) {
+        /* Skipped by a jump forward; mktime() may normalise either way,
+         * settle on the first minute at or past the wanted wall time */
+        while (wall < want) {
+            t += 60;
+            wall = malarm_wall(t, NULL);
+        }
+        while (malarm_wall(t - 60, NULL) >= want) {
+            t -= 60;
+        }
+        *at = t;
+        return t > now;
+    }
+
+    /* Possibly repeated by a jump back (30 or 60 minutes), take the
+     * earliest occurrence still ahead; one the clock jumps back onto does
+     * not count, the minute before it already was past the alarm */
+    for (int k = -2; k <= 2; k++) {
+        time_t c = t + k * 1800;
+        if (c > now && (!found || c < best) && malarm_wall(c, NULL) == want &&
+            malarm_wall(c - 60, NULL) < want) {
+            best = c;
+            found = true;
+        }
+    }
+    *at = best;
+    return found;
+}
+
+/* Next ring of alarm i after now, searched day by day */
+static inline bool malarm_next_of(const malarm_sched_t *s, int i, time_t now,
+                                  time_t *at, int32_t *ring_day) {
+    const malarm_t *a = &s->alarm[i];
+    struct tm date;
+    int32_t today;
+
+    if (!(a->flags & MCFG_ALARM_F_ENABLED) ||
+        !(a->days & MCFG_ALARM_DAYS_ALL)) {
+        return false;
+    }
+
+    localtime_r(&now, &date);
+    today = malarm_days_from_civil(date.tm_year + 1900, date.tm_mon + 1,
+                                   date.tm_mday);
+    for (int d = MALARM_FIRST_DAY; d <= MALARM_LAST_DAY; d++) {
+        int32_t day = today + d;
+        struct tm tm = date;
+
+        if (!(a->days & (1u << malarm_weekday(day))) ||
+            s->rang_day[i] == day) {
+            continue;
+        }
+        tm.tm_mday = date.tm_mday + d;   /* mktime() normalises */
+        if (malarm_on_day(a, day, tm, now, at)) {
+            *ring_day = day;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Public functions */
+static inline void malarm_init(malarm_sched_t *s) {
+    memset(s, 0, sizeof(*s));
+    s->last = MALARM_NONE;
+    s->snooze_idx = MALARM_NONE;
+    s->next_idx = MALARM_NONE;
+}
+
+/*
+ * Work out the next ring after now: O(count), called on changes only.
+ * A snooze wins a tie with a regular alarm.
+ */
+static inline void malarm_plan(malarm_sched_t *s, time_t now) {
+    time_t at;
+    int32_t day;
+
+    s->next_idx = MALARM_NONE;
+    s->next_snooze = false;
+    for (int i = 0; i < s->count; i++) {
+        if (malarm_next_of(s, i, now, &at, &day) &&
+            (s->next_idx == MALARM_NONE || at < s->next_at)) {
+            s->next_idx = (int8_t)i;
+            s->next_at = at;
+            s->next_day = day;
+        }
+    }
+
+    if (s->snooze_idx != MALARM_NONE &&
+        (s->next_idx == MALARM_NONE || s->snooze_at <= s->next_at)) {
+        s->next_idx = s->snooze_idx;
+        s->next_at = s->snooze_at;
+        s->next_snooze = true;
+    }
+}
+
+/* Replace the table with count wire entries without planning anything,
+ * for a wall clock that is not set yet; malarm_plan() once it is */
+static inline void malarm_load(malarm_sched_t *s, const uint8_t *entries,
+                               uint8_t count) {
+    malarm_init(s);
+    if (count > MCFG_ALARMS_MAX) {
+        count = MCFG_ALARMS_MAX;
+    }
+    for (int i = 0; i < count; i++) {
+        const uint8_t *e = entries + i * MCFG_ALARM_ENTRY_LEN;
+        malarm_t *a = &s->alarm[i];
+
+        a->hh = e[0];
+        a->mm = e[1];
+        a->days = e[2];
+        a->flags = e[3];
+        a->snooze_min = e[4];
+        s->rang_day[i] = MALARM_NEVER;
+    }
+    s->count = count;
+}
+
+/* Replace the table with count wire entries, see MCFG_TAG_ALARMS */
+static inline void malarm_set(malarm_sched_t *s, const uint8_t *entries,
+                              uint8_t count, time_t now) {
+    malarm_load(s, entries, count);
+    malarm_plan(s, now);
+}
+
+/* Table back in wire format, e.g. to persist one-shots that disabled
+ * themselves; returns the entry count */
+static inline uint8_t malarm_encode(const malarm_sched_t *s, uint8_t *out) {
+    for (int i = 0; i < s->count; i++) {
+        const malarm_t *a = &s->alarm[i];
+        mcfg_alarm_entry(out + i * MCFG_ALARM_ENTRY_LEN, a->hh, a->mm, a->days,
+                         a->flags, a->snooze_min);
+    }
+    return s->count;
+}
+
+/* O(1): planned instant and alarm, false when nothing is due */
+static inline bool malarm_next(const malarm_sched_t *s, time_t *at,
+                               int *idx) {
+    if (s->next_idx == MALARM_NONE) {
+        return false;
+    }
+    *at = s->next_at;
+    if (idx) {
+        *idx = s->next_idx;
+    }
+    return true;
+}
+
+/*
+ * Ring the planned alarm if now has reached it and plan the next one.
+ * Returns the alarm index, or MALARM_NONE when it is not due yet (a timer
+ * that fired early, or a clock that was set back).
+ */
+static inline int malarm_ring(malarm_sched_t *s, time_t now) {
+    int idx = s->next_idx;
+
+    if (idx == MALARM_NONE || now < s->next_at) {
+        return MALARM_NONE;
+    }
+    if (s->next_snooze) {
+        s->snooze_idx = MALARM_NONE;
+    } else {
+        s->rang_day[idx] = s->next_day;
+        if (s->alarm[idx].flags & MCFG_ALARM_F_ONESHOT) {
+            s->alarm[idx].flags &= (uint8_t)~MCFG_ALARM_F_ENABLED;
+        }
+    }
+    s->last = (int8_t)idx;
+    malarm_plan(s, now);
+    return idx;
+}
+
+/* Ring the last alarm again after its snooze length; false if none rang */
+static inline bool malarm_snooze(malarm_sched_t *s, time_t now) {
+    uint8_t min;
+
+    if (s->last == MALARM_NONE) {
+        return false;
+    }
+    min = s->alarm[s->last].snooze_min;
+    s->snooze_idx = s->last;
+    s->snooze_at = now + 60 * (min ? min : MCFG_ALARM_SNOOZE_DEFAULT);
+    malarm_plan(s, now);
+    return true;
+}
+
+/* Stop snoozing */
+static inline void malarm_dismiss(malarm_sched_t *s, time_t now) {
+    s->snooze_idx = MALARM_NONE;
+    s->last = MALARM_NONE;
+    malarm_plan(s, now);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MUSTANG_ALARM_H
@@ -0,0 +1,332 @@
+/*
+ * Host check of the alarm scheduler against a brute-force reference.
+ *
+ *   cc -std=c99 -D_DEFAULT_SOURCE -Wall -o mustang_alarm_test \
+ *       protocol/mustang_alarm_test.c
+ *   ./mustang_alarm_test [sets] [seed]
+ *
+ * For thousands of random alarm tables, start times and time zones, every
+ * planned ring (and snooze) from mustang_alarm.h must match a reference
+ * that walks the local clock minute by minute: an alarm rings at the first
+ * minute whose step covers its wall time, at most once per local day.
+ * Start times and alarm times cluster around DST changes and midnight, so
+ * skipped and repeated hours as well as day and week rollovers get hit.
+ * Exits non-zero on the first mismatch.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "mustang_alarm.h"
+
+/* Defines */
+#define TEST_SETS_DEFAULT 4000
+#define TEST_RINGS        6
+#define TEST_SCAN_DAYS    10   /* reference gives up after this */
+
+typedef struct {
+    malarm_t alarm[MCFG_ALARMS_MAX];
+    int32_t rang_day[MCFG_ALARMS_MAX];
+    int count;
+    int snooze_idx;
+    time_t snooze_at;
+} ref_t;
+
+typedef struct {
+    unsigned rings;
+    unsigned snoozes;
+    unsigned gap_rings;    /* rang on a step that skipped wall time */
+    unsigned repeat_steps; /* steps where the wall clock went back */
+    unsigned idle_sets;    /* nothing enabled, both must say so */
+} test_stats_t;
+
+/* POSIX TZ strings, no tzdata needed */
+static const char *const zones[] = {
+    "UTC0",
+    "CET-1CEST,M3.5.0,M10.5.0/3",
+    "EST5EDT,M3.2.0,M11.1.0",
+    "<+1030>-10:30<+11>-11,M10.1.0,M4.1.0",   /* 30 minute shift */
+    "<-04>4<-03>,M9.1.6/24,M4.1.6/24",        /* changes at midnight */
+};
+
+static uint32_t rng_state;
+
+/* Private functions */
+static uint32_t rnd(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static int rnd_in(int lo, int hi) {
+    return lo + (int)(rnd() % (uint32_t)(hi - lo + 1));
+}
+
+/* Next UTC offset change within 40 days of t, 0 if none (UTC0) */
+static time_t next_change(time_t t) {
+    for (time_t end = t + 40 * 86400; t < end; t += 1800) {
+        if (malarm_wall(t + 1800, NULL) - malarm_wall(t, NULL) != 30) {
+            return t;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Start somewhere in 2024..2030, half the time in a month with a change;
+ * of those, most land up to a day and a half before the change itself
+ */
+static time_t random_start(void) {
+    static const int months[] = {3, 4, 9, 10, 11};
+    struct tm tm = {0};
+    bool hot = rnd() & 1;
+    time_t t;
+    time_t change;
+
+    tm.tm_year = rnd_in(124, 130);
+    tm.tm_mon = hot ? months[rnd_in(0, 4)] - 1 : rnd_in(0, 11);
+    tm.tm_mday = rnd_in(1, 28);
+    tm.tm_hour = rnd_in(0, 23);
+    tm.tm_min = rnd_in(0, 59);
+    tm.tm_sec = rnd_in(0, 59);
+    tm.tm_isdst = -1;
+    t = mktime(&tm);
+
+    if (hot && rnd_in(0, 3) != 0 && (change = next_change(t)) != 0) {
+        t = change - rnd_in(0, 36 * 3600);
+    }
+    return t;
+}
+
+static void random_alarm(uint8_t *e) {
+    static const uint8_t change_hours[] = {0, 1, 2, 3, 23};
+    uint8_t hh = (rnd() & 1) ? change_hours[rnd_in(0, 4)]
+                             : (uint8_t)rnd_in(0, 23);
+    uint8_t mm = (rnd() & 1) ? (uint8_t)(rnd_in(0, 3) * 15)
+                             : (uint8_t)rnd_in(0, 59);
+    uint8_t days;
+    uint8_t flags = 0;
+
+    switch (rnd_in(0, 3)) {
+    case 0:
+        days = MCFG_ALARM_DAYS_ALL;
+        break;
+    case 1:
+        days = (uint8_t)(1u << rnd_in(0, 6));
+        break;
+    default:
+        days = (uint8_t)(rnd() & MCFG_ALARM_DAYS_ALL);
+        break;
+    }
+    if (rnd_in(0, 7) != 0) {
+        flags |= MCFG_ALARM_F_ENABLED;
+    }
+    if (rnd_in(0, 3) == 0) {
+        flags |= MCFG_ALARM_F_ONESHOT;
+    }
+    mcfg_alarm_entry(e, hh, mm, days, flags, (uint8_t)rnd_in(0, 15));
+}
+
+/*
+ * Reference: step the clock a minute at a time from the first minute
+ * boundary after now. The step (prev, cur] covers the wall times it jumps
+ * over, so skipped alarms ring on the first minute after a jump forward and
+ * a jump back covers nothing new.
+ */
+static bool ref_next(const ref_t *r, time_t now, time_t *at, int *idx,
+                     int32_t *ring_day, test_stats_t *st) {
+    time_t t = now - now % 60 + 60;
+    time_t end = now + TEST_SCAN_DAYS * 86400;
+    int64_t prev = malarm_wall(t - 60, NULL);
+
+    for (; t <= end; t += 60) {
+        int64_t cur = malarm_wall(t, NULL);
+
+        if (r->snooze_idx != MALARM_NONE && r->snooze_at <= t) {
+            *at = r->snooze_at;
+            *idx = r->snooze_idx;
+            *ring_day = MALARM_NEVER;
+            return true;
+        }
+        if (cur < prev) {
+            st->repeat_steps++;
+        }
+        for (int i = 0; i < r->count && cur > prev; i++) {
+            const malarm_t *a = &r->alarm[i];
+
+            if (!(a->flags & MCFG_ALARM_F_ENABLED)) {
+                continue;
+            }
+            for (int32_t day = (int32_t)(prev / 1440);
+                 day <= (int32_t)(cur / 1440); day++) {
+                int64_t w = (int64_t)day * 1440 + a->hh * 60 + a->mm;
+
+                if (w > prev && w <= cur &&
+                    (a->days & (1u << malarm_weekday(day))) &&
+                    r->rang_day[i] != day) {
+                    if (cur - prev > 1) {
+                        st->gap_rings++;
+                    }
+                    *at = t;
+                    *idx = i;
+                    *ring_day = day;
+                    return true;
+                }
+            }
+        }
+        prev = cur;
+    }
+
+    if (r->snooze_idx != MALARM_NONE) {
+        *at = r->snooze_at;
+        *idx = r->snooze_idx;
+        *ring_day = MALARM_NEVER;
+        return true;
+    }
+    return false;
+}
+
+static void print_alarms(const ref_t *r) {
+    for (int i = 0; i < r->count; i++) {
+        const malarm_t *a = &r->alarm[i];
+        fprintf(stderr, "  [%d] %02u:%02u days=0x%02x flags=0x%02x snooze=%u\n",
+                i, a->hh, a->mm, a->days, a->flags, a->snooze_min);
+    }
+}
+
+static void print_time(const char *what, time_t t) {
+    struct tm tm;
+    char buf[48];
+
+    localtime_r(&t, &tm);
+    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S %Z %a", &tm);
+    fprintf(stderr, "  %s %s (%lld)\n", what, buf, (long long)t);
+}
+
+/* Wire round trip: the table goes out as one TLV and decodes unchanged */
+static bool check_wire(const uint8_t *entries, uint8_t count) {
+    uint8_t msg[MCFG_HEADER_LEN + 2 + MCFG_ALARMS_MAX * MCFG_ALARM_ENTRY_LEN];
+    mcfg_writer_t w;
+    mcfg_config_t cfg;
+
+    mcfg_writer_init(&w, msg, sizeof(msg));
+    mcfg_put_alarms(&w, entries, count);
+    return !w.overflow && mcfg_decode(msg, w.len, &cfg) == MCFG_OK &&
+           (cfg.present & MCFG_HAS_ALARMS) && cfg.alarm_count == count &&
+           (count == 0 ||
+            memcmp(cfg.alarms, entries, count * MCFG_ALARM_ENTRY_LEN) == 0);
+}
+
+static bool run_set(int n, test_stats_t *st) {
+    uint8_t entries[MCFG_ALARMS_MAX * MCFG_ALARM_ENTRY_LEN];
+    uint8_t count = (uint8_t)rnd_in(0, MCFG_ALARMS_MAX);
+    malarm_sched_t s;
+    ref_t r;
+    time_t now = random_start();
+    bool any = false;
+
+    for (int i = 0; i < count; i++) {
+        random_alarm(entries + i * MCFG_ALARM_ENTRY_LEN);
+    }
+    if (!check_wire(entries, count)) {
+        fprintf(stderr, "set %d: alarm table does not survive the wire\n", n);
+        return false;
+    }
+
+    malarm_set(&s, entries, count, now);
+    memset(&r, 0, sizeof(r));
+    memcpy(r.alarm, s.alarm, sizeof(r.alarm));
+    r.count = count;
+    r.snooze_idx = MALARM_NONE;
+    for (int i = 0; i < MCFG_ALARMS_MAX; i++) {
+        r.rang_day[i] = MALARM_NEVER;
+    }
+
+    for (int k = 0; k < TEST_RINGS; k++) {
+        time_t want_at = 0;
+        time_t got_at = 0;
+        int want_idx = MALARM_NONE;
+        int got_idx = MALARM_NONE;
+        int32_t day = MALARM_NEVER;
+        bool want = ref_next(&r, now, &want_at, &want_idx, &day, st);
+        bool got = malarm_next(&s, &got_at, &got_idx);
+
+        if (want != got || (want && (want_at != got_at || want_idx != got_idx))) {
+            fprintf(stderr, "set %d, ring %d: TZ=%s\n", n, k, getenv("TZ"));
+            print_alarms(&r);
+            print_time("now     ", now);
+            if (want) {
+                fprintf(stderr, "  want alarm %d\n", want_idx);
+                print_time("want at ", want_at);
+            }
+            if (got) {
+                fprintf(stderr, "  got alarm %d\n", got_idx);
+                print_time("got at  ", got_at);
+            }
+            return false;
+        }
+        if (!want) {
+            break;
+        }
+        any = true;
+
+        /* A second early, then on time */
+        if (malarm_ring(&s, want_at - 1) != MALARM_NONE ||
+            malarm_ring(&s, want_at) != want_idx) {
+            fprintf(stderr, "set %d, ring %d: ring at the planned time\n", n, k);
+            return false;
+        }
+        st->rings++;
+        now = want_at;
+
+        if (day == MALARM_NEVER) {
+            r.snooze_idx = MALARM_NONE;
+        } else {
+            r.rang_day[want_idx] = day;
+            if (r.alarm[want_idx].flags & MCFG_ALARM_F_ONESHOT) {
+                r.alarm[want_idx].flags &= (uint8_t)~MCFG_ALARM_F_ENABLED;
+            }
+        }
+
+        /* Snooze some rings, a few seconds after they went off */
+        if (rnd_in(0, 2) == 0) {
+            uint8_t min = r.alarm[want_idx].snooze_min;
+
+            now += rnd_in(0, 30);
+            malarm_snooze(&s, now);
+            r.snooze_idx = want_idx;
+            r.snooze_at = now + 60 * (min ? min : MCFG_ALARM_SNOOZE_DEFAULT);
+            st->snoozes++;
+        }
+    }
+
+    if (!any) {
+        st->idle_sets++;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    int sets = argc > 1 ? atoi(argv[1]) : TEST_SETS_DEFAULT;
+    test_stats_t st = {0, 0, 0, 0, 0};
+
+    rng_state = argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 0) : 0x4d555354;
+    if (rng_state == 0) {
+        rng_state = 1;
+    }
+
+    for (int n = 0; n < sets; n++) {
+        setenv("TZ", zones[n % (sizeof(zones) / sizeof(zones[0]))], 1);
+        tzset();
+        if (!run_set(n, &st)) {
+            printf("FAIL after %d sets\n", n);
+            return 1;
+        }
+    }
+
+    printf("%d alarm sets OK: %u rings, %u snoozes, %u rang in a DST gap, "
+           "%u repeated-hour steps, %u sets idle\n",
+           sets, st.rings, st.snoozes, st.gap_rings, st.repeat_steps,
+           st.idle_sets);
+    return 0;
+}
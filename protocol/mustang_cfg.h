@@ -0,0 +1,487 @@
+/*
+ * Mustang clock binary config protocol.
+ *
+ * Shared by the Qt app, the Arduino sketch and the ESP-IDF GATT server.
+ * Sent on the same characteristic as the JSON config; the first byte tells
+ * them apart ('{' for JSON, MCFG_MAGIC for binary).
+ *
+ *   message := MCFG_MAGIC version tlv*
+ *   tlv     := tag len value[len]
+ *
+ * Decoding is done in place: string fields point into the received buffer,
+ * nothing is copied or allocated. Unknown tags are skipped, so newer apps
+ * can talk to older firmware. The alarm table (MCFG_TAG_ALARMS) and the
+ * alarm effect (MCFG_TAG_FX, see mustang_fx.h) have no JSON form, the app
+ * always sends them binary.
+ *
+ * Messages (JSON or binary) that do not fit one ATT write are split into
+ * fragments and reassembled into a bounded buffer on the receiver:
+ *
+ *   fragment := MCFG_FRAG_MAGIC seq [total_lo total_hi crc_lo crc_hi] data*
+ *
+ * seq counts up from 0, only fragment 0 carries the total length and the
+ * CRC-16/CCITT-FALSE of the whole message. Fragments have to arrive in
+ * order; a gap, a stall longer than MCFG_FRAG_TIMEOUT_MS or a CRC mismatch
+ * drops the message.
+ */
+#ifndef MUSTANG_CFG_H
+#define MUSTANG_CFG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Defines */
+#define MCFG_MAGIC   0xC7
+#define MCFG_VERSION 1
+
+#define MCFG_HEADER_LEN  2
+#define MCFG_SSID_MAX    32
+#define MCFG_PSK_MAX     64
+
+/* Tags */
+#define MCFG_TAG_WIFI_SSID 0x01   /* UTF-8, no terminator */
+#define MCFG_TAG_WIFI_PSK  0x02   /* UTF-8, no terminator */
+#define MCFG_TAG_TIME      0x10   /* hh, mm */
+#define MCFG_TAG_ALARM     0x20   /* hh, mm, flags; one daily alarm */
+#define MCFG_TAG_ALARMS    0x21   /* alarm entries, replaces the whole table */
+#define MCFG_TAG_FX        0x22   /* alarm effect program, empty = default */
+#define MCFG_TAG_COMMIT    0x30   /* empty, end of session: persist now */
+
+#define MCFG_TIME_LEN  2
+#define MCFG_ALARM_LEN 3
+
+#define MCFG_ALARM_F_ENABLED 0x01
+#define MCFG_ALARM_F_ONESHOT 0x02   /* disables itself after ringing */
+
+/* Alarm table entry: hh mm days flags snooze_min */
+#define MCFG_ALARM_ENTRY_LEN      5
+#define MCFG_ALARMS_MAX           16
+#define MCFG_ALARM_DAYS_ALL       0x7f   /* bit n is tm_wday n, Sunday = bit 0 */
+#define MCFG_ALARM_SNOOZE_DEFAULT 9      /* minutes, used when snooze_min is 0 */
+
+#define MCFG_FX_MAX 64                   /* effect program bytes */
+
+/* Which members of mcfg_config_t are valid */
+#define MCFG_HAS_SSID  0x01
+#define MCFG_HAS_PSK   0x02
+#define MCFG_HAS_TIME  0x04
+#define MCFG_HAS_ALARM 0x08
+#define MCFG_HAS_COMMIT 0x10
+#define MCFG_HAS_ALARMS 0x20
+#define MCFG_HAS_FX     0x40
+
+/* Fragmentation */
+#define MCFG_FRAG_MAGIC      0xC8
+#define MCFG_FRAG_HEADER_LEN 2   /* magic, seq */
+#define MCFG_FRAG_FIRST_LEN  6   /* magic, seq, total, crc */
+#define MCFG_FRAG_MAX_COUNT  256
+#define MCFG_FRAG_TIMEOUT_MS 2000
+
+/* Decode status */
+#define MCFG_OK          0
+#define MCFG_ERR_HEADER  -1
+#define MCFG_ERR_VERSION -2
+#define MCFG_ERR_TRUNC   -3
+#define MCFG_ERR_VALUE   -4
+#define MCFG_ERR_SEQ     -5
+#define MCFG_ERR_SIZE    -6
+#define MCFG_ERR_CRC     -7
+
+/* Reassembly status, message not complete yet */
+#define MCFG_FRAG_MORE 1
+
+/* Wi-Fi status, notified on its own characteristic: state attempt */
+#define MCFG_WIFI_STATUS_LEN 2
+#define MCFG_WIFI_IDLE       0   /* no credentials */
+#define MCFG_WIFI_CONNECTING 1
+#define MCFG_WIFI_CONNECTED  2   /* NTP sync requested */
+#define MCFG_WIFI_BACKOFF    3   /* attempt failed, waiting to retry */
+
+typedef struct {
+    uint8_t tag;
+    uint8_t len;
+    const uint8_t *value;
+} mcfg_tlv_t;
+
+typedef struct {
+    const uint8_t *p;
+    const uint8_t *end;
+} mcfg_reader_t;
+
+typedef struct {
+    uint8_t *buf;
+    size_t cap;
+    size_t len;
+    bool overflow;
+} mcfg_writer_t;
+
+typedef struct {
+    uint8_t present;             /* MCFG_HAS_* mask */
+    const char *ssid;            /* points into the message */
+    uint8_t ssid_len;
+    const char *psk;
+    uint8_t psk_len;
+    uint8_t time_hh;
+    uint8_t time_mm;
+    uint8_t alarm_hh;
+    uint8_t alarm_mm;
+    uint8_t alarm_flags;
+    const uint8_t *alarms;       /* alarm_count entries, points into the message */
+    uint8_t alarm_count;
+    const uint8_t *fx;           /* effect program, points into the message */
+    uint8_t fx_len;
+} mcfg_config_t;
+
+typedef struct {
+    uint8_t *buf;                /* caller owned, bounds the message size */
+    size_t cap;
+    size_t total;
+    size_t len;
+    uint16_t crc;
+    uint16_t next_seq;
+    bool active;
+    uint32_t last_ms;
+} mcfg_reasm_t;
+
+/* Reader */
+static inline bool mcfg_is_binary(const uint8_t *buf, size_t len) {
+    return len >= MCFG_HEADER_LEN && buf[0] == MCFG_MAGIC;
+}
+
+static inline int mcfg_reader_init(mcfg_reader_t *r, const uint8_t *buf,
+                                   size_t len) {
+    if (!mcfg_is_binary(buf, len)) {
+        return MCFG_ERR_HEADER;
+    }
+    if (buf[1] != MCFG_VERSION) {
+        return MCFG_ERR_VERSION;
+    }
+    r->p = buf + MCFG_HEADER_LEN;
+    r->end = buf + len;
+    return MCFG_OK;
+}
+
+/* Returns 1 with the next TLV, 0 at the end, or a negative MCFG_ERR_* */
+static inline int mcfg_next(mcfg_reader_t *r, mcfg_tlv_t *tlv) {
+    if (r->p == r->end) {
+        return 0;
+    }
+    if (r->end - r->p < 2 || r->end - r->p < 2 + r->p[1]) {
+        return MCFG_ERR_TRUNC;
+    }
+    tlv->tag = r->p[0];
+    tlv->len = r->p[1];
+    tlv->value = r->p + 2;
+    r->p += 2 + tlv->len;
+    return 1;
+}
+
+/* Apply one TLV to a config; shared by the flat and streaming decoders */
+static inline int mcfg_apply(mcfg_config_t *cfg, const mcfg_tlv_t *tlv) {
+    switch (tlv->tag) {
+    case MCFG_TAG_WIFI_SSID:
+        if (tlv->len > MCFG_SSID_MAX) {
+            return MCFG_ERR_VALUE;
+        }
+        cfg->ssid = (const char *)tlv->value;
+        cfg->ssid_len = tlv->len;
+        cfg->present |= MCFG_HAS_SSID;
+        break;
+
+    case MCFG_TAG_WIFI_PSK:
+        if (tlv->len > MCFG_PSK_MAX) {
+            return MCFG_ERR_VALUE;
+        }
+        cfg->psk = (const char *)tlv->value;
+        cfg->psk_len = tlv->len;
+        cfg->present |= MCFG_HAS_PSK;
+        break;
+
+    case MCFG_TAG_TIME:
+        if (tlv->len < MCFG_TIME_LEN || tlv->value[0] > 23 ||
+            tlv->value[1] > 59) {
+            return MCFG_ERR_VALUE;
+        }
+        cfg->time_hh = tlv->value[0];
+        cfg->time_mm = tlv->value[1];
+        cfg->present |= MCFG_HAS_TIME;
+        break;
+
+    case MCFG_TAG_ALARM:
+        if (tlv->len < MCFG_ALARM_LEN || tlv->value[0] > 23 ||
+            tlv->value[1] > 59) {
+            return MCFG_ERR_VALUE;
+        }
+        cfg->alarm_hh = tlv->value[0];
+        cfg->alarm_mm = tlv->value[1];
+        cfg->alarm_flags = tlv->value[2];
+        cfg->present |= MCFG_HAS_ALARM;
+        break;
+
+    case MCFG_TAG_ALARMS:
+        if (tlv->len % MCFG_ALARM_ENTRY_LEN != 0 ||
+            tlv->len / MCFG_ALARM_ENTRY_LEN > MCFG_ALARMS_MAX) {
+            return MCFG_ERR_VALUE;
+        }
+        for (const uint8_t *e = tlv->value; e < tlv->value + tlv->len;
+             e += MCFG_ALARM_ENTRY_LEN) {
+            if (e[0] > 23 || e[1] > 59) {
+                return MCFG_ERR_VALUE;
+            }
+        }
+        cfg->alarms = tlv->value;
+        cfg->alarm_count = tlv->len / MCFG_ALARM_ENTRY_LEN;
+        cfg->present |= MCFG_HAS_ALARMS;
+        break;
+
+    case MCFG_TAG_FX:
+        /* Size only, the receiver runs mfx_check() before keeping it */
+        if (tlv->len > MCFG_FX_MAX) {
+            return MCFG_ERR_VALUE;
+        }
+        cfg->fx = tlv->value;
+        cfg->fx_len = tlv->len;
+        cfg->present |= MCFG_HAS_FX;
+        break;
+
+    case MCFG_TAG_COMMIT:
+        cfg->present |= MCFG_HAS_COMMIT;
+        break;
+
+    default:
+        /* Unknown tag, skip */
+        break;
+    }
+    return MCFG_OK;
+}
+
+static inline int mcfg_decode(const uint8_t *buf, size_t len,
+                              mcfg_config_t *cfg) {
+    mcfg_reader_t r;
+    mcfg_tlv_t tlv;
+    int rc;
+
+    memset(cfg, 0, sizeof(*cfg));
+
+    rc = mcfg_reader_init(&r, buf, len);
+    if (rc != MCFG_OK) {
+        return rc;
+    }
+    while ((rc = mcfg_next(&r, &tlv)) > 0) {
+        rc = mcfg_apply(cfg, &tlv);
+        if (rc != MCFG_OK) {
+            return rc;
+        }
+    }
+    return rc;
+}
+
+/* Writer */
+static inline void mcfg_writer_init(mcfg_writer_t *w, uint8_t *buf,
+                                    size_t cap) {
+    w->buf = buf;
+    w->cap = cap;
+    w->len = 0;
+    w->overflow = cap < MCFG_HEADER_LEN;
+    if (!w->overflow) {
+        buf[w->len++] = MCFG_MAGIC;
+        buf[w->len++] = MCFG_VERSION;
+    }
+}
+
+static inline void mcfg_put(mcfg_writer_t *w, uint8_t tag, const void *value,
+                            uint8_t len) {
+    if (w->overflow || w->cap - w->len < (size_t)len + 2) {
+        w->overflow = true;
+        return;
+    }
+    w->buf[w->len++] = tag;
+    w->buf[w->len++] = len;
+    if (len > 0) {
+        memcpy(w->buf + w->len, value, len);
+    }
+    w->len += len;
+}
+
+static inline void mcfg_put_time(mcfg_writer_t *w, uint8_t hh, uint8_t mm) {
+    uint8_t v[MCFG_TIME_LEN] = {hh, mm};
+    mcfg_put(w, MCFG_TAG_TIME, v, sizeof(v));
+}
+
+static inline void mcfg_put_alarm(mcfg_writer_t *w, uint8_t hh, uint8_t mm,
+                                  uint8_t flags) {
+    uint8_t v[MCFG_ALARM_LEN] = {hh, mm, flags};
+    mcfg_put(w, MCFG_TAG_ALARM, v, sizeof(v));
+}
+
+static inline void mcfg_alarm_entry(uint8_t *e, uint8_t hh, uint8_t mm,
+                                    uint8_t days, uint8_t flags,
+                                    uint8_t snooze_min) {
+    e[0] = hh;
+    e[1] = mm;
+    e[2] = days;
+    e[3] = flags;
+    e[4] = snooze_min;
+}
+
+/* count entries of MCFG_ALARM_ENTRY_LEN bytes, 0 clears the table */
+static inline void mcfg_put_alarms(mcfg_writer_t *w, const uint8_t *entries,
+                                   uint8_t count) {
+    if (count > MCFG_ALARMS_MAX) {
+        w->overflow = true;
+        return;
+    }
+    mcfg_put(w, MCFG_TAG_ALARMS, entries,
+             (uint8_t)(count * MCFG_ALARM_ENTRY_LEN));
+}
+
+/* Alarm effect program, len 0 goes back to the firmware default */
+static inline void mcfg_put_fx(mcfg_writer_t *w, const uint8_t *prog,
+                               uint8_t len) {
+    if (len > MCFG_FX_MAX) {
+        w->overflow = true;
+        return;
+    }
+    mcfg_put(w, MCFG_TAG_FX, prog, len);
+}
+
+static inline void mcfg_put_commit(mcfg_writer_t *w) {
+    mcfg_put(w, MCFG_TAG_COMMIT, NULL, 0);
+}
+
+/* CRC-16/CCITT-FALSE, start with 0xFFFF */
+static inline uint16_t mcfg_crc16(uint16_t crc, const uint8_t *data,
+                                  size_t len) {
+    while (len--) {
+        crc ^= (uint16_t)(*data++) << 8;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021)
+                                 : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+/* Fragment writer, returns the header length written to out */
+static inline size_t mcfg_frag_header(uint8_t *out, uint8_t seq,
+                                      uint16_t total, uint16_t crc) {
+    out[0] = MCFG_FRAG_MAGIC;
+    out[1] = seq;
+    if (seq != 0) {
+        return MCFG_FRAG_HEADER_LEN;
+    }
+    out[2] = (uint8_t)(total & 0xff);
+    out[3] = (uint8_t)(total >> 8);
+    out[4] = (uint8_t)(crc & 0xff);
+    out[5] = (uint8_t)(crc >> 8);
+    return MCFG_FRAG_FIRST_LEN;
+}
+
+/* Reassembly */
+static inline bool mcfg_is_fragment(const uint8_t *buf, size_t len) {
+    return len >= MCFG_FRAG_HEADER_LEN && buf[0] == MCFG_FRAG_MAGIC;
+}
+
+static inline void mcfg_reasm_init(mcfg_reasm_t *r, uint8_t *buf,
+                                   size_t cap) {
+    memset(r, 0, sizeof(*r));
+    r->buf = buf;
+    r->cap = cap;
+}
+
+/*
+ * Start a fragment from its first bytes (at least MCFG_FRAG_FIRST_LEN, or
+ * the whole fragment if shorter). Returns the header length to skip before
+ * mcfg_reasm_append, or a negative MCFG_ERR_* with the message dropped.
+ */
+static inline int mcfg_reasm_start(mcfg_reasm_t *r, const uint8_t *frag,
+                                   size_t len, uint32_t now_ms) {
+    if (!mcfg_is_fragment(frag, len)) {
+        r->active = false;
+        return MCFG_ERR_HEADER;
+    }
+
+    if (r->active && now_ms - r->last_ms > MCFG_FRAG_TIMEOUT_MS) {
+        r->active = false;
+    }
+    r->last_ms = now_ms;
+
+    if (frag[1] == 0) {
+        if (len < MCFG_FRAG_FIRST_LEN) {
+            r->active = false;
+            return MCFG_ERR_TRUNC;
+        }
+        r->total = frag[2] | ((size_t)frag[3] << 8);
+        r->crc = (uint16_t)(frag[4] | (frag[5] << 8));
+        r->len = 0;
+        r->next_seq = 1;
+        r->active = r->total <= r->cap;
+        return r->active ? MCFG_FRAG_FIRST_LEN : MCFG_ERR_SIZE;
+    }
+
+    if (!r->active || frag[1] != r->next_seq) {
+        r->active = false;
+        return MCFG_ERR_SEQ;
+    }
+    r->next_seq++;
+    return MCFG_FRAG_HEADER_LEN;
+}
+
+/* Append fragment data, may be called once per buffer segment */
+static inline int mcfg_reasm_append(mcfg_reasm_t *r, const uint8_t *data,
+                                    size_t len) {
+    if (!r->active) {
+        return MCFG_ERR_SEQ;
+    }
+    if (len > r->total - r->len) {
+        r->active = false;
+        return MCFG_ERR_SIZE;
+    }
+    memcpy(r->buf + r->len, data, len);
+    r->len += len;
+    return MCFG_OK;
+}
+
+/*
+ * Close the current fragment. Returns MCFG_FRAG_MORE while fragments are
+ * missing, MCFG_OK when r->buf holds r->len bytes of a verified message.
+ */
+static inline int mcfg_reasm_end(mcfg_reasm_t *r) {
+    if (!r->active) {
+        return MCFG_ERR_SEQ;
+    }
+    if (r->len < r->total) {
+        return MCFG_FRAG_MORE;
+    }
+    r->active = false;
+    if (mcfg_crc16(0xFFFF, r->buf, r->len) != r->crc) {
+        return MCFG_ERR_CRC;
+    }
+    return MCFG_OK;
+}
+
+/* One contiguous fragment */
+static inline int mcfg_reasm_push(mcfg_reasm_t *r, const uint8_t *frag,
+                                  size_t len, uint32_t now_ms) {
+    int rc = mcfg_reasm_start(r, frag, len, now_ms);
+    if (rc < 0) {
+        return rc;
+    }
+    rc = mcfg_reasm_append(r, frag + rc, len - (size_t)rc);
+    if (rc < 0) {
+        return rc;
+    }
+    return mcfg_reasm_end(r);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MUSTANG_CFG_H */
@@ -0,0 +1,394 @@
+/*
+ * Mustang clock display and alarm effects.
+ *
+ * Shared by the Arduino sketch and the ESP-IDF firmwares. An effect is a
+ * short bytecode program (at most MCFG_FX_MAX bytes, uploaded as
+ * MCFG_TAG_FX) played one tick at a time; the owner calls mfx_tick() from
+ * a periodic MFX_TICK_MS timer and renders whatever it reports changed.
+ * Nothing in here blocks or sleeps, and timing is counted in ticks only,
+ * so an effect runs the same however busy the rest of the firmware is.
+ *
+ *   program := instr* MFX_OP_END
+ *
+ *   MFX_OP_END                          stop, back to the clock
+ *   MFX_OP_SEGS    d0 d1 d2 d3          show raw segments
+ *   MFX_OP_CLOCK                        show the owner's digits (the time)
+ *   MFX_OP_BLANK                        all segments off
+ *   MFX_OP_LEVEL   level                brightness 0..7, bit 3 = display on
+ *   MFX_OP_FADE    level ticks          one brightness step every ticks
+ *                                       until level is reached
+ *   MFX_OP_TEXT    ticks len c[len]     scroll ASCII in from the right, one
+ *                                       position every ticks
+ *   MFX_OP_OUT     mask                 MFX_OUT_* lines (LED, buzzer)
+ *   MFX_OP_WAIT    ticks                hold the current frame
+ *   MFX_OP_REPEAT  count                loop to the matching MFX_OP_NEXT,
+ *   MFX_OP_NEXT                         count 0 = until stopped
+ *
+ * Programs are checked once by mfx_check(): operands in bounds, loops
+ * balanced and at most MFX_LOOP_DEPTH deep, every loop body waits or
+ * scrolls (a fade may already be at its level and take no time at all).
+ * At the end the brightness the effect started with comes back and the
+ * outputs go low.
+ */
+#ifndef MUSTANG_FX_H
+#define MUSTANG_FX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "mustang_cfg.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Defines */
+#define MFX_TICK_MS    50
+#define MFX_DIGITS     4
+#define MFX_LOOP_DEPTH 2
+/* Ops one tick may run; a checked program never gets near it, no loop
+ * goes round twice without a wait in between */
+#define MFX_OPS_PER_TICK (2 * MCFG_FX_MAX)
+
+/* Opcodes */
+#define MFX_OP_END    0x00
+#define MFX_OP_SEGS   0x01
+#define MFX_OP_CLOCK  0x02
+#define MFX_OP_BLANK  0x03
+#define MFX_OP_LEVEL  0x04
+#define MFX_OP_FADE   0x05
+#define MFX_OP_TEXT   0x06
+#define MFX_OP_OUT    0x07
+#define MFX_OP_WAIT   0x08
+#define MFX_OP_REPEAT 0x09
+#define MFX_OP_NEXT   0x0a
+
+/* Output lines of MFX_OP_OUT */
+#define MFX_OUT_LED    0x01
+#define MFX_OUT_BUZZER 0x02
+
+/* What mfx_tick() / mfx_start() changed */
+#define MFX_CHG_DIGITS 0x01       /* digits, or clock flag */
+#define MFX_CHG_LEVEL  0x02
+#define MFX_CHG_OUT    0x04
+#define MFX_CHG_DONE   0x08       /* program ended, clock is back */
+
+/* Status */
+#define MFX_OK        0
+#define MFX_ERR_OP    -1          /* unknown opcode */
+#define MFX_ERR_TRUNC -2          /* operands past the end, or no MFX_OP_END */
+#define MFX_ERR_VALUE -3          /* operand out of range */
+#define MFX_ERR_LOOP  -4          /* unbalanced, too deep or a loop that spins */
+
+typedef struct {
+    uint8_t prog[MCFG_FX_MAX];    /* own copy, the source may change */
+    uint8_t len;
+    uint8_t pc;
+    uint16_t wait;                /* ticks left on the current frame */
+    uint8_t loop_pc[MFX_LOOP_DEPTH];
+    uint8_t loop_left[MFX_LOOP_DEPTH];   /* 0 = forever */
+    uint8_t depth;
+    uint8_t text_pos;             /* scroll position of MFX_OP_TEXT, 0 idle */
+    uint8_t base_level;           /* restored at the end */
+
+    /* Output, valid after a change was reported */
+    bool running;
+    bool clock;                   /* render the owner's digits, not digits[] */
+    uint8_t digits[MFX_DIGITS];
+    uint8_t level;
+    uint8_t out;
+} mfx_player_t;
+
+/* Three quick blinks of the time, eight times, with the LED and buzzer */
+static const uint8_t MFX_ALARM_DEFAULT[] = {
+    MFX_OP_REPEAT, 8,
+    MFX_OP_REPEAT, 3,
+    MFX_OP_BLANK, MFX_OP_OUT, MFX_OUT_LED | MFX_OUT_BUZZER, MFX_OP_WAIT, 3,
+    MFX_OP_CLOCK, MFX_OP_OUT, 0, MFX_OP_WAIT, 3,
+    MFX_OP_NEXT,
+    MFX_OP_NEXT,
+    MFX_OP_END,
+};
+
+/* Helpers */
+/* Seven-segment glyph of an ASCII character, blank if it has none */
+static inline uint8_t mfx_glyph(char c) {
+    static const uint8_t digits[10] = {
+        0x3f, 0x06, 0x5b, 0x4f, 0x66, 0x6d, 0x7d, 0x07, 0x7f, 0x6f,
+    };
+    static const uint8_t letters[26] = {
+        0x77, 0x7c, 0x39, 0x5e, 0x79, 0x71, 0x3d, 0x76, 0x06, 0x1e, /* A-J */
+        0x75, 0x38, 0x15, 0x54, 0x5c, 0x73, 0x67, 0x50, 0x6d, 0x78, /* K-T */
+        0x3e, 0x1c, 0x2a, 0x76, 0x6e, 0x5b,                         /* U-Z */
+    };
+
+    if (c >= '0' && c <= '9') {
+        return digits[c - '0'];
+    }
+    if (c >= 'a' && c <= 'z') {
+        c = (char)(c - 'a' + 'A');
+    }
+    if (c >= 'A' && c <= 'Z') {
+        return letters[c - 'A'];
+    }
+    switch (c) {
+    case '-':
+        return 0x40;
+    case '_':
+        return 0x08;
+    case '.':
+        return 0x80;
+    default:
+        return 0x00;
+    }
+}
+
+/* Operand bytes following an opcode, -1 if unknown; text needs its length */
+static inline int mfx_operands(const uint8_t *prog, uint8_t len, uint8_t pc) {
+    switch (prog[pc]) {
+    case MFX_OP_END:
+    case MFX_OP_CLOCK:
+    case MFX_OP_BLANK:
+    case MFX_OP_NEXT:
+        return 0;
+    case MFX_OP_LEVEL:
+    case MFX_OP_OUT:
+    case MFX_OP_WAIT:
+    case MFX_OP_REPEAT:
+        return 1;
+    case MFX_OP_FADE:
+        return 2;
+    case MFX_OP_SEGS:
+        return MFX_DIGITS;
+    case MFX_OP_TEXT:
+        return pc + 2 < len ? 2 + prog[pc + 2] : 2;
+    default:
+        return -1;
+    }
+}
+
+/* Public functions */
+/* Static check of a program, MFX_OK or MFX_ERR_* */
+static inline int mfx_check(const uint8_t *prog, size_t len) {
+    bool timed[MFX_LOOP_DEPTH + 1] = {false};
+    uint8_t depth = 0;
+
+    if (len == 0 || len > MCFG_FX_MAX) {
+        return MFX_ERR_TRUNC;
+    }
+    for (size_t pc = 0; pc < len;) {
+        uint8_t op = prog[pc];
+        int n = mfx_operands(prog, (uint8_t)len, (uint8_t)pc);
+        const uint8_t *arg = prog + pc + 1;
+
+        if (n < 0) {
+            return MFX_ERR_OP;
+        }
+        if (pc + 1 + (size_t)n > len) {
+            return MFX_ERR_TRUNC;
+        }
+        switch (op) {
+        case MFX_OP_END:
+            return depth == 0 ? MFX_OK : MFX_ERR_LOOP;
+        case MFX_OP_LEVEL:
+            if (arg[0] > 0x0f) {
+                return MFX_ERR_VALUE;
+            }
+            break;
+        case MFX_OP_FADE:
+            if (arg[0] > 0x07 || arg[1] == 0) {
+                return MFX_ERR_VALUE;
+            }
+            break;
+        case MFX_OP_TEXT:
+            if (arg[0] == 0 || arg[1] == 0) {
+                return MFX_ERR_VALUE;
+            }
+            timed[depth] = true;
+            break;
+        case MFX_OP_WAIT:
+            if (arg[0] != 0) {
+                timed[depth] = true;
+            }
+            break;
+        case MFX_OP_REPEAT:
+            if (depth == MFX_LOOP_DEPTH) {
+                return MFX_ERR_LOOP;
+            }
+            timed[++depth] = false;
+            break;
+        case MFX_OP_NEXT:
+            if (depth == 0 || !timed[depth]) {
+                return MFX_ERR_LOOP;
+            }
+            depth--;
+            timed[depth] = true;
+            break;
+        default:
+            break;
+        }
+        pc += 1 + (size_t)n;
+    }
+    return MFX_ERR_TRUNC;
+}
+
+/* Draw scroll position text_pos (1..len + 3) of the text at pc */
+static inline void mfx_text_frame(mfx_player_t *p) {
+    const uint8_t *text = p->prog + p->pc + 3;
+    int first = p->text_pos - MFX_DIGITS;
+
+    for (int i = 0; i < MFX_DIGITS; i++) {
+        int c = first + i;
+        p->digits[i] = c >= 0 && c < p->prog[p->pc + 2] ? mfx_glyph((char)text[c])
+                                                        : 0x00;
+    }
+    p->clock = false;
+}
+
+/* Back to the clock at the start brightness, outputs low */
+static inline int mfx_end(mfx_player_t *p) {
+    p->running = false;
+    p->clock = true;
+    p->level = p->base_level;
+    p->out = 0;
+    p->wait = 0;
+    p->depth = 0;
+    p->text_pos = 0;
+    return MFX_CHG_DIGITS | MFX_CHG_LEVEL | MFX_CHG_OUT | MFX_CHG_DONE;
+}
+
+/*
+ * Execute from pc until something holds the frame for a while or the
+ * program ends; returns the MFX_CHG_* mask
+ */
+static inline int mfx_run(mfx_player_t *p) {
+    int changed = 0;
+
+    for (int budget = MFX_OPS_PER_TICK; budget > 0; budget--) {
+        const uint8_t *arg = p->prog + p->pc + 1;
+        uint8_t op = p->prog[p->pc];
+
+        switch (op) {
+        case MFX_OP_SEGS:
+            memcpy(p->digits, arg, MFX_DIGITS);
+            p->clock = false;
+            changed |= MFX_CHG_DIGITS;
+            break;
+        case MFX_OP_CLOCK:
+            p->clock = true;
+            changed |= MFX_CHG_DIGITS;
+            break;
+        case MFX_OP_BLANK:
+            memset(p->digits, 0, sizeof(p->digits));
+            p->clock = false;
+            changed |= MFX_CHG_DIGITS;
+            break;
+        case MFX_OP_LEVEL:
+            p->level = arg[0];
+            changed |= MFX_CHG_LEVEL;
+            break;
+        case MFX_OP_FADE:
+            /* Stays on this op, one level per hold, until it gets there */
+            if ((p->level & 0x07) != arg[0] || !(p->level & 0x08)) {
+                uint8_t lvl = p->level & 0x07;
+                if (p->level & 0x08) {
+                    lvl = lvl < arg[0] ? lvl + 1 : lvl - 1;
+                }
+                p->level = (uint8_t)(lvl | 0x08);
+                p->wait = arg[1];
+                return changed | MFX_CHG_LEVEL;
+            }
+            break;
+        case MFX_OP_TEXT:
+            if (p->text_pos < p->prog[p->pc + 2] + MFX_DIGITS - 1) {
+                p->text_pos++;
+                mfx_text_frame(p);
+                p->wait = arg[0];
+                return changed | MFX_CHG_DIGITS;
+            }
+            p->text_pos = 0;
+            break;
+        case MFX_OP_OUT:
+            if (p->out != arg[0]) {
+                p->out = arg[0];
+                changed |= MFX_CHG_OUT;
+            }
+            break;
+        case MFX_OP_WAIT:
+            if (arg[0] != 0) {
+                p->pc += 2;
+                p->wait = arg[0];
+                return changed;
+            }
+            break;
+        case MFX_OP_REPEAT:
+            p->loop_pc[p->depth] = (uint8_t)(p->pc + 2);
+            p->loop_left[p->depth] = arg[0];
+            p->depth++;
+            break;
+        case MFX_OP_NEXT: {
+            uint8_t *left = &p->loop_left[p->depth - 1];
+            if (*left == 0 || --*left != 0) {
+                p->pc = p->loop_pc[p->depth - 1];
+                continue;
+            }
+            p->depth--;
+            break;
+        }
+        default:
+            /* MFX_OP_END */
+            return changed | mfx_end(p);
+        }
+        p->pc += 1 + mfx_operands(p->prog, p->len, p->pc);
+    }
+
+    /* Not reached by a checked program */
+    return changed | mfx_end(p);
+}
+
+static inline void mfx_init(mfx_player_t *p, uint8_t level) {
+    memset(p, 0, sizeof(*p));
+    p->clock = true;
+    p->level = level;
+    p->base_level = level;
+}
+
+/*
+ * Load and start a program; level is the brightness in use right now. The
+ * first frame is due at once, render the returned MFX_CHG_* mask and call
+ * mfx_tick() every MFX_TICK_MS. A negative MFX_ERR_* leaves the player
+ * stopped.
+ */
+static inline int mfx_start(mfx_player_t *p, const uint8_t *prog, size_t len,
+                            uint8_t level) {
+    int rc = mfx_check(prog, len);
+
+    mfx_init(p, level);
+    if (rc != MFX_OK) {
+        return rc;
+    }
+    memcpy(p->prog, prog, len);
+    p->len = (uint8_t)len;
+    p->running = true;
+    return mfx_run(p);
+}
+
+/* One MFX_TICK_MS tick, returns the MFX_CHG_* mask to render */
+static inline int mfx_tick(mfx_player_t *p) {
+    if (!p->running || (p->wait != 0 && --p->wait != 0)) {
+        return 0;
+    }
+    return mfx_run(p);
+}
+
+/* Cut the program short: clock, start brightness, outputs off */
+static inline int mfx_stop(mfx_player_t *p) {
+    return p->running ? mfx_end(p) : 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MUSTANG_FX_H
@@ -0,0 +1,341 @@
+/*
+ * Host check of the effects player on the simulated TM1637.
+ *
+ *   cc -std=c99 -Wall -Ifirmware/esp-idf/tm1637_display/main \
+ *       -o mustang_fx_test protocol/mustang_fx_test.c \
+ *       firmware/esp-idf/tm1637_display/main/tm1637.c \
+ *       firmware/esp-idf/tm1637_display/main/tm1637_sim.c
+ *   ./mustang_fx_test [programs] [seed]
+ *
+ * Effects from mustang_fx.h are rendered tick by tick through tm1637.c into
+ * the bus decoder of tm1637_sim.c, and what the chip latched is compared
+ * with what the program says: the default alarm against the fixed 150 ms
+ * blink it replaces, fades, scrolling text and the outputs. Every frame has
+ * to be on the bus within one tick. Random programs then check that
+ * whatever mfx_check() lets through plays without leaving the program or
+ * spinning. Exits non-zero on the first mismatch.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "mustang_fx.h"
+#include "tm1637_sim.h"
+
+/* Defines */
+#define TEST_PROGRAMS_DEFAULT 20000
+#define TEST_FUZZ_TICKS       4000
+#define TEST_BASE_LEVEL       0x0b   /* brightness 3, on */
+#define TEST_BLINK_TICKS      (150 / MFX_TICK_MS)   /* blink step it replaces */
+
+static const uint8_t clock_digits[MFX_DIGITS] = {0x06, 0xbf, 0x3f, 0x06};
+
+static uint32_t rng_state;
+static unsigned frames;
+static uint64_t worst_frame_us;
+static int failures;
+
+/* Private functions */
+static uint32_t rnd(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static void expect(bool ok, const char *what, int tick) {
+    if (!ok && failures++ < 10) {
+        fprintf(stderr, "FAIL %s (tick %d)\n", what, tick);
+    }
+}
+
+/* Same as the firmwares: clock digits unless the effect draws its own */
+static void render(const mfx_player_t *p, int changed) {
+    size_t before = TM1637_simFrameCount();
+    uint64_t t0 = TM1637_simTimeUs();
+
+    if (changed & MFX_CHG_LEVEL) {
+        TM1637_setBrightness(p->level & 0x07, p->level & 0x08);
+    }
+    if (changed & (MFX_CHG_DIGITS | MFX_CHG_LEVEL)) {
+        TM1637_setSegments(p->clock ? clock_digits : p->digits, MFX_DIGITS, 0);
+    }
+    if (TM1637_simFrameCount() != before) {
+        uint64_t us = TM1637_simTimeUs() - t0;
+        frames++;
+        if (us > worst_frame_us) {
+            worst_frame_us = us;
+        }
+    }
+}
+
+static void sim_start(void) {
+    TM1637_simReset();
+    TM1637_setPort(TM1637_simPort());
+    TM1637_Init(0, 1, DEFAULT_BIT_DELAY);
+    TM1637_invalidate();
+    TM1637_setBrightness(TEST_BASE_LEVEL & 0x07, true);
+    TM1637_setSegments(clock_digits, MFX_DIGITS, 0);
+}
+
+static bool shows(const uint8_t *digits) {
+    return memcmp(TM1637_simDisplay()->segments, digits, MFX_DIGITS) == 0;
+}
+
+static bool shows_level(uint8_t level) {
+    const tm1637_sim_display_t *d = TM1637_simDisplay();
+    return d->on == ((level & 0x08) != 0) && (!d->on || d->brightness == (level & 0x07));
+}
+
+/* Start, then tick until done or max_ticks; returns the ticks it ran */
+static int play(mfx_player_t *p, const uint8_t *prog, size_t len,
+                void (*each)(const mfx_player_t *, int), int max_ticks) {
+    int changed = mfx_start(p, prog, len, TEST_BASE_LEVEL);
+    int tick = 0;
+
+    expect(changed >= 0, "program accepted", 0);
+    render(p, changed);
+    if (each) {
+        each(p, 0);
+    }
+    while (p->running && tick < max_ticks) {
+        tick++;
+        render(p, mfx_tick(p));
+        if (each) {
+            each(p, tick);
+        }
+    }
+    return tick;
+}
+
+/* Old firmware: pattern 0xAA, 48 steps of 150 ms, LSB first */
+static void check_default_tick(const mfx_player_t *p, int tick) {
+    static const uint8_t blank[MFX_DIGITS] = {0};
+    int step = tick / TEST_BLINK_TICKS;
+    bool visible = step >= 48 || ((0xAA >> (step & 7)) & 1);
+
+    expect(shows(visible ? clock_digits : blank), "default blink frame", tick);
+    expect(p->out == (step < 48 && !visible ? (MFX_OUT_LED | MFX_OUT_BUZZER) : 0),
+           "default blink outputs", tick);
+}
+
+static void test_default(void) {
+    mfx_player_t p;
+    int ticks;
+
+    sim_start();
+    ticks = play(&p, MFX_ALARM_DEFAULT, sizeof(MFX_ALARM_DEFAULT),
+                 check_default_tick, 1000);
+    expect(ticks == 48 * TEST_BLINK_TICKS, "default alarm length", ticks);
+    expect(shows(clock_digits) && shows_level(TEST_BASE_LEVEL),
+           "clock back after the alarm", ticks);
+}
+
+static void check_fade_tick(const mfx_player_t *p, int tick) {
+    /* Off, then 0..7 two ticks each, back down to 2 */
+    int level;
+
+    (void)p;
+    if (tick == 0) {
+        expect(shows_level(0x00), "fade starts dark", tick);
+        return;
+    }
+    level = (tick - 1) / 2;
+    if (level > 7) {
+        level = 14 - level;
+    }
+    if (tick <= 2 * 13) {
+        expect(shows_level((uint8_t)(0x08 | level)), "fade level", tick);
+    }
+}
+
+static void test_fade(void) {
+    static const uint8_t prog[] = {
+        MFX_OP_LEVEL, 0x00, MFX_OP_WAIT, 1,
+        MFX_OP_FADE, 7, 2,
+        MFX_OP_FADE, 2, 2,
+        MFX_OP_END,
+    };
+    mfx_player_t p;
+    int ticks;
+
+    sim_start();
+    ticks = play(&p, prog, sizeof(prog), check_fade_tick, 1000);
+    /* 1 dark, 0..7 and 6..2 at two ticks each */
+    expect(ticks == 1 + 2 * 8 + 2 * 5, "fade length", ticks);
+    expect(shows_level(TEST_BASE_LEVEL), "fade restores brightness", ticks);
+}
+
+static void check_text_tick(const mfx_player_t *p, int tick) {
+    static const char *const want[] = {"   H", "  HI", " HI ", "HI  ", "I   "};
+    int pos = tick / 2;
+    uint8_t digits[MFX_DIGITS];
+
+    (void)p;
+    if (pos >= 5) {
+        return;
+    }
+    for (int i = 0; i < MFX_DIGITS; i++) {
+        digits[i] = mfx_glyph(want[pos][i]);
+    }
+    expect(shows(digits), "scroll frame", tick);
+}
+
+static void test_text(void) {
+    static const uint8_t prog[] = {
+        MFX_OP_TEXT, 2, 2, 'h', 'i',
+        MFX_OP_END,
+    };
+    mfx_player_t p;
+    int ticks;
+
+    sim_start();
+    ticks = play(&p, prog, sizeof(prog), check_text_tick, 1000);
+    expect(ticks == 2 * 5, "scroll length", ticks);
+    expect(shows(clock_digits), "clock back after the text", ticks);
+}
+
+static void test_stop(void) {
+    static const uint8_t prog[] = {
+        MFX_OP_LEVEL, 0x0f, MFX_OP_OUT, MFX_OUT_BUZZER,
+        MFX_OP_REPEAT, 0, MFX_OP_BLANK, MFX_OP_WAIT, 1, MFX_OP_CLOCK,
+        MFX_OP_WAIT, 1, MFX_OP_NEXT,
+        MFX_OP_END,
+    };
+    mfx_player_t p;
+    int ticks;
+
+    sim_start();
+    ticks = play(&p, prog, sizeof(prog), NULL, 500);
+    expect(ticks == 500 && p.running, "endless loop keeps running", ticks);
+    render(&p, mfx_stop(&p));
+    expect(!p.running && p.out == 0, "stop clears the outputs", ticks);
+    expect(shows(clock_digits) && shows_level(TEST_BASE_LEVEL),
+           "stop restores the clock", ticks);
+}
+
+static void test_check(void) {
+    static const struct {
+        uint8_t prog[8];
+        uint8_t len;
+        int rc;
+    } cases[] = {
+        {{MFX_OP_END}, 1, MFX_OK},
+        {{MFX_OP_CLOCK}, 1, MFX_ERR_TRUNC},
+        {{0x42, MFX_OP_END}, 2, MFX_ERR_OP},
+        {{MFX_OP_SEGS, 1, 2, 3}, 4, MFX_ERR_TRUNC},
+        {{MFX_OP_LEVEL, 0x10, MFX_OP_END}, 3, MFX_ERR_VALUE},
+        {{MFX_OP_FADE, 3, 0, MFX_OP_END}, 4, MFX_ERR_VALUE},
+        {{MFX_OP_TEXT, 1, 5, 'a', MFX_OP_END}, 5, MFX_ERR_TRUNC},
+        {{MFX_OP_NEXT, MFX_OP_END}, 2, MFX_ERR_LOOP},
+        {{MFX_OP_REPEAT, 2, MFX_OP_WAIT, 1, MFX_OP_END}, 5, MFX_ERR_LOOP},
+        {{MFX_OP_REPEAT, 0, MFX_OP_CLOCK, MFX_OP_NEXT, MFX_OP_END}, 5,
+         MFX_ERR_LOOP},
+        {{MFX_OP_REPEAT, 0, MFX_OP_FADE, 3, 1, MFX_OP_NEXT, MFX_OP_END}, 7,
+         MFX_ERR_LOOP},
+        {{MFX_OP_REPEAT, 1, MFX_OP_REPEAT, 1, MFX_OP_REPEAT, 1}, 6,
+         MFX_ERR_LOOP},
+        {{MFX_OP_REPEAT, 0, MFX_OP_WAIT, 1, MFX_OP_NEXT, MFX_OP_END}, 6,
+         MFX_OK},
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        int rc = mfx_check(cases[i].prog, cases[i].len);
+        if (rc != cases[i].rc) {
+            fprintf(stderr, "check case %u: rc %d, want %d\n", (unsigned)i, rc,
+                    cases[i].rc);
+            failures++;
+        }
+    }
+    expect(mfx_check(MFX_ALARM_DEFAULT, sizeof(MFX_ALARM_DEFAULT)) == MFX_OK,
+           "default alarm checks", 0);
+}
+
+/* Mostly valid instructions, so a fair share gets past mfx_check() */
+static size_t random_program(uint8_t *prog) {
+    size_t len = 0;
+    size_t n = 1 + rnd() % 20;
+
+    for (size_t i = 0; i < n && len + 8 < MCFG_FX_MAX; i++) {
+        uint8_t op = (uint8_t)(rnd() % 11);
+        int ops;
+
+        prog[len] = op;
+        for (int k = 1; k < 8; k++) {
+            prog[len + k] = (uint8_t)(rnd() % ((rnd() & 1) ? 4 : 16));
+        }
+        if (op == MFX_OP_END) {
+            continue;
+        }
+        if (op == MFX_OP_TEXT) {
+            prog[len + 2] = (uint8_t)(1 + rnd() % 4);
+        }
+        ops = mfx_operands(prog, MCFG_FX_MAX, (uint8_t)len);
+        len += 1 + (size_t)ops;
+    }
+    if (rnd() % 8 != 0) {
+        prog[len++] = MFX_OP_END;
+    }
+    if (len > 0 && rnd() % 16 == 0) {
+        prog[rnd() % len] = (uint8_t)rnd();
+    }
+    return len;
+}
+
+static void test_fuzz(int programs) {
+    unsigned accepted = 0;
+    unsigned ended = 0;
+
+    TM1637_simReset();
+    for (int n = 0; n < programs && failures == 0; n++) {
+        uint8_t prog[MCFG_FX_MAX];
+        size_t len = random_program(prog);
+        mfx_player_t p;
+        int changed = mfx_start(&p, prog, len, TEST_BASE_LEVEL);
+
+        if (changed < 0) {
+            expect(!p.running, "rejected program does not run", 0);
+            continue;
+        }
+        accepted++;
+        for (int tick = 0; p.running && tick < TEST_FUZZ_TICKS; tick++) {
+            expect(p.pc < p.len, "pc inside the program", tick);
+            expect(p.depth <= MFX_LOOP_DEPTH, "loop depth", tick);
+            changed = mfx_tick(&p);
+        }
+        if (!p.running) {
+            ended++;
+            /* Ended on its END, not on the ops-per-tick backstop */
+            expect(p.prog[p.pc] == MFX_OP_END, "program ended on END", 0);
+            expect(p.clock && p.out == 0 && p.level == TEST_BASE_LEVEL,
+                   "end restores the clock", 0);
+        }
+    }
+    printf("%d random programs: %u accepted, %u ended\n", programs, accepted,
+           ended);
+}
+
+int main(int argc, char **argv) {
+    int programs = argc > 1 ? atoi(argv[1]) : TEST_PROGRAMS_DEFAULT;
+
+    rng_state = argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 0) : 0x4d465831;
+    if (rng_state == 0) {
+        rng_state = 1;
+    }
+
+    test_check();
+    test_default();
+    test_fade();
+    test_text();
+    test_stop();
+    expect(worst_frame_us < MFX_TICK_MS * 1000, "frame fits in a tick", 0);
+    printf("%u frames, slowest %llu us on the bus (tick %d ms)\n", frames,
+           (unsigned long long)worst_frame_us, MFX_TICK_MS);
+    test_fuzz(programs);
+
+    if (failures) {
+        printf("FAIL: %d mismatches\n", failures);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
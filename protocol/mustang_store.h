@@ -0,0 +1,277 @@
+/*
+ * Mustang clock persistent config store.
+ *
+ * Shared by the Arduino sketch and the ESP-IDF GATT server. The whole
+ * persisted config lives in RAM as one fixed-size blob:
+ *
+ *   blob := version present ssid[33] psk[65] alarm_count
+ *           alarms[MCFG_ALARMS_MAX * MCFG_ALARM_ENTRY_LEN] fx_len
+ *           fx[MCFG_FX_MAX] crc_lo crc_hi
+ *
+ * and goes to flash as a single record. Setters only mark the store dirty
+ * when a value actually changes; the owner flushes once the config has been
+ * quiet for MSTORE_DEBOUNCE_MS, or right away on an MCFG_TAG_COMMIT. A
+ * whole provisioning session thus costs one flash write instead of one per
+ * key and message, and boot is a single read.
+ *
+ * Older blobs are still read and marked dirty so the next flush rewrites
+ * them: version 1 (a single alarm) comes back as a one-entry, every-day
+ * table, version 2 (no alarm effect) with the default effect.
+ *
+ * Nothing here touches flash, the caller reads and writes the blob.
+ */
+#ifndef MUSTANG_STORE_H
+#define MUSTANG_STORE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "mustang_cfg.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Defines */
+#define MSTORE_VERSION     3
+#define MSTORE_KEY         "cfg_blob"
+#define MSTORE_DEBOUNCE_MS 3000
+
+/* Which members of the blob are valid, same bits as MCFG_HAS_* */
+#define MSTORE_PERSISTED \
+    (MCFG_HAS_SSID | MCFG_HAS_PSK | MCFG_HAS_ALARMS | MCFG_HAS_FX)
+
+typedef struct {
+    uint8_t version;
+    uint8_t present;
+    char ssid[MCFG_SSID_MAX + 1];
+    char psk[MCFG_PSK_MAX + 1];
+    uint8_t alarm_count;
+    uint8_t alarms[MCFG_ALARMS_MAX * MCFG_ALARM_ENTRY_LEN];
+    uint8_t fx_len;              /* 0 = firmware default effect */
+    uint8_t fx[MCFG_FX_MAX];
+    uint8_t crc[2];              /* CRC-16 of everything before it */
+} mstore_blob_t;
+
+/* Older layouts, read for migration only */
+typedef struct {
+    uint8_t version;
+    uint8_t present;
+    char ssid[MCFG_SSID_MAX + 1];
+    char psk[MCFG_PSK_MAX + 1];
+    uint8_t alarm_count;
+    uint8_t alarms[MCFG_ALARMS_MAX * MCFG_ALARM_ENTRY_LEN];
+    uint8_t crc[2];
+} mstore_blob_v2_t;
+
+typedef struct {
+    uint8_t version;
+    uint8_t present;
+    char ssid[MCFG_SSID_MAX + 1];
+    char psk[MCFG_PSK_MAX + 1];
+    uint8_t alarm_hh;
+    uint8_t alarm_mm;
+    uint8_t alarm_flags;
+    uint8_t crc[2];
+} mstore_blob_v1_t;
+
+typedef struct {
+    mstore_blob_t blob;
+    bool dirty;
+    uint32_t changed_ms;         /* last change, starts the debounce window */
+} mstore_t;
+
+/* Helpers */
+static inline uint16_t mstore_crc(const mstore_blob_t *b) {
+    return mcfg_crc16(0xFFFF, (const uint8_t *)b, offsetof(mstore_blob_t, crc));
+}
+
+static inline void mstore_touch(mstore_t *s, uint32_t now_ms) {
+    s->dirty = true;
+    s->changed_ms = now_ms;
+}
+
+static inline void mstore_put_string(mstore_t *s, char *dst, size_t cap,
+                                     uint8_t bit, const char *src, size_t len,
+                                     uint32_t now_ms) {
+    if (len >= cap) {
+        len = cap - 1;
+    }
+    if ((s->blob.present & bit) && strlen(dst) == len &&
+        memcmp(dst, src, len) == 0) {
+        return;
+    }
+    memset(dst, 0, cap);
+    memcpy(dst, src, len);
+    s->blob.present |= bit;
+    mstore_touch(s, now_ms);
+}
+
+/* Public functions */
+static inline void mstore_init(mstore_t *s) {
+    memset(s, 0, sizeof(*s));
+    s->blob.version = MSTORE_VERSION;
+}
+
+static inline bool mstore_load_v1(mstore_t *s, const void *buf) {
+    const mstore_blob_v1_t *b = (const mstore_blob_v1_t *)buf;
+    uint16_t crc = mcfg_crc16(0xFFFF, (const uint8_t *)b,
+                              offsetof(mstore_blob_v1_t, crc));
+
+    if (b->version != 1 || crc != (uint16_t)(b->crc[0] | (b->crc[1] << 8))) {
+        return false;
+    }
+    memcpy(s->blob.ssid, b->ssid, sizeof(s->blob.ssid));
+    memcpy(s->blob.psk, b->psk, sizeof(s->blob.psk));
+    s->blob.present = b->present & (MCFG_HAS_SSID | MCFG_HAS_PSK);
+    if (b->present & MCFG_HAS_ALARM) {
+        mcfg_alarm_entry(s->blob.alarms, b->alarm_hh, b->alarm_mm,
+                         MCFG_ALARM_DAYS_ALL, b->alarm_flags, 0);
+        s->blob.alarm_count = 1;
+        s->blob.present |= MCFG_HAS_ALARMS;
+    }
+    mstore_touch(s, 0);
+    return true;
+}
+
+static inline bool mstore_load_v2(mstore_t *s, const void *buf) {
+    const mstore_blob_v2_t *b = (const mstore_blob_v2_t *)buf;
+    uint16_t crc = mcfg_crc16(0xFFFF, (const uint8_t *)b,
+                              offsetof(mstore_blob_v2_t, crc));
+
+    if (b->version != 2 || crc != (uint16_t)(b->crc[0] | (b->crc[1] << 8)) ||
+        b->alarm_count > MCFG_ALARMS_MAX) {
+        return false;
+    }
+    memcpy(s->blob.ssid, b->ssid, sizeof(s->blob.ssid));
+    memcpy(s->blob.psk, b->psk, sizeof(s->blob.psk));
+    s->blob.alarm_count = b->alarm_count;
+    memcpy(s->blob.alarms, b->alarms, sizeof(s->blob.alarms));
+    s->blob.present = b->present & (MCFG_HAS_SSID | MCFG_HAS_PSK |
+                                    MCFG_HAS_ALARMS);
+    mstore_touch(s, 0);
+    return true;
+}
+
+/*
+ * Adopt a blob read back from flash, current or an older layout. Returns
+ * false, and leaves the store empty, on a size, version or CRC mismatch.
+ */
+static inline bool mstore_load(mstore_t *s, const void *buf, size_t len) {
+    const mstore_blob_t *b = (const mstore_blob_t *)buf;
+
+    mstore_init(s);
+    if (len == sizeof(mstore_blob_v1_t) || len == sizeof(mstore_blob_v2_t)) {
+        if (len == sizeof(mstore_blob_v1_t) ? !mstore_load_v1(s, buf)
+                                            : !mstore_load_v2(s, buf)) {
+            mstore_init(s);
+            return false;
+        }
+    } else if (len != sizeof(mstore_blob_t) || b->version != MSTORE_VERSION ||
+               mstore_crc(b) != (uint16_t)(b->crc[0] | (b->crc[1] << 8)) ||
+               b->alarm_count > MCFG_ALARMS_MAX || b->fx_len > MCFG_FX_MAX) {
+        return false;
+    } else {
+        s->blob = *b;
+    }
+    s->blob.ssid[MCFG_SSID_MAX] = '\0';
+    s->blob.psk[MCFG_PSK_MAX] = '\0';
+    return true;
+}
+
+static inline void mstore_set_ssid(mstore_t *s, const char *ssid, size_t len,
+                                   uint32_t now_ms) {
+    mstore_put_string(s, s->blob.ssid, sizeof(s->blob.ssid), MCFG_HAS_SSID,
+                      ssid, len, now_ms);
+}
+
+static inline void mstore_set_psk(mstore_t *s, const char *psk, size_t len,
+                                  uint32_t now_ms) {
+    mstore_put_string(s, s->blob.psk, sizeof(s->blob.psk), MCFG_HAS_PSK, psk,
+                      len, now_ms);
+}
+
+/* Whole alarm table, count entries in MCFG_TAG_ALARMS wire format */
+static inline void mstore_set_alarms(mstore_t *s, const uint8_t *entries,
+                                     uint8_t count, uint32_t now_ms) {
+    size_t len = (size_t)count * MCFG_ALARM_ENTRY_LEN;
+
+    if (count > MCFG_ALARMS_MAX) {
+        return;
+    }
+    if ((s->blob.present & MCFG_HAS_ALARMS) && s->blob.alarm_count == count &&
+        memcmp(s->blob.alarms, entries, len) == 0) {
+        return;
+    }
+    memset(s->blob.alarms, 0, sizeof(s->blob.alarms));
+    memcpy(s->blob.alarms, entries, len);
+    s->blob.alarm_count = count;
+    s->blob.present |= MCFG_HAS_ALARMS;
+    mstore_touch(s, now_ms);
+}
+
+/* Single daily alarm of MCFG_TAG_ALARM, replaces the table */
+static inline void mstore_set_alarm(mstore_t *s, uint8_t hh, uint8_t mm,
+                                    uint8_t flags, uint32_t now_ms) {
+    uint8_t e[MCFG_ALARM_ENTRY_LEN];
+
+    mcfg_alarm_entry(e, hh, mm, MCFG_ALARM_DAYS_ALL, flags, 0);
+    mstore_set_alarms(s, e, 1, now_ms);
+}
+
+/* Alarm effect program, already through mfx_check(); len 0 = default */
+static inline void mstore_set_fx(mstore_t *s, const uint8_t *prog, uint8_t len,
+                                 uint32_t now_ms) {
+    if (len > MCFG_FX_MAX) {
+        return;
+    }
+    if ((s->blob.present & MCFG_HAS_FX) && s->blob.fx_len == len &&
+        memcmp(s->blob.fx, prog, len) == 0) {
+        return;
+    }
+    memset(s->blob.fx, 0, sizeof(s->blob.fx));
+    if (len > 0) {
+        memcpy(s->blob.fx, prog, len);
+    }
+    s->blob.fx_len = len;
+    s->blob.present |= MCFG_HAS_FX;
+    mstore_touch(s, now_ms);
+}
+
+/* Dirty and quiet for the debounce window, or commit requested */
+static inline bool mstore_due(const mstore_t *s, uint32_t now_ms,
+                              bool commit) {
+    return s->dirty &&
+           (commit || (uint32_t)(now_ms - s->changed_ms) >= MSTORE_DEBOUNCE_MS);
+}
+
+/* Milliseconds until mstore_due() turns true, UINT32_MAX when clean */
+static inline uint32_t mstore_wait_ms(const mstore_t *s, uint32_t now_ms) {
+    uint32_t quiet = now_ms - s->changed_ms;
+
+    if (!s->dirty) {
+        return UINT32_MAX;
+    }
+    return quiet >= MSTORE_DEBOUNCE_MS ? 0 : MSTORE_DEBOUNCE_MS - quiet;
+}
+
+/*
+ * Stamp the CRC and hand out the blob to write. The store counts as clean
+ * from here on; call mstore_touch() again if the write fails.
+ */
+static inline const mstore_blob_t *mstore_seal(mstore_t *s) {
+    uint16_t crc = mstore_crc(&s->blob);
+
+    s->blob.crc[0] = (uint8_t)(crc & 0xff);
+    s->blob.crc[1] = (uint8_t)(crc >> 8);
+    s->dirty = false;
+    return &s->blob;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MUSTANG_STORE_H
@@ -0,0 +1,222 @@
+/*
+ * Host simulation of config persistence, counts flash writes per session.
+ *
+ *   cc -std=c99 -Wall -o mustang_store_sim protocol/mustang_store_sim.c
+ *   ./mustang_store_sim
+ *
+ * Replays the same app sessions against three schemes:
+ *   - per-key:   Preferences put* per field, each one a commit
+ *   - per-msg:   every field of a message, one commit per message
+ *   - blob:      mustang_store.h, debounced, one record per flush
+ *
+ * A "commit" is one flash commit; "entries" are 32-byte NVS entries
+ * written (one header entry per key plus the data entries of strings and
+ * blobs), the unit NVS pages wear in.
+ */
+#include <stdio.h>
+
+#include "mustang_store.h"
+
+/* Defines */
+#define NVS_ENTRY_SIZE 32
+#define SIM_MAX_MSGS   16
+
+typedef struct {
+    uint32_t at_ms;
+    uint8_t present;
+    const char *ssid;
+    const char *psk;
+    uint8_t alarm_hh;
+    uint8_t alarm_mm;
+    uint8_t alarm_flags;
+} sim_msg_t;
+
+typedef struct {
+    const char *name;
+    int count;
+    sim_msg_t msgs[SIM_MAX_MSGS];
+} sim_session_t;
+
+typedef struct {
+    unsigned commits;
+    unsigned entries;
+} sim_cost_t;
+
+/* Private functions */
+static unsigned str_entries(const char *s) {
+    return 1 + (unsigned)(strlen(s) + 1 + NVS_ENTRY_SIZE - 1) / NVS_ENTRY_SIZE;
+}
+
+static sim_cost_t run_per_key(const sim_session_t *s) {
+    sim_cost_t c = {0, 0};
+
+    for (int i = 0; i < s->count; i++) {
+        const sim_msg_t *m = &s->msgs[i];
+        if (m->present & MCFG_HAS_SSID) {
+            c.commits++;
+            c.entries += str_entries(m->ssid);
+        }
+        if (m->present & MCFG_HAS_PSK) {
+            c.commits++;
+            c.entries += str_entries(m->psk);
+        }
+        if (m->present & MCFG_HAS_ALARM) {
+            c.commits += 3; /* alarm_h, alarm_m, alarm_en */
+            c.entries += 3;
+        }
+    }
+    return c;
+}
+
+static sim_cost_t run_per_msg(const sim_session_t *s) {
+    sim_cost_t c = {0, 0};
+
+    for (int i = 0; i < s->count; i++) {
+        const sim_msg_t *m = &s->msgs[i];
+        if (!(m->present & (MSTORE_PERSISTED | MCFG_HAS_ALARM))) {
+            continue;
+        }
+        c.commits++;
+        if (m->present & MCFG_HAS_SSID) {
+            c.entries += str_entries(m->ssid);
+        }
+        if (m->present & MCFG_HAS_PSK) {
+            c.entries += str_entries(m->psk);
+        }
+        if (m->present & MCFG_HAS_ALARM) {
+            c.entries += 3;
+        }
+    }
+    return c;
+}
+
+static void blob_flush(mstore_t *st, sim_cost_t *c) {
+    mstore_seal(st);
+    c->commits++;
+    c->entries += 1 + (sizeof(mstore_blob_t) + NVS_ENTRY_SIZE - 1) /
+                          NVS_ENTRY_SIZE;
+}
+
+/* Same loop as the firmware: apply, then flush when due */
+static sim_cost_t run_blob(const sim_session_t *s, const mstore_t *boot) {
+    sim_cost_t c = {0, 0};
+    mstore_t st = *boot;
+
+    for (int i = 0; i < s->count; i++) {
+        const sim_msg_t *m = &s->msgs[i];
+
+        /* Debounce expiring between messages */
+        if (mstore_due(&st, m->at_ms, false)) {
+            blob_flush(&st, &c);
+        }
+
+        if (m->present & MCFG_HAS_SSID) {
+            mstore_set_ssid(&st, m->ssid, strlen(m->ssid), m->at_ms);
+        }
+        if (m->present & MCFG_HAS_PSK) {
+            mstore_set_psk(&st, m->psk, strlen(m->psk), m->at_ms);
+        }
+        if (m->present & MCFG_HAS_ALARM) {
+            mstore_set_alarm(&st, m->alarm_hh, m->alarm_mm, m->alarm_flags,
+                             m->at_ms);
+        }
+        if (mstore_due(&st, m->at_ms, m->present & MCFG_HAS_COMMIT)) {
+            blob_flush(&st, &c);
+        }
+    }
+
+    /* Session over, the debounce window runs out */
+    if (mstore_due(&st, UINT32_MAX / 2, false)) {
+        blob_flush(&st, &c);
+    }
+    return c;
+}
+
+/* Sessions, times in ms since connect */
+static const sim_session_t sessions[] = {
+    {"first setup, apply all",
+     1,
+     {
+         {0,
+          MCFG_HAS_SSID | MCFG_HAS_PSK | MCFG_HAS_TIME | MCFG_HAS_ALARM |
+              MCFG_HAS_COMMIT,
+          "HomeNet", "correct horse battery", 6, 45, MCFG_ALARM_F_ENABLED},
+     }},
+    {"per-box sends",
+     4,
+     {
+         {0, MCFG_HAS_SSID | MCFG_HAS_PSK, "HomeNet", "correct horse battery"},
+         {1500, MCFG_HAS_TIME},
+         {2500, MCFG_HAS_ALARM, NULL, NULL, 6, 30, MCFG_ALARM_F_ENABLED},
+         {4000, MCFG_HAS_ALARM, NULL, NULL, 6, 45, MCFG_ALARM_F_ENABLED},
+     }},
+    {"alarm fiddling",
+     6,
+     {
+         {0, MCFG_HAS_ALARM, NULL, NULL, 7, 0, MCFG_ALARM_F_ENABLED},
+         {600, MCFG_HAS_ALARM, NULL, NULL, 7, 5, MCFG_ALARM_F_ENABLED},
+         {1200, MCFG_HAS_ALARM, NULL, NULL, 7, 10, MCFG_ALARM_F_ENABLED},
+         {1800, MCFG_HAS_ALARM, NULL, NULL, 7, 15, MCFG_ALARM_F_ENABLED},
+         {2400, MCFG_HAS_ALARM, NULL, NULL, 7, 15, 0},
+         {3000, MCFG_HAS_ALARM, NULL, NULL, 7, 15, MCFG_ALARM_F_ENABLED},
+     }},
+    {"fleet re-provision, unchanged",
+     1,
+     {
+         {0,
+          MCFG_HAS_SSID | MCFG_HAS_PSK | MCFG_HAS_TIME | MCFG_HAS_ALARM |
+              MCFG_HAS_COMMIT,
+          "HomeNet", "correct horse battery", 7, 15, MCFG_ALARM_F_ENABLED},
+     }},
+};
+
+int main(void) {
+    mstore_t boot;
+    sim_cost_t total[3] = {{0, 0}, {0, 0}, {0, 0}};
+
+    /* The sessions run back to back on one clock */
+    mstore_init(&boot);
+
+    printf("%-32s %16s %16s %16s\n", "session", "per-key", "per-msg",
+           "blob");
+    printf("%-32s %16s %16s %16s\n", "", "commits/entries", "commits/entries",
+           "commits/entries");
+
+    for (size_t i = 0; i < sizeof(sessions) / sizeof(sessions[0]); i++) {
+        const sim_session_t *s = &sessions[i];
+        sim_cost_t c[3];
+
+        c[0] = run_per_key(s);
+        c[1] = run_per_msg(s);
+        c[2] = run_blob(s, &boot);
+
+        /* Carry the stored config into the next session */
+        for (int m = 0; m < s->count; m++) {
+            const sim_msg_t *msg = &s->msgs[m];
+            if (msg->present & MCFG_HAS_SSID) {
+                mstore_set_ssid(&boot, msg->ssid, strlen(msg->ssid), 0);
+            }
+            if (msg->present & MCFG_HAS_PSK) {
+                mstore_set_psk(&boot, msg->psk, strlen(msg->psk), 0);
+            }
+            if (msg->present & MCFG_HAS_ALARM) {
+                mstore_set_alarm(&boot, msg->alarm_hh, msg->alarm_mm,
+                                 msg->alarm_flags, 0);
+            }
+        }
+        mstore_seal(&boot);
+
+        printf("%-32s %8u/%-7u %8u/%-7u %8u/%-7u\n", s->name, c[0].commits,
+               c[0].entries, c[1].commits, c[1].entries, c[2].commits,
+               c[2].entries);
+        for (int k = 0; k < 3; k++) {
+            total[k].commits += c[k].commits;
+            total[k].entries += c[k].entries;
+        }
+    }
+
+    printf("%-32s %8u/%-7u %8u/%-7u %8u/%-7u\n", "total", total[0].commits,
+           total[0].entries, total[1].commits, total[1].entries,
+           total[2].commits, total[2].entries);
+    return 0;
+}
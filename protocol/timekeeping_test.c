@@ -0,0 +1,158 @@
+/*
+ * Host soak of the tm1637_display timekeeping: months of jittery ticks.
+ *
+ *   cc -std=c99 -Wall -Iprotocol/host -Ifirmware/esp-idf/tm1637_display/main \
+ *       -o timekeeping_test protocol/timekeeping_test.c \
+ *       firmware/esp-idf/tm1637_display/main/timekeeping.c \
+ *       firmware/esp-idf/tm1637_display/main/clock_tick.c \
+ *       protocol/host/esp_host.c
+ *   ./timekeeping_test [days] [seed]
+ *
+ * timekeeping.c runs unchanged on the simulated esp_timer of protocol/host.
+ * Every second boundary callback fires late by a random jitter, now and then
+ * by whole seconds (missed callbacks), and once a day an SNTP-like step
+ * moves the epoch by up to half a second either way. The run is long past
+ * the 49.7 days at which a 32-bit millisecond clock wraps.
+ *
+ * Checked all along: wall time never goes back except at a backward step,
+ * every callback publishes the second it runs in (no drift, however late the
+ * callbacks were before), its lag behind the boundary is only the lateness
+ * of that callback, and after a step the offset is exactly the one set.
+ * Exits non-zero on the first mismatch.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "timekeeping.h"
+
+/* Defines */
+#define TEST_DAYS_DEFAULT 120
+#define TEST_BOOT_US      (5 * TIMEKEEPING_US_PER_SEC)
+#define TEST_EPOCH_S      1767225600LL   /* 2026-01-01 00:00:00 UTC */
+#define TEST_JITTER_US    3000           /* normal lateness of a callback */
+#define TEST_STEP_MAX_US  500000         /* SNTP step, either way */
+
+static uint32_t rng_state;
+static int failures;
+
+/* Private functions */
+static uint32_t rnd(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static void expect(bool ok, const char *what, int64_t wall_us) {
+    if (!ok && failures++ < 10) {
+        fprintf(stderr, "FAIL %s at %lld.%06lld\n", what,
+                (long long)(wall_us / TIMEKEEPING_US_PER_SEC),
+                (long long)(wall_us % TIMEKEEPING_US_PER_SEC));
+    }
+}
+
+static bool same_time(clock_time_t a, clock_time_t b) {
+    return a.hours == b.hours && a.minutes == b.minutes && a.seconds == b.seconds;
+}
+
+/* Mostly jitter, sometimes whole missed seconds within the catch-up window */
+static int64_t lateness(void) {
+    if (rnd() % 5000 == 0) {
+        return (int64_t)(1 + rnd() % (CLOCK_TICK_QUEUE_LEN - 1)) *
+                   TIMEKEEPING_US_PER_SEC + rnd() % TEST_JITTER_US;
+    }
+    return rnd() % TEST_JITTER_US;
+}
+
+int main(int argc, char **argv) {
+    int days = argc > 1 ? atoi(argv[1]) : TEST_DAYS_DEFAULT;
+    clock_subscriber_t *sub;
+    clock_tick_t tick;
+    int64_t end_us;
+    int64_t last_wall;
+    int64_t last_second = TEST_EPOCH_S;
+    int64_t worst_lag = 0;
+    int64_t late = 0;
+    int64_t next_step;
+    unsigned callbacks = 0;
+    unsigned ticks = 0;
+    unsigned steps = 0;
+
+    rng_state = argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 0) : 0x54494d45;
+    if (rng_state == 0) {
+        rng_state = 1;
+    }
+
+    host_timer_reset(TEST_BOOT_US);
+    sub = ClockTick_subscribe("soak");
+    if (sub == NULL || !Timekeeping_start(TEST_EPOCH_S)) {
+        fprintf(stderr, "FAIL start\n");
+        return 1;
+    }
+    expect(Timekeeping_nowUs() == TEST_EPOCH_S * TIMEKEEPING_US_PER_SEC,
+           "start sets the epoch", 0);
+
+    end_us = (TEST_EPOCH_S + (int64_t)days * TIMEKEEPING_SEC_PER_DAY) *
+             TIMEKEEPING_US_PER_SEC;
+    next_step = TEST_EPOCH_S * TIMEKEEPING_US_PER_SEC;
+    last_wall = Timekeeping_nowUs();
+
+    while (last_wall < end_us && failures == 0) {
+        int64_t wall;
+        int64_t second;
+        bool got = false;
+
+        late = lateness();
+        host_timer_fire(late);
+        callbacks++;
+
+        wall = Timekeeping_nowUs();
+        second = wall / TIMEKEEPING_US_PER_SEC;
+        expect(wall >= last_wall, "wall time went back", wall);
+        last_wall = wall;
+
+        /* The display always ends up on the current second */
+        while (ClockTick_wait(sub, &tick, 0)) {
+            got = true;
+            ticks++;
+        }
+        /* Nothing new only when a backward step landed before the boundary */
+        expect(got || second == last_second, "callback published", wall);
+        last_second = second;
+        expect(same_time(tick.time, Timekeeping_timeOfDay(wall)),
+               "published second is the current one", wall);
+        expect(sub->dropped == 0, "no tick dropped", wall);
+
+        /* Lag behind the boundary is this callback's lateness, nothing more */
+        if (wall - second * TIMEKEEPING_US_PER_SEC > worst_lag) {
+            worst_lag = wall - second * TIMEKEEPING_US_PER_SEC;
+        }
+        expect(wall - second * TIMEKEEPING_US_PER_SEC <= late,
+               "lag within the callback's lateness", wall);
+
+        if (wall >= next_step) {
+            int64_t step = (int64_t)(rnd() % (2 * TEST_STEP_MAX_US)) -
+                           TEST_STEP_MAX_US;
+
+            Timekeeping_setEpochUs(wall + step);
+            expect(Timekeeping_nowUs() == wall + step, "step sets the epoch",
+                   wall);
+            last_wall = wall + step;
+            next_step += TIMEKEEPING_SEC_PER_DAY * TIMEKEEPING_US_PER_SEC;
+            steps++;
+        }
+    }
+
+    printf("%d days: %u callbacks, %u ticks, %u steps, worst lag %lld us, "
+           "%u late warnings\n",
+           days, callbacks, ticks, steps, (long long)worst_lag,
+           host_log_warnings);
+    if (failures) {
+        printf("FAIL: %d mismatches\n", failures);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
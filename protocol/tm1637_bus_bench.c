@@ -0,0 +1,174 @@
+/*
+ * Bus time per TM1637 frame, measured on the host simulator.
+ *
+ *   cc -std=c99 -Wall -Ifirmware/esp-idf/tm1637_display/main \
+ *       -o tm1637_bus_bench protocol/tm1637_bus_bench.c \
+ *       firmware/esp-idf/tm1637_display/main/tm1637.c \
+ *       firmware/esp-idf/tm1637_display/main/tm1637_sim.c
+ *   ./tm1637_bus_bench [bit delay us]
+ *
+ * tm1637.c bit-bangs into tm1637_sim.c, whose clock only moves with the bit
+ * delays, so every figure is exact bus time and the same on any machine.
+ * Reported per bit delay (the default DEFAULT_BIT_DELAY, or the one given):
+ * the start()/writeByte()/stop() primitives, then each kind of update the
+ * clock makes - a full rewrite, the per-second colon toggle, minute changes
+ * carrying into one to four digits, a brightness change and an unchanged
+ * frame - and the average over a whole day of per-second updates.
+ *
+ * Every frame has to be ACKed and leave the simulated chip showing what
+ * TM1637_encodeTime() rendered; an unchanged frame has to cost nothing.
+ * Exits non-zero on the first mismatch.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tm1637.h"
+#include "tm1637_sim.h"
+
+/* Defines */
+#define BENCH_BRIGHTNESS 0x03
+
+typedef struct {
+    size_t frames;
+    unsigned bytes;
+    uint64_t busUs;
+} bench_cost_t;
+
+static int failures;
+static uint8_t latched[4];   /* what the chip shows, for the checks */
+static bool latchedValid;
+
+/* Private functions */
+static void expect(bool ok, const char *what) {
+    if (!ok && failures++ < 10) {
+        fprintf(stderr, "FAIL %s\n", what);
+    }
+}
+
+/* Frames and bus time of what ran since the last TM1637_simReset() */
+static bench_cost_t cost(void) {
+    bench_cost_t c = {.frames = TM1637_simFrameCount(),
+                      .busUs = TM1637_simBusTimeUs()};
+
+    for (size_t i = 0; i < c.frames; i++) {
+        const tm1637_sim_frame_t *frame = TM1637_simFrame(i);
+
+        c.bytes += frame->length;
+        expect(frame->acked, "frame ACKed");
+    }
+    expect(TM1637_simDroppedFrames() == 0 && TM1637_simDroppedEdges() == 0,
+           "trace large enough");
+    return c;
+}
+
+static void invalidate(void) {
+    TM1637_invalidate();
+    latchedValid = false;
+}
+
+/*
+ * One showTime() from the current latched state. The simulator starts
+ * blank after the reset, so a digit not clocked out must be one that
+ * did not change.
+ */
+static bench_cost_t show(uint8_t hours, uint8_t minutes, bool colon) {
+    const uint8_t *segments;
+    uint8_t want[4];
+
+    TM1637_simReset();
+    TM1637_showTime(hours, minutes, colon, true);
+    TM1637_encodeTime(hours, minutes, colon, true, want);
+    segments = TM1637_simDisplay()->segments;
+    for (int d = 0; d < 4; d++) {
+        expect(segments[d] == want[d] ||
+                   (latchedValid && latched[d] == want[d] && segments[d] == 0),
+               "display shows the time");
+    }
+    memcpy(latched, want, sizeof(latched));
+    latchedValid = true;
+    return cost();
+}
+
+static void row(const char *name, bench_cost_t c) {
+    printf("  %-28s %2u frames %3u bytes %8.1f us\n", name, (unsigned)c.frames,
+           c.bytes, (double)c.busUs);
+}
+
+static void primitives(void) {
+    uint64_t t0;
+
+    TM1637_simReset();
+    t0 = TM1637_simTimeUs();
+    start();
+    printf("  %-28s %8.1f us\n", "start()",
+           (double)(TM1637_simTimeUs() - t0));
+    t0 = TM1637_simTimeUs();
+    expect(writeByte(0x40), "writeByte ACKed");
+    printf("  %-28s %8.1f us\n", "writeByte() with ACK",
+           (double)(TM1637_simTimeUs() - t0));
+    t0 = TM1637_simTimeUs();
+    stop();
+    printf("  %-28s %8.1f us\n", "stop()", (double)(TM1637_simTimeUs() - t0));
+    invalidate();
+}
+
+static void updates(void) {
+    bench_cost_t c;
+
+    invalidate();
+    row("full rewrite 12:34", show(12, 34, true));
+    row("colon toggle", show(12, 34, false));
+    c = show(12, 34, false);
+    expect(c.frames == 0 && c.busUs == 0, "unchanged frame is free");
+    row("unchanged", c);
+    row("minute, 1 digit 12:35", show(12, 35, false));
+    show(12, 39, false);
+    row("minute, 2 digits 12:40", show(12, 40, false));
+    show(12, 59, false);
+    row("hour, 3 digits 13:00", show(13, 0, false));
+    show(19, 59, false);
+    row("hour, 4 digits 20:00", show(20, 0, false));
+
+    TM1637_simReset();
+    TM1637_setBrightness(BENCH_BRIGHTNESS + 1, true);
+    TM1637_showTime(20, 0, false, true);
+    row("brightness only", cost());
+    TM1637_setBrightness(BENCH_BRIGHTNESS, true);
+}
+
+/* What the display task costs over a day: one update per second */
+static void day(void) {
+    uint64_t busUs = 0;
+    unsigned frames = 0;
+
+    invalidate();
+    for (int second = 0; second < 86400; second++) {
+        bench_cost_t c = show(second / 3600, second / 60 % 60, second & 1);
+
+        busUs += c.busUs;
+        frames += c.frames;
+    }
+    printf("  %-28s %8.1f us per second, %u frames, %.2f s of bus a day\n",
+           "day of updates", busUs / 86400.0, frames, busUs / 1e6);
+}
+
+int main(int argc, char **argv) {
+    unsigned bitDelay = argc > 1 ? (unsigned)atoi(argv[1]) : DEFAULT_BIT_DELAY;
+
+    TM1637_setPort(TM1637_simPort());
+    TM1637_Init(0, 1, bitDelay);
+    TM1637_setBrightness(BENCH_BRIGHTNESS, true);
+
+    printf("bit delay %u us\n", bitDelay);
+    primitives();
+    updates();
+    day();
+
+    if (failures) {
+        printf("FAIL: %d mismatches\n", failures);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
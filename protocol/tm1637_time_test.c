@@ -0,0 +1,86 @@
+/*
+ * Host check of the table-driven HH:MM renderer in tm1637.c.
+ *
+ *   cc -std=c99 -Wall -Ifirmware/esp-idf/tm1637_display/main \
+ *       -o tm1637_time_test protocol/tm1637_time_test.c \
+ *       firmware/esp-idf/tm1637_display/main/tm1637.c
+ *   ./tm1637_time_test
+ *
+ * Every one of the 1440 minutes, with and without the colon and the
+ * leading hour zero, is rendered by TM1637_encodeTime() and compared with
+ * the same time built digit by digit through encodeDigit(), and with what
+ * TM1637_formatNumberDecEx() shows for hour * 100 + minute wherever the old
+ * path rendered the time (it blanks every leading zero, including the
+ * minutes of " 0:05", so only hours from 10 up without the leading zero).
+ * Exits non-zero on the first mismatch.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "tm1637.h"
+
+/* Defines */
+#define TEST_COLON 0x80   /* dots bit of the colon, between digit 1 and 2 */
+
+static int failures;
+
+/* Private functions */
+static void reference(uint8_t hours, uint8_t minutes, bool colon,
+                      bool leading_zero, uint8_t *digits) {
+    digits[0] = hours < 10 && !leading_zero ? 0 : encodeDigit(hours / 10);
+    digits[1] = encodeDigit(hours % 10) | (colon ? TEST_COLON : 0);
+    digits[2] = encodeDigit(minutes / 10);
+    digits[3] = encodeDigit(minutes % 10);
+}
+
+static void expect_digits(const uint8_t *got, const uint8_t *want,
+                          const char *what, int hours, int minutes,
+                          bool colon, bool leading_zero) {
+    if (memcmp(got, want, 4) != 0 && failures++ < 10) {
+        fprintf(stderr,
+                "FAIL %s %02d:%02d colon=%d zero=%d: "
+                "%02x %02x %02x %02x, want %02x %02x %02x %02x\n",
+                what, hours, minutes, colon, leading_zero, got[0], got[1],
+                got[2], got[3], want[0], want[1], want[2], want[3]);
+    }
+}
+
+int main(void) {
+    unsigned checked = 0;
+    unsigned legacy = 0;
+
+    for (int hours = 0; hours < 24; hours++) {
+        for (int minutes = 0; minutes < 60; minutes++) {
+            for (int flags = 0; flags < 4; flags++) {
+                bool colon = flags & 1;
+                bool leading_zero = flags & 2;
+                uint8_t got[4];
+                uint8_t want[4];
+
+                TM1637_encodeTime(hours, minutes, colon, leading_zero, got);
+                reference(hours, minutes, colon, leading_zero, want);
+                expect_digits(got, want, "encodeDigit", hours, minutes,
+                              colon, leading_zero);
+                checked++;
+
+                if (leading_zero || hours >= 10) {
+                    TM1637_formatNumberDecEx(hours * 100 + minutes,
+                                             colon ? TEST_COLON : 0,
+                                             leading_zero, 4, want);
+                    expect_digits(got, want, "formatNumberDecEx", hours,
+                                  minutes, colon, leading_zero);
+                    legacy++;
+                }
+            }
+        }
+    }
+
+    printf("%u renderings, %u against TM1637_formatNumberDecEx\n", checked,
+           legacy);
+    if (failures) {
+        printf("FAIL: %d mismatches\n", failures);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}